@@ -0,0 +1,71 @@
+// Maps addresses back to source lines using a line map written by the assemblers' --linemap option
+// Build: gcc -O2 sicaddr2line.c -o sicaddr2line
+// Usage: ./sicaddr2line <line_map> <hex_address>...   (addresses are read from standard input if none are given)
+#include "siccompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "siclinemap.h"
+
+// Prints ADDRESS FILE:LINE LABEL+OFFSET, or ?? for an address no statement produced
+void printLocation(const LineMap* map, const char* text)
+{
+    char* end = NULL;
+    int address = (int)strtol(text, &end, 16);
+    if (end == text)
+    {
+        fprintf(stderr, "Error: Invalid address %s\n", text);
+        return;
+    }
+    LineMapLocation location;
+    if (!lookupLineMap(map, address, &location))
+    {
+        printf("%06X\t??\n", address);
+        return;
+    }
+    printf("%06X\t%s:%d", address, location.file != NULL ? location.file : "??", location.line);
+    if (location.label != NULL)
+    {
+        printf("\t%s", location.label);
+    }
+    if (address != location.address)
+    {
+        printf("\t(+%d into the statement at %06X)", address - location.address, location.address);
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        printf("\nUsage: %s <line_map> [hex_address...]\n", argv[0]);
+        return 1;
+    }
+    LineMap map;
+    if (!openLineMap(argv[1], &map))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 2)
+    {
+        for (int i = 2; i < argc; i++)
+        {
+            printLocation(&map, argv[i]);
+        }
+    }
+    else // One address per line, so a simulator's fault log can be piped straight in
+    {
+        char line[64];
+        while (fgets(line, sizeof(line), stdin))
+        {
+            if (line[0] != '\n')
+            {
+                printLocation(&map, line);
+            }
+        }
+    }
+    closeLineMap(&map);
+    return 0;
+}
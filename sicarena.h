@@ -0,0 +1,142 @@
+// Bump (arena) allocator: allocations are carved out of large blocks and all released together with one reset
+#ifndef SICARENA_H
+#define SICARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 8
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    unsigned char data[];
+} ArenaBlock;
+
+// Blocks stay chained after a reset and are reused in order, so a reset arena allocates nothing until it outgrows its high-water mark
+typedef struct Arena
+{
+    ArenaBlock* first;
+    ArenaBlock* current;
+} Arena;
+
+static inline ArenaBlock* arenaNewBlock(size_t minimumSize)
+{
+    size_t size = minimumSize > ARENA_BLOCK_SIZE ? minimumSize : ARENA_BLOCK_SIZE;
+    ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL)
+    {
+        printf("Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// Returns size bytes aligned to 8, moving on to the next (or a new) block when the current one is full
+static inline void* arenaAlloc(Arena* arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (arena->current == NULL)
+    {
+        arena->first = arena->current = arenaNewBlock(size);
+    }
+    while (arena->current->used + size > arena->current->size)
+    {
+        ArenaBlock* next = arena->current->next;
+        if (next == NULL || next->size < size)
+        {
+            // Splice a fresh block in here; any smaller blocks after it are still reused on later resets
+            ArenaBlock* block = arenaNewBlock(size);
+            block->next = next;
+            arena->current->next = block;
+            next = block;
+        }
+        arena->current = next;
+        arena->current->used = 0;
+    }
+    void* pointer = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    return pointer;
+}
+
+static inline char* arenaStrndup(Arena* arena, const char* text, size_t length)
+{
+    char* copy = arenaAlloc(arena, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static inline char* arenaStrdup(Arena* arena, const char* text)
+{
+    return arenaStrndup(arena, text, strlen(text));
+}
+
+// Releases everything allocated from the arena at once, keeping the blocks for reuse
+static inline void arenaReset(Arena* arena)
+{
+    arena->current = arena->first;
+    if (arena->current != NULL)
+    {
+        arena->current->used = 0;
+    }
+}
+
+// Returns the blocks to the system
+static inline void arenaFree(Arena* arena)
+{
+    ArenaBlock* block = arena->first;
+    while (block != NULL)
+    {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = arena->current = NULL;
+}
+
+// Reads one line of any length (including its newline, like fgets) into the arena. Returns NULL at end of file
+static inline char* arenaReadLine(Arena* arena, FILE* file)
+{
+    char chunk[256];
+    if (!fgets(chunk, sizeof(chunk), file))
+    {
+        return NULL;
+    }
+    size_t length = strlen(chunk);
+    if (length == 0 || chunk[length - 1] == '\n' || feof(file))
+    {
+        return arenaStrndup(arena, chunk, length);
+    }
+
+    // Longer than one chunk, so keep doubling a buffer in the arena until the newline turns up
+    size_t capacity = 2 * sizeof(chunk);
+    char* line = arenaAlloc(arena, capacity);
+    memcpy(line, chunk, length + 1);
+    while (line[length - 1] != '\n' && fgets(chunk, sizeof(chunk), file))
+    {
+        size_t chunkLength = strlen(chunk);
+        if (length + chunkLength + 1 > capacity)
+        {
+            while (length + chunkLength + 1 > capacity)
+            {
+                capacity *= 2;
+            }
+            char* grown = arenaAlloc(arena, capacity);
+            memcpy(grown, line, length);
+            line = grown;
+        }
+        memcpy(line + length, chunk, chunkLength + 1);
+        length += chunkLength;
+    }
+    return line;
+}
+
+#endif
@@ -0,0 +1,575 @@
+// Microbenchmarks for the inner-loop primitives of the SIC/XE assembler (symbol table, opcode lookups, encoders, T records)
+// Build: gcc -O2 sicbench.c -o sicbench
+// Usage: ./sicbench [--filter <text>] [--warmup <n>] [--reps <n>] [--json <file>]
+#include "siccompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// Every general-purpose allocation made by the assembler code is counted
+static long long benchAllocations = 0;
+static long long benchAllocatedBytes = 0;
+
+static void* benchMalloc(size_t size)
+{
+    benchAllocations++;
+    benchAllocatedBytes += size;
+    return malloc(size);
+}
+
+#define malloc(size) benchMalloc(size)
+#define SICXEASM_NO_MAIN
+#include "sicxeasm.c"
+#undef malloc
+
+// Result of one benchmark, all times in nanoseconds per operation
+typedef struct BenchResult
+{
+    char name[48];
+    long long param;
+    long long iterations;
+    int repetitions;
+    double median, mean, stddev, min, max;
+    double allocationsPerOp, bytesPerOp;
+} BenchResult;
+
+// A benchmark body runs the operation 'iterations' times; setup (if any) runs untimed before every batch
+typedef void (*BenchSetup)(long long param);
+typedef void (*BenchBody)(long long param, long long iterations);
+
+int warmupReps = 3;
+int measuredReps = 15;
+const char* nameFilter = NULL;
+volatile long long benchSink = 0; // Keeps the optimizer from discarding results
+
+double nowNanoseconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Times one batch, returning ns/op. The per-statement arena is reset afterwards, as pass 2 does after every line
+double timeBatch(BenchSetup setup, BenchBody body, long long param, long long iterations)
+{
+    if (setup != NULL)
+    {
+        setup(param);
+    }
+    double start = nowNanoseconds();
+    body(param, iterations);
+    double elapsed = nowNanoseconds() - start;
+    arenaReset(&lineArena);
+    return elapsed / (double)iterations;
+}
+
+// Runs warmup batches, calibrates the batch size to roughly 10ms (unless fixed), then records the measured repetitions
+BenchResult runBenchmark(const char* name, long long param, BenchSetup setup, BenchBody body, long long fixedIterations)
+{
+    BenchResult result;
+    memset(&result, 0, sizeof(result));
+    snprintf(result.name, sizeof(result.name), "%s", name);
+    result.param = param;
+
+    long long iterations = fixedIterations > 0 ? fixedIterations : 64;
+    if (fixedIterations <= 0)
+    {
+        while (iterations < (1LL << 30) && timeBatch(setup, body, param, iterations) * iterations < 10e6)
+        {
+            iterations *= 2;
+        }
+    }
+    for (int i = 0; i < warmupReps; i++)
+    {
+        timeBatch(setup, body, param, iterations);
+    }
+
+    double* samples = calloc(measuredReps, sizeof(double));
+    long long allocationsBefore = benchAllocations, bytesBefore = benchAllocatedBytes;
+    for (int i = 0; i < measuredReps; i++)
+    {
+        samples[i] = timeBatch(setup, body, param, iterations);
+    }
+    long long operations = iterations * measuredReps;
+    result.allocationsPerOp = (double)(benchAllocations - allocationsBefore) / operations;
+    result.bytesPerOp = (double)(benchAllocatedBytes - bytesBefore) / operations;
+
+    qsort(samples, measuredReps, sizeof(double), compareDoubles);
+    double sum = 0, squares = 0;
+    for (int i = 0; i < measuredReps; i++)
+    {
+        sum += samples[i];
+    }
+    result.mean = sum / measuredReps;
+    for (int i = 0; i < measuredReps; i++)
+    {
+        squares += (samples[i] - result.mean) * (samples[i] - result.mean);
+    }
+    result.stddev = measuredReps > 1 ? sqrt(squares / (measuredReps - 1)) : 0;
+    result.median = (measuredReps % 2) ? samples[measuredReps / 2] : (samples[measuredReps / 2 - 1] + samples[measuredReps / 2]) / 2;
+    result.min = samples[0];
+    result.max = samples[measuredReps - 1];
+    result.iterations = iterations;
+    result.repetitions = measuredReps;
+    free(samples);
+    return result;
+}
+
+//////////////////// Symbol table ////////////////////
+
+char (*symbolNames)[7] = NULL;
+long long symbolNamesCount = 0;
+
+// Generates n distinct 6 character labels (S + 5 base-36 digits) in a shuffled order
+void generateSymbolNames(long long n)
+{
+    const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    free(symbolNames);
+    symbolNames = malloc(n * sizeof(*symbolNames));
+    for (long long i = 0; i < n; i++)
+    {
+        long long value = i;
+        symbolNames[i][0] = 'S';
+        for (int j = 5; j >= 1; j--)
+        {
+            symbolNames[i][j] = digits[value % 36];
+            value /= 36;
+        }
+        symbolNames[i][6] = '\0';
+    }
+    unsigned int seed = 12345;
+    for (long long i = n - 1; i > 0; i--)
+    {
+        seed = seed * 1103515245 + 12345;
+        long long j = seed % (i + 1);
+        char temp[7];
+        memcpy(temp, symbolNames[i], 7);
+        memcpy(symbolNames[i], symbolNames[j], 7);
+        memcpy(symbolNames[j], temp, 7);
+    }
+    symbolNamesCount = n;
+}
+
+// Empties the symbol table and everything it allocated
+void resetSymbols(long long n)
+{
+    arenaReset(&assemblyArena);
+    resetSymbolTable(&assemblyArena);
+}
+
+void fillSymbols(long long n)
+{
+    resetSymbols(n);
+    for (long long i = 0; i < n; i++)
+    {
+        addSymbol(symbolNames[i], (int)i);
+    }
+}
+
+// Inserts all n symbols into an empty table; one "operation" is one insert
+void benchSymbolInsert(long long n, long long iterations)
+{
+    for (long long i = 0; i < iterations; i++)
+    {
+        addSymbol(symbolNames[i], (int)i);
+    }
+}
+
+void benchSymbolLookup(long long n, long long iterations)
+{
+    long long total = 0;
+    for (long long i = 0; i < iterations; i++)
+    {
+        total += getSymbolAddress(symbolNames[(i * 7919) % n]);
+    }
+    benchSink += total;
+}
+
+//////////////////// Mnemonic classification ////////////////////
+
+char* mnemonicMix[] = { "LDA", "+JSUB", "STCH", "TIXR", "COMPR", "RSUB", "WD", "CLEAR", "+LDT", "J", "BOGUS", "STX" };
+#define MNEMONIC_MIX_SIZE (sizeof(mnemonicMix) / sizeof(mnemonicMix[0]))
+
+void benchIsValidOpcode(long long param, long long iterations)
+{
+    long long total = 0;
+    for (long long i = 0; i < iterations; i++)
+    {
+        total += isValidOpcode(mnemonicMix[i % MNEMONIC_MIX_SIZE]);
+    }
+    benchSink += total;
+}
+
+void benchGetFormat(long long param, long long iterations)
+{
+    long long total = 0;
+    for (long long i = 0; i < iterations; i++)
+    {
+        total += getFormat(mnemonicMix[i % MNEMONIC_MIX_SIZE]);
+    }
+    benchSink += total;
+}
+
+void benchGetMachineCode(long long param, long long iterations)
+{
+    long long total = 0;
+    for (long long i = 0; i < iterations; i++)
+    {
+        total += getMachineCode(mnemonicMix[i % MNEMONIC_MIX_SIZE]);
+    }
+    benchSink += total;
+}
+
+//////////////////// Encoders ////////////////////
+
+// A small program's worth of symbols for the encoders to resolve against
+void setupEncoderSymbols(long long param)
+{
+    resetSymbols(0);
+    addSymbol("FIRST", 0x0000);
+    addSymbol("LENGTH", 0x0033);
+    addSymbol("BUFFER", 0x0036);
+    addSymbol("RDREC", 0x1036);
+    addSymbol("RLOOP", 0x1040);
+}
+
+void benchFormat2(long long param, long long iterations)
+{
+    char objectCode[33];
+    for (long long i = 0; i < iterations; i++)
+    {
+        if (i & 1)
+        {
+            encodeFormat2(objectCode, sizeof(objectCode), "COMPR", "A,S");
+        }
+        else
+        {
+            encodeFormat2(objectCode, sizeof(objectCode), "CLEAR", "X");
+        }
+        benchSink += objectCode[2];
+    }
+}
+
+// Format 3 with the sample program's operand mix: PC-relative, base-relative, indexed, indirect and immediate
+void benchFormat3(long long param, long long iterations)
+{
+    char* operands[] = { "LENGTH", "RLOOP", "BUFFER,X", "@LENGTH", "#3", "#LENGTH" };
+    char objectCode[33];
+    for (long long i = 0; i < iterations; i++)
+    {
+        encodeFormat3(objectCode, sizeof(objectCode), "LDA", operands[i % 6], 0x1043, true, 0x0033, "0");
+        benchSink += objectCode[5];
+    }
+}
+
+void benchFormat4(long long param, long long iterations)
+{
+    char objectCode[33];
+    for (long long i = 0; i < iterations; i++)
+    {
+        encodeFormat3(objectCode, sizeof(objectCode), (i & 1) ? "+JSUB" : "+LDT", (i & 1) ? "RDREC" : "#4096", 0x000A, false, 0, "0");
+        benchSink += objectCode[7];
+    }
+}
+
+// The binary string helpers on their own, as used to build and patch format 3/4 object code
+void benchBinaryHelpers(long long param, long long iterations)
+{
+    for (long long i = 0; i < iterations; i++)
+    {
+        char* binary = intToBinary((int)(i & 0xFF));
+        char* hex = binaryToHex(binary);
+        char* back = hexToBinary(hex);
+        benchSink += back[0];
+    }
+}
+
+// BYTE constants of length bytes; the buffers come from lineArena, which timeBatch resets
+void benchByteCharacter(long long length, long long iterations)
+{
+    char* operand = arenaAlloc(&lineArena, length + 4);
+    strcpy(operand, "C'");
+    for (long long i = 0; i < length; i++)
+    {
+        operand[2 + i] = (char)('A' + i % 26);
+    }
+    strcpy(operand + 2 + length, "'");
+    char* objectCode = arenaAlloc(&lineArena, 2 * length + 1);
+    for (long long i = 0; i < iterations; i++)
+    {
+        encodeByteConstant(objectCode, 2 * length + 1, operand);
+        benchSink += objectCode[0];
+    }
+}
+
+void benchByteHex(long long length, long long iterations)
+{
+    char* operand = arenaAlloc(&lineArena, 2 * length + 4);
+    strcpy(operand, "X'");
+    for (long long i = 0; i < length * 2; i++)
+    {
+        operand[2 + i] = "0123456789abcdef"[i % 16];
+    }
+    strcpy(operand + 2 + 2 * length, "'");
+    char* objectCode = arenaAlloc(&lineArena, 2 * length + 1);
+    for (long long i = 0; i < iterations; i++)
+    {
+        encodeByteConstant(objectCode, 2 * length + 1, operand);
+        benchSink += objectCode[0];
+    }
+}
+
+//////////////////// T records ////////////////////
+
+FILE* nullObjectFile = NULL;
+
+// Appends 3 byte instructions to T records, flushing full records to a scratch file; one operation is one append
+void benchTextRecord(long long param, long long iterations)
+{
+    char buffer[70] = { 0 };
+    for (long long i = 0; i < iterations; i++)
+    {
+        appendToTextRecord(nullObjectFile, buffer, sizeof(buffer), (int)((i * 3) & MAX_ADDRESS), "17202D");
+    }
+    if (buffer[0] != '\0')
+    {
+        writeToObjectFile(nullObjectFile, buffer);
+    }
+    rewind(nullObjectFile);
+}
+
+//////////////////// Pass 1 lexing ////////////////////
+
+#define LEX_SOURCE_LINES 20000
+
+char* lexSource = NULL;       // A generated program in the sample's style, never modified
+char* lexBuffer = NULL;       // The copy each batch lexes, since lexing cuts fields in place
+size_t lexSourceLength = 0;
+
+void generateLexSource(void)
+{
+    const char* lines[] = { "FIRST    STL     RETADR\n", "         LDB     #LENGTH\n", "CLOOP   +JSUB    RDREC\n",
+        ".        SUBROUTINE TO READ RECORD INTO BUFFER\n", "         STCH    BUFFER,X\n", "EOF      BYTE    C'E O F'\n",
+        "         RSUB\n", "BUFFER   RESB    4096\n" };
+    size_t count = sizeof(lines) / sizeof(lines[0]);
+    lexSource = malloc(LEX_SOURCE_LINES * 64);
+    lexBuffer = malloc(LEX_SOURCE_LINES * 64);
+    lexSourceLength = 0;
+    for (long long i = 0; i < LEX_SOURCE_LINES; i++)
+    {
+        size_t length = strlen(lines[i % count]);
+        memcpy(lexSource + lexSourceLength, lines[i % count], length);
+        lexSourceLength += length;
+    }
+    lexSource[lexSourceLength] = '\0';
+}
+
+void restoreLexSource(long long param)
+{
+    memcpy(lexBuffer, lexSource, lexSourceLength + 1);
+}
+
+// Splits a line into label, opcode and operand, the way pass 1 did before lexSourceBlock. The line is modified, and
+// Windows line endings are normalized first
+void tokenizeSourceLine(char* line, SourceStatement* statement)
+{
+    char* context = NULL;
+
+    // Sources saved with Windows line endings assemble the same everywhere
+    size_t lineLength = strlen(line);
+    if (lineLength >= 2 && line[lineLength - 2] == '\r')
+    {
+        line[lineLength - 2] = '\n';
+        line[lineLength - 1] = '\0';
+    }
+
+    statement->comment = NULL;
+    if (line[0] == '.') // A comment is copied through whole
+    {
+        statement->comment = line;
+        statement->label = statement->opcode = statement->operand = NULL;
+    }
+    else if (line[0] != ' ') // A label is present in the first column
+    {
+        statement->label = splitField(line, " \n", &context);
+        statement->opcode = splitField(NULL, " \n", &context);
+        statement->operand = splitField(NULL, " \n", &context);
+    }
+    else // No label, so the first token is the opcode
+    {
+        statement->label = NULL;
+        statement->opcode = splitField(line, " \n", &context);
+        statement->operand = splitField(NULL, " \n", &context);
+    }
+}
+
+// One line at a time, as pass 1 used to read them; one operation is one line
+void benchLexLines(long long param, long long iterations)
+{
+    SourceStatement statement;
+    char* line = lexBuffer;
+    for (long long i = 0; i < iterations; i++)
+    {
+        char* next = strchr(line, '\n') + 1;
+        char saved = *next;
+        *next = '\0';
+        tokenizeSourceLine(line, &statement);
+        *next = saved;
+        benchSink += statement.opcode != NULL ? statement.opcode[0] : 0;
+        line = next;
+    }
+}
+
+// The whole source as one block
+void benchLexBlock(long long param, long long iterations)
+{
+    SourceStatement* statements;
+    size_t consumed;
+    benchSink += lexSourceBlock(&lineArena, lexBuffer, lexSourceLength, true, &statements, &consumed);
+}
+
+//////////////////// Driver ////////////////////
+
+BenchResult results[64];
+int resultCount = 0;
+
+bool isSelected(const char* name)
+{
+    return nameFilter == NULL || strstr(name, nameFilter) != NULL;
+}
+
+void report(BenchResult result)
+{
+    results[resultCount++] = result;
+    printf("%-24s %9lld  %10.2f ns/op  (+/- %6.2f, min %8.2f)  %6.2f allocs/op  %8.2f B/op\n",
+        result.name, result.param, result.median, result.stddev, result.min, result.allocationsPerOp, result.bytesPerOp);
+}
+
+void writeJson(const char* path)
+{
+    FILE* JsonFile = fopen(path, "w");
+    if (JsonFile == NULL)
+    {
+        perror("Error opening JSON output");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(JsonFile, "[\n");
+    for (int i = 0; i < resultCount; i++)
+    {
+        BenchResult* r = &results[i];
+        fprintf(JsonFile, "  {\"name\": \"%s\", \"param\": %lld, \"iterations\": %lld, \"repetitions\": %d, "
+            "\"ns_per_op\": {\"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f}, "
+            "\"allocs_per_op\": %.4f, \"bytes_per_op\": %.4f}%s\n",
+            r->name, r->param, r->iterations, r->repetitions,
+            r->median, r->mean, r->stddev, r->min, r->max, r->allocationsPerOp, r->bytesPerOp,
+            (i < resultCount - 1) ? "," : "");
+    }
+    fprintf(JsonFile, "]\n");
+    fclose(JsonFile);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* jsonPath = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            nameFilter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            warmupReps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc)
+        {
+            measuredReps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            jsonPath = argv[++i];
+        }
+        else
+        {
+            printf("\nUsage: %s [--filter <text>] [--warmup <n>] [--reps <n>] [--json <file>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (measuredReps < 1)
+    {
+        measuredReps = 1;
+    }
+
+    // Symbol insert and lookup from 10^2 to 10^6 symbols
+    for (long long n = 100; n <= 1000000; n *= 10)
+    {
+        if (isSelected("symbol_insert") || isSelected("symbol_lookup"))
+        {
+            generateSymbolNames(n);
+        }
+        if (isSelected("symbol_insert"))
+        {
+            report(runBenchmark("symbol_insert", n, resetSymbols, benchSymbolInsert, n));
+        }
+        if (isSelected("symbol_lookup"))
+        {
+            fillSymbols(n);
+            report(runBenchmark("symbol_lookup", n, NULL, benchSymbolLookup, 0));
+        }
+    }
+
+    // Lexing the same source line by line and as a block
+    if (isSelected("lex_lines") || isSelected("lex_block"))
+    {
+        generateLexSource();
+        if (isSelected("lex_lines"))
+        {
+            report(runBenchmark("lex_lines", 0, restoreLexSource, benchLexLines, LEX_SOURCE_LINES));
+        }
+        if (isSelected("lex_block"))
+        {
+            report(runBenchmark("lex_block", 0, restoreLexSource, benchLexBlock, LEX_SOURCE_LINES));
+        }
+    }
+
+    struct { const char* name; long long param; BenchSetup setup; BenchBody body; } benches[] =
+    {
+        { "isValidOpcode", 0, NULL, benchIsValidOpcode },
+        { "getFormat", 0, NULL, benchGetFormat },
+        { "getMachineCode", 0, NULL, benchGetMachineCode },
+        { "encode_format2", 0, NULL, benchFormat2 },
+        { "encode_format3", 0, setupEncoderSymbols, benchFormat3 },
+        { "encode_format4", 0, setupEncoderSymbols, benchFormat4 },
+        { "binary_helpers", 0, NULL, benchBinaryHelpers },
+        { "byte_character", 3, NULL, benchByteCharacter },
+        { "byte_character", 16, NULL, benchByteCharacter },
+        { "byte_character", 4096, NULL, benchByteCharacter },
+        { "byte_hex", 1, NULL, benchByteHex },
+        { "byte_hex", 16, NULL, benchByteHex },
+        { "byte_hex", 4096, NULL, benchByteHex },
+        { "text_record", 0, NULL, benchTextRecord },
+    };
+    nullObjectFile = tmpfile();
+    for (int i = 0; i < (int)(sizeof(benches) / sizeof(benches[0])); i++)
+    {
+        if (isSelected(benches[i].name))
+        {
+            report(runBenchmark(benches[i].name, benches[i].param, benches[i].setup, benches[i].body, 0));
+        }
+    }
+    fclose(nullObjectFile);
+
+    if (jsonPath != NULL)
+    {
+        writeJson(jsonPath);
+    }
+    return 0;
+}
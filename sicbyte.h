@@ -0,0 +1,161 @@
+// BYTE constants of any length: character constants turned into hex digits, and hex constants checked and uppercased,
+// 16 or 32 bytes at a time. x86 builds use SSE2, and AVX2 where the processor has it (checked once, at run time);
+// everything else, and the tail of every constant, goes through the scalar loops, which give the same result
+#ifndef SICBYTE_H
+#define SICBYTE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BYTE_SSE2 1
+#include <emmintrin.h>
+#else
+#define BYTE_SSE2 0
+#endif
+// The AVX2 loop is compiled for AVX2 on its own, so the rest of the program still runs on any x86-64
+#if BYTE_SSE2 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BYTE_AVX2 1
+#include <immintrin.h>
+#else
+#define BYTE_AVX2 0
+#endif
+
+static const char BYTE_HEX_DIGITS[] = "0123456789ABCDEF";
+
+static inline size_t encodeCharacterHexScalar(const unsigned char* text, size_t length, char* out)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        out[2 * i] = BYTE_HEX_DIGITS[text[i] >> 4];
+        out[2 * i + 1] = BYTE_HEX_DIGITS[text[i] & 0x0F];
+    }
+    return length;
+}
+
+#if BYTE_SSE2
+// Nibbles 0-15 to their digits: '0' + n, and 7 more for A-F
+static inline __m128i nibblesToHex128(__m128i nibbles)
+{
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+// Returns how many bytes of text it encoded, a multiple of 16
+static inline size_t encodeCharacterHexSse2(const unsigned char* text, size_t length, char* out)
+{
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i high = nibblesToHex128(_mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibble));
+        __m128i low = nibblesToHex128(_mm_and_si128(bytes, lowNibble));
+        // Interleaving puts each byte's high digit in front of its low one
+        _mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i*)(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    return i;
+}
+#endif
+
+#if BYTE_AVX2
+__attribute__((target("avx2"))) static size_t encodeCharacterHexAvx2(const unsigned char* text, size_t length, char* out)
+{
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i seven = _mm256_set1_epi8(7);
+    const __m256i zero = _mm256_set1_epi8('0');
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), lowNibble);
+        __m256i low = _mm256_and_si256(bytes, lowNibble);
+        high = _mm256_add_epi8(_mm256_add_epi8(high, zero), _mm256_and_si256(_mm256_cmpgt_epi8(high, nine), seven));
+        low = _mm256_add_epi8(_mm256_add_epi8(low, zero), _mm256_and_si256(_mm256_cmpgt_epi8(low, nine), seven));
+        // The unpacks work within each 128 bit lane, so the lanes are put back in order before storing
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256((__m256i*)(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    return i;
+}
+
+static inline bool byteHasAvx2(void)
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported == 1;
+}
+#endif
+
+// Writes the 2 * length hex digits of length characters to out (no NUL)
+static inline void encodeCharacterHex(const unsigned char* text, size_t length, char* out)
+{
+    size_t done = 0;
+#if BYTE_AVX2
+    if (length >= 32 && byteHasAvx2())
+    {
+        done = encodeCharacterHexAvx2(text, length, out);
+    }
+#endif
+#if BYTE_SSE2
+    done += encodeCharacterHexSse2(text + done, length - done, out + 2 * done);
+#endif
+    encodeCharacterHexScalar(text + done, length - done, out + 2 * done);
+}
+
+static inline bool normalizeHexDigitsScalar(const char* digits, size_t length, char* out)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = digits[i];
+        if (c >= 'a' && c <= 'f')
+        {
+            c = (char)(c - 'a' + 'A');
+        }
+        if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F')))
+        {
+            return false;
+        }
+        out[i] = c;
+    }
+    return true;
+}
+
+#if BYTE_SSE2
+// Bytes in [low, high]. The compares are signed, so bytes past 0x7F never match
+static inline __m128i byteInRange128(__m128i bytes, char low, char high)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8((char)(low - 1))), _mm_cmpgt_epi8(_mm_set1_epi8((char)(high + 1)), bytes));
+}
+#endif
+
+// Copies length hex digits to out with a-f uppercased. Returns false if any of them isn't a hex digit
+static inline bool normalizeHexDigits(const char* digits, size_t length, char* out)
+{
+    size_t i = 0;
+#if BYTE_SSE2
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(digits + i));
+        __m128i lower = byteInRange128(bytes, 'a', 'f');
+        __m128i upper = _mm_sub_epi8(bytes, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+        __m128i valid = _mm_or_si128(byteInRange128(upper, '0', '9'), byteInRange128(upper, 'A', 'F'));
+        if (_mm_movemask_epi8(valid) != 0xFFFF)
+        {
+            return false;
+        }
+        _mm_storeu_si128((__m128i*)(out + i), upper);
+    }
+#endif
+    return normalizeHexDigitsScalar(digits + i, length - i, out + i);
+}
+
+#endif
@@ -0,0 +1,614 @@
+// Result cache: an input whose source, INCLUDE and INCBIN files, assembler build and options are all unchanged since it
+// was last assembled isn't assembled again; its outputs are copied out of the cache instead, without running either pass.
+// The cache is the directory $SICASM_CACHE_DIR, or ~/.cache/sicasm. Each entry is named by its key, 32 hex digits
+// hashing the input file and everything else that decides the outputs:
+//   <key>.manifest  "SICCACHE1", then "dep <hash> <path>" for each file pass 1 read besides the input, then
+//                   "out <role>" for each output the entry holds
+//   <key>.<role>    a copy of that output (object, listing, intermediate, xref, image, linemap, symbols, stats,
+//                   statsjson)
+//   stats           hits, misses, stores and evictions so far, one "name count" line each
+// An entry's files are written under temporary names and renamed into place, manifest last, so a half-written entry is
+// never used. Once the directory grows past $SICASM_CACHE_SIZE (bytes, or with a K, M or G suffix; 256M by default),
+// the least recently used entries (oldest manifest; a hit touches it) are removed until it is back under 90% of that.
+// Standard input, and outputs sent to standard output, can't be cached, so those assemblies always run.
+// Outputs are copied in and out of the cache, unless $SICASM_CACHE_HARDLINK asks for hard links.
+#ifndef SICCACHE_H
+#define SICCACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#include "sicarena.h"
+#include "sicoptions.h"
+
+#ifdef _WIN32
+#define CACHE_AVAILABLE 0
+#else
+#define CACHE_AVAILABLE 1
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#endif
+
+#define CACHE_MAGIC "SICCACHE1"
+#define CACHE_DEFAULT_SIZE (256LL << 20)
+// A new build of the assembler may encode differently, so it never reuses an older build's results
+#define CACHE_BUILD __DATE__ " " __TIME__
+
+// The outputs an entry can hold, and the option giving each one's path
+#define CACHE_ROLES 9
+static const char* CACHE_ROLE_NAMES[CACHE_ROLES] = { "object", "listing", "intermediate", "xref", "image", "linemap", "symbols", "stats", "statsjson" };
+
+static inline const char* getCacheOutputPath(const AssemblerOptions* options, int role)
+{
+    const char* paths[CACHE_ROLES] = { options->objectPath, options->listingPath, options->intermediatePath, options->crossReferencePath,
+        options->imagePath, options->lineMapPath, options->symbolsPath, options->statsPath, options->statsJsonPath };
+    return paths[role];
+}
+
+// The counters in the stats file
+#define CACHE_HITS 0
+#define CACHE_MISSES 1
+#define CACHE_STORES 2
+#define CACHE_EVICTIONS 3
+#define CACHE_COUNTERS 4
+static const char* CACHE_COUNTER_NAMES[CACHE_COUNTERS] = { "hits", "misses", "stores", "evictions" };
+
+// 128 bits from two 64-bit lanes mixed differently, so a key collision needs both to collide at once
+typedef struct CacheHash
+{
+    unsigned long long low;
+    unsigned long long high;
+} CacheHash;
+
+static inline void startCacheHash(CacheHash* hash)
+{
+    hash->low = 14695981039346656037ull; // 64-bit FNV-1a
+    hash->high = 0x9E3779B97F4A7C15ull;
+}
+
+static inline void addCacheBytes(CacheHash* hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash->low = (hash->low ^ bytes[i]) * 1099511628211ull;
+        hash->high = (hash->high ^ bytes[i]) * 0xFF51AFD7ED558CCDull;
+        hash->high ^= hash->high >> 29;
+    }
+}
+
+// Strings are hashed with their NUL, so "AB" then "C" differs from "A" then "BC"
+static inline void addCacheString(CacheHash* hash, const char* text)
+{
+    addCacheBytes(hash, text != NULL ? text : "", strlen(text != NULL ? text : "") + 1);
+}
+
+static inline void formatCacheHash(const CacheHash* hash, char* text)
+{
+    snprintf(text, 33, "%016llx%016llx", hash->high, hash->low);
+}
+
+// Hashes a whole file into text (33 characters). Returns false if it can't be read
+static inline bool hashCacheFile(const char* path, char* text)
+{
+    FILE* HashedFile = fopen(path, "rb");
+    if (HashedFile == NULL)
+    {
+        return false;
+    }
+    CacheHash hash;
+    startCacheHash(&hash);
+    char buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), HashedFile)) > 0)
+    {
+        addCacheBytes(&hash, buffer, length);
+    }
+    fclose(HashedFile);
+    formatCacheHash(&hash, text);
+    return true;
+}
+
+#define CACHE_HOLE_SIZE 4096 // Blocks of zeros this long are skipped over rather than written, keeping a copy sparse
+
+// Puts a copy of from at to. The copy seeks over blocks of zeros, so a sparse --image stays sparse. With hardLink
+// ($SICASM_CACHE_HARDLINK), a hard link replaces to instead where the file system allows it; the outputs and the cache
+// entries then share their contents, and writing an output in place changes its entry too. Returns false if either
+// file can't be opened
+static inline bool copyCacheFile(const char* from, const char* to, bool hardLink)
+{
+#if CACHE_AVAILABLE
+    struct stat fromInfo, toInfo;
+    if (stat(from, &fromInfo) == 0 && stat(to, &toInfo) == 0 && fromInfo.st_dev == toInfo.st_dev && fromInfo.st_ino == toInfo.st_ino)
+    {
+        return true; // Already linked, and copying would truncate from before reading it
+    }
+    // link won't replace a file, so the link is made under a temporary name and renamed over to
+    char linked[PATH_MAX + 32];
+    if (hardLink && snprintf(linked, sizeof(linked), "%s.%ld.link", to, (long)getpid()) < (int)sizeof(linked) && link(from, linked) == 0)
+    {
+        if (rename(linked, to) == 0)
+        {
+            return true;
+        }
+        unlink(linked);
+    }
+#endif
+    FILE* Source = fopen(from, "rb");
+    if (Source == NULL)
+    {
+        return false;
+    }
+    FILE* Destination = fopen(to, "wb");
+    if (Destination == NULL)
+    {
+        fclose(Source);
+        return false;
+    }
+    static const char zeros[CACHE_HOLE_SIZE] = { 0 };
+    char buffer[65536];
+    size_t length;
+    bool ok = true, endsInHole = false;
+    while ((length = fread(buffer, 1, sizeof(buffer), Source)) > 0)
+    {
+        for (size_t offset = 0; offset < length; offset += CACHE_HOLE_SIZE)
+        {
+            size_t part = length - offset < CACHE_HOLE_SIZE ? length - offset : CACHE_HOLE_SIZE;
+            endsInHole = memcmp(buffer + offset, zeros, part) == 0;
+            ok = ok && (endsInHole ? fseek(Destination, (long)part, SEEK_CUR) == 0 : fwrite(buffer + offset, 1, part, Destination) == part);
+        }
+    }
+    fclose(Source);
+    if (endsInHole) // A file can't end in a hole, so its last zero byte is written to give it its full length
+    {
+        ok = ok && fseek(Destination, -1, SEEK_CUR) == 0 && fputc(0, Destination) == 0;
+    }
+    return fclose(Destination) == 0 && ok;
+}
+
+// One assembly's view of the cache
+typedef struct ResultCache
+{
+    bool enabled;               // Set once the key is known; a miss stores the outputs when the assembly finishes
+    bool hardLink;              // $SICASM_CACHE_HARDLINK is set: outputs and entries are hard-linked, not copied
+    char directory[PATH_MAX];
+    char key[33];
+    unsigned int roles;         // Bit per CACHE_ROLES output being written
+    const char** dependencies;  // Files pass 1 read besides the input, in the assembly's arena
+    int dependencyCount;
+    int dependencyCapacity;
+} ResultCache;
+
+static inline void getCacheDirectory(char* directory, size_t size)
+{
+    const char* configured = getenv("SICASM_CACHE_DIR");
+    const char* home = getenv("HOME");
+    if (configured != NULL && configured[0] != '\0')
+    {
+        snprintf(directory, size, "%s", configured);
+    }
+    else
+    {
+        snprintf(directory, size, "%s/.cache/sicasm", home != NULL ? home : ".");
+    }
+}
+
+// Returns false if the path doesn't fit in size
+static inline bool getCachePath(const ResultCache* cache, const char* suffix, char* path, size_t size)
+{
+    return snprintf(path, size, "%s/%s.%s", cache->directory, cache->key, suffix) < (int)size;
+}
+
+// $SICASM_CACHE_SIZE in bytes
+static inline long long getCacheLimit(void)
+{
+    const char* text = getenv("SICASM_CACHE_SIZE");
+    if (text == NULL || text[0] == '\0')
+    {
+        return CACHE_DEFAULT_SIZE;
+    }
+    char* end = NULL;
+    long long limit = strtoll(text, &end, 10);
+    switch (*end)
+    {
+    case 'G': case 'g': limit <<= 30; break;
+    case 'M': case 'm': limit <<= 20; break;
+    case 'K': case 'k': limit <<= 10; break;
+    default: break;
+    }
+    return limit > 0 ? limit : CACHE_DEFAULT_SIZE;
+}
+
+static inline void readCacheStats(const char* directory, long long* counts)
+{
+    char path[PATH_MAX], name[32];
+    long long count = 0;
+    memset(counts, 0, CACHE_COUNTERS * sizeof(long long));
+    FILE* StatsFile = snprintf(path, sizeof(path), "%s/stats", directory) < (int)sizeof(path) ? fopen(path, "r") : NULL;
+    while (StatsFile != NULL && fscanf(StatsFile, "%31s %lld", name, &count) == 2)
+    {
+        for (int i = 0; i < CACHE_COUNTERS; i++)
+        {
+            if (strcmp(name, CACHE_COUNTER_NAMES[i]) == 0)
+            {
+                counts[i] = count;
+            }
+        }
+    }
+    if (StatsFile != NULL)
+    {
+        fclose(StatsFile);
+    }
+}
+
+// Adds amount to one counter. Runs at the same time may lose a count, which only makes the statistics approximate
+static inline void countCacheEvent(const char* directory, int counter, long long amount)
+{
+#if CACHE_AVAILABLE
+    long long counts[CACHE_COUNTERS];
+    readCacheStats(directory, counts);
+    counts[counter] += amount;
+    char path[PATH_MAX], temporary[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/stats", directory) >= (int)sizeof(path)
+        || snprintf(temporary, sizeof(temporary), "%s/stats.%ld.tmp", directory, (long)getpid()) >= (int)sizeof(temporary))
+    {
+        return;
+    }
+    FILE* StatsFile = fopen(temporary, "w");
+    if (StatsFile == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < CACHE_COUNTERS; i++)
+    {
+        fprintf(StatsFile, "%s %lld\n", CACHE_COUNTER_NAMES[i], counts[i]);
+    }
+    fclose(StatsFile);
+    rename(temporary, path);
+#endif
+}
+
+#if CACHE_AVAILABLE
+// Makes the directory and any missing parents
+static inline bool makeCacheDirectory(const char* directory)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", directory);
+    for (char* c = path + 1; ; c++)
+    {
+        if (*c == '/' || *c == '\0')
+        {
+            char saved = *c;
+            *c = '\0';
+            if (mkdir(path, 0777) != 0 && access(path, W_OK) != 0)
+            {
+                return false;
+            }
+            *c = saved;
+            if (saved == '\0')
+            {
+                return true;
+            }
+        }
+    }
+}
+
+typedef struct CacheEntry
+{
+    char key[33];
+    long long time;
+} CacheEntry;
+
+static inline int compareCacheEntries(const void* a, const void* b)
+{
+    const CacheEntry* x = a, * y = b;
+    return (x->time > y->time) - (x->time < y->time);
+}
+
+// Removes the least recently used entries while the directory is over its size limit
+static inline void evictResultCache(const char* directory)
+{
+    long long limit = getCacheLimit();
+    DIR* CacheDirectory = opendir(directory);
+    if (CacheDirectory == NULL)
+    {
+        return;
+    }
+    CacheEntry* entries = NULL;
+    int entryCount = 0, entryCapacity = 0;
+    long long total = 0;
+    struct dirent* item;
+    char path[PATH_MAX];
+    while ((item = readdir(CacheDirectory)) != NULL)
+    {
+        struct stat info;
+        if (snprintf(path, sizeof(path), "%s/%s", directory, item->d_name) >= (int)sizeof(path) || stat(path, &info) != 0
+            || !S_ISREG(info.st_mode))
+        {
+            continue;
+        }
+        total += (long long)info.st_size;
+        const char* dot = strchr(item->d_name, '.');
+        if (dot != NULL && dot - item->d_name == 32 && strcmp(dot, ".manifest") == 0)
+        {
+            if (entryCount == entryCapacity)
+            {
+                entryCapacity = entryCapacity ? entryCapacity * 2 : 64;
+                CacheEntry* grown = realloc(entries, entryCapacity * sizeof(CacheEntry));
+                if (grown == NULL)
+                {
+                    break;
+                }
+                entries = grown;
+            }
+            snprintf(entries[entryCount].key, sizeof(entries[entryCount].key), "%.32s", item->d_name);
+            entries[entryCount].time = (long long)info.st_mtime;
+            entryCount++;
+        }
+    }
+    closedir(CacheDirectory);
+
+    if (total > limit)
+    {
+        qsort(entries, entryCount, sizeof(CacheEntry), compareCacheEntries);
+        int evicted = 0;
+        for (int i = 0; i < entryCount && total > limit / 10 * 9; i++)
+        {
+            // The manifest goes first, so the entry stops being used before its outputs do
+            for (int role = -1; role < CACHE_ROLES; role++)
+            {
+                struct stat info;
+                int pathLength = snprintf(path, sizeof(path), "%s/%s.%s", directory, entries[i].key, role < 0 ? "manifest" : CACHE_ROLE_NAMES[role]);
+                if (pathLength < (int)sizeof(path) && stat(path, &info) == 0 && unlink(path) == 0)
+                {
+                    total -= (long long)info.st_size;
+                }
+            }
+            evicted++;
+        }
+        countCacheEvent(directory, CACHE_EVICTIONS, evicted);
+    }
+    free(entries);
+}
+#endif
+
+// Works out the input's key and, if the cache has outputs for it whose dependencies haven't changed, copies them into
+// place. Returns true on a hit, when there is nothing left to do
+static inline bool beginResultCache(ResultCache* cache, const AssemblerOptions* options, const char* isaName)
+{
+    memset(cache, 0, sizeof(*cache));
+#if CACHE_AVAILABLE
+    const char* hardLink = getenv("SICASM_CACHE_HARDLINK");
+    cache->hardLink = hardLink != NULL && hardLink[0] != '\0' && strcmp(hardLink, "0") != 0;
+    if (options->noCache || strcmp(options->inputPath, "-") == 0)
+    {
+        return false;
+    }
+    for (int role = 0; role < CACHE_ROLES; role++)
+    {
+        const char* path = getCacheOutputPath(options, role);
+        if (path != NULL && strcmp(path, "-") == 0)
+        {
+            return false;
+        }
+        cache->roles |= path != NULL ? 1u << role : 0;
+    }
+    getCacheDirectory(cache->directory, sizeof(cache->directory));
+    if (!makeCacheDirectory(cache->directory))
+    {
+        return false;
+    }
+
+    // The key covers the assembler, the options that change the outputs, where relative paths start from, and the source
+    CacheHash hash;
+    char text[PATH_MAX];
+    startCacheHash(&hash);
+    addCacheString(&hash, CACHE_MAGIC);
+    addCacheString(&hash, isaName);
+    addCacheString(&hash, CACHE_BUILD);
+    addCacheString(&hash, getcwd(text, sizeof(text)));
+    addCacheString(&hash, options->inputPath);
+    for (int i = 0; i < options->includeDirCount; i++)
+    {
+        addCacheString(&hash, options->includeDirs[i]);
+    }
+    for (int i = 0; i < options->defineCount; i++)
+    {
+        addCacheString(&hash, "-D");
+        addCacheString(&hash, options->defines[i]);
+    }
+    snprintf(text, sizeof(text), "%u %u %d", cache->roles, options->peephole, options->crossReference ? 1 : 0);
+    addCacheString(&hash, text);
+    FILE* InputFile = fopen(options->inputPath, "rb");
+    if (InputFile == NULL)
+    {
+        return false; // The assembly itself reports it
+    }
+    char buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), InputFile)) > 0)
+    {
+        addCacheBytes(&hash, buffer, length);
+    }
+    fclose(InputFile);
+    formatCacheHash(&hash, cache->key);
+    cache->enabled = true;
+
+    // A hit needs every file the last assembly read to be as it was, and the outputs this one asks for
+    char path[PATH_MAX];
+    if (!getCachePath(cache, "manifest", path, sizeof(path)))
+    {
+        cache->enabled = false; // The directory's name is too long to hold entries
+        return false;
+    }
+    FILE* ManifestFile = fopen(path, "r");
+    bool hit = ManifestFile != NULL && fgets(text, sizeof(text), ManifestFile) != NULL && strncmp(text, CACHE_MAGIC, strlen(CACHE_MAGIC)) == 0;
+    unsigned int roles = 0;
+    while (hit && fgets(text, sizeof(text), ManifestFile) != NULL)
+    {
+        text[strcspn(text, "\n")] = '\0';
+        char current[33];
+        if (strncmp(text, "dep ", 4) == 0 && strlen(text) > 37)
+        {
+            hit = hashCacheFile(text + 37, current) && strncmp(text + 4, current, 32) == 0;
+        }
+        for (int role = 0; strncmp(text, "out ", 4) == 0 && role < CACHE_ROLES; role++)
+        {
+            roles |= strcmp(text + 4, CACHE_ROLE_NAMES[role]) == 0 ? 1u << role : 0;
+        }
+    }
+    if (ManifestFile != NULL)
+    {
+        fclose(ManifestFile);
+    }
+    hit = hit && roles == cache->roles;
+    for (int role = 0; hit && role < CACHE_ROLES; role++)
+    {
+        if (cache->roles & 1u << role)
+        {
+            char cached[PATH_MAX];
+            hit = getCachePath(cache, CACHE_ROLE_NAMES[role], cached, sizeof(cached)) && copyCacheFile(cached, getCacheOutputPath(options, role), cache->hardLink);
+        }
+    }
+    if (hit)
+    {
+        utime(path, NULL); // Recently used, so it is evicted last
+        cache->enabled = false;
+    }
+    countCacheEvent(cache->directory, hit ? CACHE_HITS : CACHE_MISSES, 1);
+    return hit;
+#else
+    return false;
+#endif
+}
+
+// Records a file pass 1 read (an INCLUDE or INCBIN file), whose changes have to invalidate the entry
+static inline void addCacheDependency(ResultCache* cache, Arena* arena, const char* path)
+{
+    if (!cache->enabled)
+    {
+        return;
+    }
+    for (int i = 0; i < cache->dependencyCount; i++)
+    {
+        if (strcmp(cache->dependencies[i], path) == 0)
+        {
+            return;
+        }
+    }
+    if (cache->dependencyCount == cache->dependencyCapacity)
+    {
+        int capacity = cache->dependencyCapacity ? cache->dependencyCapacity * 2 : 16;
+        const char** grown = arenaAlloc(arena, capacity * sizeof(const char*));
+        if (cache->dependencyCount > 0)
+        {
+            memcpy(grown, cache->dependencies, cache->dependencyCount * sizeof(const char*));
+        }
+        cache->dependencies = grown;
+        cache->dependencyCapacity = capacity;
+    }
+    cache->dependencies[cache->dependencyCount++] = arenaStrdup(arena, path);
+}
+
+// After a miss, copies the finished outputs into the cache under the key beginResultCache worked out
+static inline void storeResultCache(ResultCache* cache, const AssemblerOptions* options)
+{
+#if CACHE_AVAILABLE
+    if (!cache->enabled)
+    {
+        return;
+    }
+    char path[PATH_MAX], temporary[PATH_MAX], hash[33];
+    for (int role = 0; role < CACHE_ROLES; role++)
+    {
+        if (cache->roles & 1u << role)
+        {
+            if (!getCachePath(cache, CACHE_ROLE_NAMES[role], path, sizeof(path))
+                || snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(temporary))
+            {
+                return;
+            }
+            if (!copyCacheFile(getCacheOutputPath(options, role), temporary, cache->hardLink) || rename(temporary, path) != 0)
+            {
+                unlink(temporary);
+                return;
+            }
+        }
+    }
+
+    if (!getCachePath(cache, "manifest", path, sizeof(path))
+        || snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(temporary))
+    {
+        return;
+    }
+    FILE* ManifestFile = fopen(temporary, "w");
+    if (ManifestFile == NULL)
+    {
+        return;
+    }
+    fprintf(ManifestFile, "%s\n", CACHE_MAGIC);
+    bool ok = true;
+    for (int i = 0; i < cache->dependencyCount; i++)
+    {
+        ok = ok && hashCacheFile(cache->dependencies[i], hash);
+        fprintf(ManifestFile, "dep %s %s\n", hash, cache->dependencies[i]);
+    }
+    for (int role = 0; role < CACHE_ROLES; role++)
+    {
+        if (cache->roles & 1u << role)
+        {
+            fprintf(ManifestFile, "out %s\n", CACHE_ROLE_NAMES[role]);
+        }
+    }
+    if (fclose(ManifestFile) != 0 || !ok || rename(temporary, path) != 0)
+    {
+        unlink(temporary);
+        return;
+    }
+    countCacheEvent(cache->directory, CACHE_STORES, 1);
+    evictResultCache(cache->directory);
+#endif
+}
+
+// --cache-stats: the counters, and how much the cache holds against its limit
+static inline void printCacheStats(FILE* MessageFile)
+{
+    char directory[PATH_MAX];
+    long long counts[CACHE_COUNTERS];
+    getCacheDirectory(directory, sizeof(directory));
+    readCacheStats(directory, counts);
+    long long size = 0, entries = 0;
+#if CACHE_AVAILABLE
+    DIR* CacheDirectory = opendir(directory);
+    struct dirent* item;
+    while (CacheDirectory != NULL && (item = readdir(CacheDirectory)) != NULL)
+    {
+        char path[PATH_MAX];
+        struct stat info;
+        if (snprintf(path, sizeof(path), "%s/%s", directory, item->d_name) < (int)sizeof(path) && stat(path, &info) == 0
+            && S_ISREG(info.st_mode))
+        {
+            size += (long long)info.st_size;
+            entries += strstr(item->d_name, ".manifest") != NULL ? 1 : 0;
+        }
+    }
+    if (CacheDirectory != NULL)
+    {
+        closedir(CacheDirectory);
+    }
+#endif
+    long long lookups = counts[CACHE_HITS] + counts[CACHE_MISSES];
+    fprintf(MessageFile, "Result cache: %s%s\n", directory, CACHE_AVAILABLE ? "" : " (not available in this build)");
+    fprintf(MessageFile, "  hits        %lld (%.1f%%)\n", counts[CACHE_HITS], lookups > 0 ? 100.0 * counts[CACHE_HITS] / lookups : 0.0);
+    fprintf(MessageFile, "  misses      %lld\n", counts[CACHE_MISSES]);
+    fprintf(MessageFile, "  stores      %lld\n", counts[CACHE_STORES]);
+    fprintf(MessageFile, "  evictions   %lld\n", counts[CACHE_EVICTIONS]);
+    fprintf(MessageFile, "  entries     %lld\n", entries);
+    fprintf(MessageFile, "  size        %lld KB of %lld KB\n", size / 1024, getCacheLimit() / 1024);
+}
+
+#endif
@@ -0,0 +1,41 @@
+// Portability shims so the assemblers build with GCC/Clang as well as MSVC. Include it before any system header, so
+// the feature-test macros below are seen by all of them
+#ifndef SICCOMPAT_H
+#define SICCOMPAT_H
+
+#ifndef _WIN32
+// open_memstream, fmemopen, realpath, fileno and ftruncate are POSIX, and strict C (-std=c11) only declares them when
+// asked to. Without a declaration realpath's pointer would be truncated to int
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
+#endif
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#ifndef _MSC_VER
+// The bounds-checked _s functions are MSVC extensions, so map them onto their standard equivalents everywhere else
+#define strtok_s(str, delimiters, context) strtok_r(str, delimiters, context)
+#define strcpy_s(dest, size, src) snprintf(dest, size, "%s", src)
+#define strcat_s(dest, size, src) strncat(dest, src, (size) - strlen(dest) - 1)
+#define strncat_s(dest, size, src, count) strncat(dest, src, count)
+#define strncpy_s(dest, size, src, count) (strncpy(dest, src, count), (dest)[count] = '\0')
+#define sprintf_s snprintf
+#define fopen_s(file, path, mode) ((*(file) = fopen(path, mode)) == NULL)
+#endif
+
+#ifdef _WIN32
+// No realpath on Windows; _fullpath makes a path absolute the same way, apart from resolving symbolic links
+#define realpath(path, resolved) _fullpath(resolved, path, PATH_MAX)
+#endif
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#endif
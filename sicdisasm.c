@@ -0,0 +1,471 @@
+// Disassembles a SIC/XE object file (H/T/E records) back into source-like text
+// Build: gcc -O2 sicdisasm.c -o sicdisasm
+// Usage: ./sicdisasm <object_file> [-s <symbol_file>] [-o <output_file>] [-l <load_address>]
+#include "siccompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "sicxeoptab.h"
+#include "sicobject.h"
+#include "sicsymbols.h"
+
+// The reverse of OPTAB: the instruction each possible first byte starts. A format 3/4 opcode fills the 4 entries its
+// n and i bits can select; format 1 and 2 opcodes use the whole byte
+const SIC_OPTAB* REVERSE_OPTAB[256];
+
+void buildReverseOptab(void)
+{
+    memset(REVERSE_OPTAB, 0, sizeof(REVERSE_OPTAB));
+    for (int i = 0; i < OPTAB_SIZE; i++)
+    {
+        int code = OPTAB[i].MachineCode;
+        for (int ni = 0; ni < (OPTAB[i].Format == '3' ? 4 : 1); ni++)
+        {
+            REVERSE_OPTAB[code | ni] = &OPTAB[i];
+        }
+    }
+}
+
+// The assembler's name for a format 2 register field, "?" for 7, which isn't a register
+const char* registerName(int number)
+{
+    const char* name = RegisterNames[number % 10];
+    return name != NULL ? name : "?";
+}
+
+//////////////////// Symbols ////////////////////
+
+typedef struct AddressSymbol
+{
+    char name[7];
+    int address;
+} AddressSymbol;
+
+AddressSymbol* symbols = NULL;
+int symbolsCount = 0;
+
+int compareAddressSymbols(const void* a, const void* b)
+{
+    const AddressSymbol* x = a, * y = b;
+    return (x->address > y->address) - (x->address < y->address);
+}
+
+// Takes the symbols that stand for addresses from a symbol index (--symbols), already in address order
+void readSymbolIndex(const char* path)
+{
+    SymbolIndex index;
+    if (!openSymbolIndex(path, &index))
+    {
+        exit(EXIT_FAILURE);
+    }
+    symbols = malloc((index.addressCount > 0 ? index.addressCount : 1) * sizeof(AddressSymbol));
+    for (int i = 0; i < index.addressCount; i++)
+    {
+        IndexedSymbol symbol;
+        getIndexedSymbol(&index, i, &symbol);
+        if (strlen(symbol.name) <= 6)
+        {
+            strcpy_s(symbols[symbolsCount].name, sizeof(symbols[symbolsCount].name), symbol.name);
+            symbols[symbolsCount].address = symbol.address;
+            symbolsCount++;
+        }
+    }
+    closeSymbolIndex(&index);
+}
+
+// Reads NAME<whitespace>HEXADDRESS pairs, such as the symbol table at the end of a listing file. All other lines are
+// skipped, including the listing's absolute symbols (marked ABS), whose values are numbers rather than addresses. A
+// symbol index written by --symbols is read as one
+void readSymbolFile(const char* path)
+{
+    FILE* SymbolFile = fopen(path, "rb");
+    if (SymbolFile == NULL)
+    {
+        perror("Error opening symbol file");
+        exit(EXIT_FAILURE);
+    }
+    char magic[sizeof(SYMBOLS_MAGIC)] = { 0 };
+    if (fread(magic, 1, sizeof(magic), SymbolFile) == sizeof(magic) && memcmp(magic, SYMBOLS_MAGIC, sizeof(magic)) == 0)
+    {
+        fclose(SymbolFile);
+        readSymbolIndex(path);
+        return;
+    }
+    rewind(SymbolFile);
+    char line[256];
+    int capacity = 0;
+    while (fgets(line, sizeof(line), SymbolFile))
+    {
+        char* context = NULL;
+        char* name = strtok_s(line, " \t\r\n", &context);
+        char* address = strtok_s(NULL, " \t\r\n", &context);
+        char* mark = strtok_s(NULL, " \t\r\n", &context);
+        if (name == NULL || address == NULL || strcmp(name, "SYMBOL") == 0)
+        {
+            continue;
+        }
+        if (mark != NULL) // An ABS symbol, or a line that is not a pair at all
+        {
+            continue;
+        }
+        char* end = NULL;
+        long value = strtol(address, &end, 16);
+        if (*end != '\0' || strlen(name) > 6)
+        {
+            continue;
+        }
+        if (symbolsCount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            symbols = realloc(symbols, capacity * sizeof(AddressSymbol));
+        }
+        strcpy_s(symbols[symbolsCount].name, sizeof(symbols[symbolsCount].name), name);
+        symbols[symbolsCount].address = (int)value;
+        symbolsCount++;
+    }
+    fclose(SymbolFile);
+    qsort(symbols, symbolsCount, sizeof(AddressSymbol), compareAddressSymbols);
+}
+
+// Returns the name of the symbol at exactly this address, or NULL
+const char* findSymbolName(int address)
+{
+    int low = 0, high = symbolsCount - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        if (symbols[middle].address == address)
+        {
+            return symbols[middle].name;
+        }
+        else if (symbols[middle].address < address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+//////////////////// Output ////////////////////
+
+// Lines are formatted straight into a large buffer and written out in big chunks, which keeps printf off the hot path
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+char outputBuffer[OUTPUT_BUFFER_SIZE];
+size_t outputLength = 0;
+FILE* OutputFile = NULL;
+
+void flushOutput(void)
+{
+    fwrite(outputBuffer, 1, outputLength, OutputFile);
+    outputLength = 0;
+}
+
+void outChar(char c)
+{
+    outputBuffer[outputLength++] = c;
+}
+
+void outString(const char* text)
+{
+    while (*text)
+    {
+        outputBuffer[outputLength++] = *text++;
+    }
+}
+
+void outHex(unsigned int value, int digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        outputBuffer[outputLength++] = "0123456789ABCDEF"[(value >> (4 * i)) & 0xF];
+    }
+}
+
+void outDecimal(int value)
+{
+    char digits[12];
+    snprintf(digits, sizeof(digits), "%d", value);
+    outString(digits);
+}
+
+// Writes a target address as its label if one is known, otherwise as hex
+void outTarget(int address)
+{
+    const char* name = findSymbolName(address);
+    if (name != NULL)
+    {
+        outString(name);
+    }
+    else
+    {
+        outHex(address, address > 0xFFFF ? 5 : 4);
+    }
+}
+
+//////////////////// Decoding ////////////////////
+
+// Starts a line with the address, object code bytes and label column
+void beginLine(int address, const unsigned char* bytes, int count)
+{
+    outHex(address, address > 0xFFFF ? 5 : 4);
+    outChar('\t');
+    for (int i = 0; i < count; i++)
+    {
+        outHex(bytes[i], 2);
+    }
+    outChar('\t');
+    const char* label = findSymbolName(address);
+    if (label != NULL)
+    {
+        outString(label);
+    }
+    outChar('\t');
+}
+
+void disassembleImage(ObjectImage* image)
+{
+    int baseRegister = -1; // Tracked from LDB #label, since the BASE directive isn't in the object file
+    int offset = 0;
+
+    outString("H\t");
+    outString(image->name);
+    outChar('\t');
+    outHex(image->startAddress, 6);
+    outChar('\t');
+    outHex(image->length, 6);
+    outChar('\n');
+
+    while (offset < image->length)
+    {
+        if (outputLength > OUTPUT_BUFFER_SIZE - 256)
+        {
+            flushOutput();
+        }
+        if (!image->loaded[offset]) // Skip reserved (RESB/RESW) areas
+        {
+            int gapStart = offset;
+            while (offset < image->length && !image->loaded[offset])
+            {
+                offset++;
+            }
+            outHex(image->startAddress + gapStart, (image->startAddress + gapStart) > 0xFFFF ? 5 : 4);
+            outString("\t\t");
+            const char* label = findSymbolName(image->startAddress + gapStart);
+            if (label != NULL)
+            {
+                outString(label);
+            }
+            outString("\tRESB\t");
+            outDecimal(offset - gapStart);
+            outChar('\n');
+            continue;
+        }
+
+        int address = image->startAddress + offset;
+        const unsigned char* bytes = image->memory + offset;
+        int available = 0;
+        while (available < 4 && offset + available < image->length && image->loaded[offset + available])
+        {
+            available++;
+        }
+        const SIC_OPTAB* op = REVERSE_OPTAB[bytes[0]];
+        int size = 0;
+        if (op != NULL)
+        {
+            if (op->Format == '1')
+            {
+                size = 1;
+            }
+            else if (op->Format == '2')
+            {
+                size = 2;
+            }
+            else
+            {
+                size = ((bytes[0] & 0x03) != 0 && available >= 2 && (bytes[1] & 0x10)) ? 4 : 3;
+            }
+        }
+        if (size == 0 || size > available) // Not an instruction, so show it as a data byte
+        {
+            beginLine(address, bytes, 1);
+            outString("BYTE\tX'");
+            outHex(bytes[0], 2);
+            outString("'\n");
+            offset++;
+            continue;
+        }
+
+        beginLine(address, bytes, size);
+        if (size == 4)
+        {
+            outChar('+');
+        }
+        outString(op->Mnemonic);
+
+        if (op->Format == '2')
+        {
+            outChar('\t');
+            if (op->OperandType == OPERANDS_NUMBER)
+            {
+                outDecimal(bytes[1] >> 4);
+            }
+            else
+            {
+                outString(registerName(bytes[1] >> 4));
+            }
+            if (op->OperandType == OPERANDS_REGISTERS)
+            {
+                outChar(',');
+                outString(registerName(bytes[1] & 0x0F));
+            }
+            else if (op->OperandType == OPERANDS_REGISTER_COUNT)
+            {
+                outChar(',');
+                outDecimal((bytes[1] & 0x0F) + 1);
+            }
+        }
+        else if (op->Format == '3' && op->NumberOperands > 0)
+        {
+            int ni = bytes[0] & 0x03;
+            bool indexed = (bytes[1] & 0x80) != 0;
+            int target;
+            bool relativeToUnknownBase = false;
+            int displacement = 0;
+
+            if (ni == 0) // Standard SIC instruction: x bit and a 15 bit address
+            {
+                target = ((bytes[1] & 0x7F) << 8) | bytes[2];
+            }
+            else if (size == 4)
+            {
+                target = ((bytes[1] & 0x0F) << 16) | (bytes[2] << 8) | bytes[3];
+            }
+            else
+            {
+                displacement = ((bytes[1] & 0x0F) << 8) | bytes[2];
+                if (bytes[1] & 0x20) // p: PC-relative, 12 bit signed displacement
+                {
+                    if (displacement & 0x800)
+                    {
+                        displacement -= 0x1000;
+                    }
+                    target = address + 3 + displacement;
+                }
+                else if (bytes[1] & 0x40) // b: base-relative, 12 bit unsigned displacement
+                {
+                    relativeToUnknownBase = baseRegister < 0;
+                    target = baseRegister + displacement;
+                }
+                else
+                {
+                    target = displacement;
+                }
+            }
+
+            outChar('\t');
+            if (ni == 1)
+            {
+                outChar('#');
+            }
+            else if (ni == 2)
+            {
+                outChar('@');
+            }
+            if (relativeToUnknownBase)
+            {
+                outDecimal(displacement);
+                outString("(B)");
+            }
+            else if (ni == 1 && (bytes[1] & 0x60) == 0) // Immediate constant
+            {
+                outDecimal(target);
+            }
+            else
+            {
+                outTarget(target);
+            }
+            if (indexed)
+            {
+                outString(",X");
+            }
+            if (ni == 1 && strcmp(op->Mnemonic, "LDB") == 0 && !relativeToUnknownBase)
+            {
+                baseRegister = target;
+            }
+        }
+        outChar('\n');
+        offset += size;
+    }
+
+    outString("E\t");
+    outTarget(image->entryAddress);
+    outChar('\n');
+}
+
+int main(int argc, char* argv[])
+{
+    const char* objectPath = NULL, * symbolPath = NULL, * outputPath = NULL;
+    int loadAddress = -1; // Where to relocate the program to first, -1 to leave it where it was assembled
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            symbolPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            loadAddress = (int)strtol(argv[++i], NULL, 16);
+        }
+        else if (objectPath == NULL)
+        {
+            objectPath = argv[i];
+        }
+        else
+        {
+            objectPath = NULL;
+            break;
+        }
+    }
+    if (objectPath == NULL)
+    {
+        printf("\nUsage: %s <object_file> [-s <symbol_file>] [-o <output_file>] [-l <load_address>]\n", argv[0]);
+        return 1;
+    }
+
+    ObjectImage image;
+    if (loadAddress >= 0 ? !loadObjectFileAt(objectPath, loadAddress, &image) : !readObjectFile(objectPath, &image))
+    {
+        return EXIT_FAILURE;
+    }
+    if (symbolPath != NULL)
+    {
+        readSymbolFile(symbolPath);
+    }
+    OutputFile = (outputPath != NULL) ? fopen(outputPath, "w") : stdout;
+    if (OutputFile == NULL)
+    {
+        perror("Error opening output file");
+        return EXIT_FAILURE;
+    }
+
+    buildReverseOptab();
+    disassembleImage(&image);
+    flushOutput();
+
+    if (OutputFile != stdout)
+    {
+        fclose(OutputFile);
+    }
+    freeObjectImage(&image);
+    free(symbols);
+    return 0;
+}
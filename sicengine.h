@@ -0,0 +1,1823 @@
+// The two-pass assembler both sicasm.c and sicxeasm.c are built from. Everything that doesn't depend on the instruction
+// set lives here: directives, the symbol table, the intermediate file, T/M/E records, the listing and every optional output.
+// Each assembler is this engine specialized for one ISA at compile time, so there are no function pointers or ISA checks
+// at run time. Before including this file the ISA defines:
+//   ISA_NAME            prefix of the default output files ("sic", "sicxe")
+//   MAX_ADDRESS         highest address a program may use
+//   ISA_RELOCATABLE     1 if absolute address fields get M records, 0 for an absolute-only object format
+//   ISA_ENCODING_STATS  1 if encodeInstruction counts encodings for --stats and --stats-json
+//   ISA_PEEPHOLE        1 if the ISA provides optimizeIntermediate, the peephole pass -O runs between the passes
+//   isValidOpcode(OPCODE), its opcode table lookup
+// and after it, the two functions declared below
+#ifndef SICENGINE_H
+#define SICENGINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "siccompat.h"
+#include "sicarena.h"
+#include "sicsymtab.h"
+#include "sicexpr.h"
+#include "sicoptions.h"
+#include "sicinclude.h"
+#include "sicxref.h"
+#include "sicimage.h"
+#include "sicstats.h"
+#include "sicpipeline.h"
+#include "siclinemap.h"
+#include "sicsymbols.h"
+#include "sicbyte.h"
+#include "sicrecords.h"
+#include "siccache.h"
+
+// START is not included here as it is only supposed to appear once. If it appears again, it is an error
+const char* DIRECTIVES[] = { "BYTE", "WORD", "RESB", "RESW", "END", "BASE", "NOBASE", "INCBIN", "EQU", "ORG", "USE", "IF", "IFDEF",
+    "IFNDEF", "ELSE", "ENDIF" };
+#define DIRECTIVES_SIZE (sizeof(DIRECTIVES) / sizeof(DIRECTIVES[0]))
+
+// Pass 2's input: the intermediate file, read here or (with --pipeline) by a reader thread, or with --external
+// the statement records
+typedef struct IntermediateSource
+{
+    FILE* IntermediateFile;
+    StatementRecords* records; // NULL unless --external
+#if PIPELINE_AVAILABLE
+    BlockReader* lines; // NULL when reading IntermediateFile directly
+#endif
+} IntermediateSource;
+
+// What pass 2 knows about an instruction beyond its opcode and operand
+typedef struct InstructionContext
+{
+    int address;            // Address of the instruction
+    bool baseSet;           // BASE is in effect
+    int baseAddress;
+    const char* LINE;       // Line number as written in the intermediate file, for error messages
+    EncodingStats* stats;   // Where to count the encoding, NULL if no report was asked for
+} InstructionContext;
+
+// Provided by the ISA. The length in bytes of an instruction (pass 1), and its object code as hex digits (pass 2)
+static inline int instructionLength(const char* OPCODE);
+static inline void encodeInstruction(char* objectCode, size_t size, const char* OPCODE, char* OPERAND, InstructionContext* context);
+#if ISA_PEEPHOLE
+// Rewrites the intermediate file pass 1 wrote (open for reading) using the rules options->peephole selects, updating the
+// symbol table and LOCCTR for the new layout. Returns the rewritten file, open for writing like pass 1 left it
+static inline FILE* optimizeIntermediate(const AssemblerOptions* options, FILE* IntermediateFile, int* LOCCTR, FILE* MessageFile);
+#endif
+
+static inline int isValidDirective(const char* OPCODE)
+{
+    for (int i = 0; i < DIRECTIVES_SIZE; i++)
+    {
+        if (strcmp(OPCODE, DIRECTIVES[i]) == 0)
+        {
+            return 1; // Directive is valid
+        }
+    }
+    return 0;
+}
+
+// Storage for everything that lives as long as one assembly (symbol names and the symbol table itself)
+static Arena assemblyArena = { 0 };
+// Scratch storage for the statement being processed, reset at the start of every line
+static Arena lineArena = { 0 };
+static int lineNumber = 0;
+// The use getSymbolAddress recorded last, so the encoder can add how the reference was encoded (-1 if none)
+static int lastSymbolUse = -1;
+
+// An address field that has to change if the program is loaded somewhere else, written out as an M record
+typedef struct Modification
+{
+    int address;   // Address of the byte holding the field's first half-byte
+    int halfBytes; // 5 for a format 4 address (it starts in the low half of the byte), 6 for a WORD
+} Modification;
+
+// Modifications in the order pass 2 found them. Stored in assemblyArena, so they go when the assembly does
+static Modification* modifications = NULL;
+static int modificationCount = 0;
+static int modificationCapacity = 0;
+
+// Where pass 1 writes its statements with --external instead of the intermediate file (NULL otherwise)
+static StatementRecords* statementRecords = NULL;
+
+static inline void addModification(int address, int halfBytes)
+{
+    if (statementRecords != NULL) // --external keeps them on disk with the statement records
+    {
+        writeModificationRecord(statementRecords, address, halfBytes);
+        return;
+    }
+    if (modificationCount == modificationCapacity)
+    {
+        int capacity = modificationCapacity ? modificationCapacity * 2 : 64;
+        Modification* grown = arenaAlloc(&assemblyArena, capacity * sizeof(Modification));
+        if (modificationCount > 0)
+        {
+            memcpy(grown, modifications, modificationCount * sizeof(Modification));
+        }
+        modifications = grown;
+        modificationCapacity = capacity;
+    }
+    modifications[modificationCount].address = address;
+    modifications[modificationCount].halfBytes = halfBytes;
+    modificationCount++;
+}
+
+// Gives the modification after *index (start it at 0) and moves past it. Returns false after the last one
+static inline bool nextModification(int* index, Modification* modification)
+{
+    if (statementRecords != NULL)
+    {
+        return readModificationRecord(statementRecords, &modification->address, &modification->halfBytes);
+    }
+    if (*index >= modificationCount)
+    {
+        return false;
+    }
+    *modification = modifications[(*index)++];
+    return true;
+}
+
+// INCBIN files in statement order, resolved by pass 1 (which knows the including file) and read by pass 2
+static BinaryInclusion* binaryInclusions = NULL;
+static int binaryInclusionCount = 0;
+static int binaryInclusionCapacity = 0;
+
+static inline BinaryInclusion* addBinaryInclusion(void)
+{
+    if (binaryInclusionCount == binaryInclusionCapacity)
+    {
+        int capacity = binaryInclusionCapacity ? binaryInclusionCapacity * 2 : 16;
+        BinaryInclusion* grown = arenaAlloc(&assemblyArena, capacity * sizeof(BinaryInclusion));
+        if (binaryInclusionCount > 0)
+        {
+            memcpy(grown, binaryInclusions, binaryInclusionCount * sizeof(BinaryInclusion));
+        }
+        binaryInclusions = grown;
+        binaryInclusionCapacity = capacity;
+    }
+    return &binaryInclusions[binaryInclusionCount++];
+}
+
+// Program blocks (USE). Each keeps its own LOCCTR through pass 1, counting from 0 (the default block from START), and
+// at the end of pass 1 the blocks are laid out one after another in the order they first appeared
+typedef struct ProgramBlock
+{
+    const char* name;  // "" for the default block
+    int LOCCTR;        // Where the block continues when USE comes back to it
+    int highest;       // Furthest its LOCCTR has reached (ORG can move back)
+    int start;         // Its address in the program, once pass 1 is over
+} ProgramBlock;
+
+static ProgramBlock* programBlocks = NULL;
+static int programBlockCount = 0;
+static int programBlockCapacity = 0;
+static int currentBlock = 0;
+
+static inline void resetProgramBlocks(void)
+{
+    programBlocks = arenaAlloc(&assemblyArena, 4 * sizeof(ProgramBlock));
+    programBlockCapacity = 4;
+    programBlockCount = 1;
+    currentBlock = 0;
+    memset(&programBlocks[0], 0, sizeof(ProgramBlock));
+    programBlocks[0].name = "";
+}
+
+// Pass 1's USE: saves where the current block got to and carries on in the named one (the default one with no name)
+static inline void switchProgramBlock(const char* name, int* LOCCTR, int* highestLOCCTR)
+{
+    programBlocks[currentBlock].LOCCTR = *LOCCTR;
+    programBlocks[currentBlock].highest = *highestLOCCTR;
+    name = name != NULL ? name : "";
+    int block = 0;
+    while (block < programBlockCount && strcmp(programBlocks[block].name, name) != 0)
+    {
+        block++;
+    }
+    if (block == programBlockCount)
+    {
+        if (programBlockCount == programBlockCapacity)
+        {
+            ProgramBlock* grown = arenaAlloc(&assemblyArena, 2 * programBlockCapacity * sizeof(ProgramBlock));
+            memcpy(grown, programBlocks, programBlockCount * sizeof(ProgramBlock));
+            programBlocks = grown;
+            programBlockCapacity *= 2;
+        }
+        memset(&programBlocks[block], 0, sizeof(ProgramBlock));
+        programBlocks[block].name = arenaStrdup(&assemblyArena, name);
+        programBlockCount++;
+    }
+    currentBlock = block;
+    *LOCCTR = programBlocks[block].LOCCTR;
+    *highestLOCCTR = programBlocks[block].highest;
+}
+
+// Lays the blocks out after one another once pass 1 is over, returning where the program ends. Every label moves by
+// its block's start, and the EQUs are evaluated again from the moved labels
+static inline int layOutProgramBlocks(int LOCCTR, int highestLOCCTR)
+{
+    programBlocks[currentBlock].LOCCTR = LOCCTR;
+    programBlocks[currentBlock].highest = highestLOCCTR;
+    int end = 0;
+    for (int i = 0; i < programBlockCount; i++)
+    {
+        ProgramBlock* block = &programBlocks[i];
+        block->highest = block->highest > block->LOCCTR ? block->highest : block->LOCCTR;
+        block->start = end;
+        end += block->highest;
+    }
+    if (end > MAX_ADDRESS + 1)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: Program blocks together exceed the address space (end %X, last address %X)\n", lineNumber, end, MAX_ADDRESS);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < symbolCount; i++)
+    {
+        symbolTable[i].address += programBlocks[symbolTable[i].block].start;
+    }
+    for (int i = 0; i < equateCount; i++)
+    {
+        equates[i].location += programBlocks[symbolTable[equates[i].symbol].block].start;
+    }
+    return end;
+}
+
+static inline void addSymbol(const char* LABEL, int address)
+{
+    int index = insertSymbol(LABEL, address);
+    if (index < 0)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: Duplicate symbol '%s'\n", lineNumber, LABEL);
+        exit(EXIT_FAILURE);
+    }
+    symbolTable[index].definedLine = lineNumber;
+    symbolTable[index].block = currentBlock;
+}
+
+// Address of the statement being assembled, which * stands for in its operand
+static int statementAddress = 0;
+
+// Compiled operand expressions by statement number, so pass 2 evaluates what pass 1 compiled. Plain symbols and
+// numbers, most operands, are looked up directly and never compiled
+static Expression** statementExpressions = NULL;
+static int statementExpressionCapacity = 0;
+
+// The part of an operand that holds its value: without the addressing prefix (# or @) or index suffix (,X).
+// Sets *mode to the USE_ bits they stand for
+static inline const char* operandBody(const char* OPERAND, size_t* length, int* mode)
+{
+    *length = strlen(OPERAND);
+    *mode = 0;
+    if (*length >= 2 && OPERAND[*length - 2] == ',' && OPERAND[*length - 1] == 'X')
+    {
+        *length -= 2;
+        *mode = USE_INDEXED;
+    }
+    else if (OPERAND[0] == '@' || OPERAND[0] == '#')
+    {
+        *mode = OPERAND[0] == '@' ? USE_INDIRECT : USE_IMMEDIATE;
+        (*length)--;
+        return OPERAND + 1;
+    }
+    return OPERAND;
+}
+
+// Whether an operand body is an expression rather than a single symbol or number
+static inline bool isExpression(const char* body, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (body[i] == '+' || body[i] == '-' || body[i] == '*' || body[i] == '/' || body[i] == '(')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compiles an operand into arena, stopping the assembly if it isn't a valid expression
+static inline Expression* compileOperandIn(Arena* arena, const char* body, size_t length, int pass)
+{
+    Expression* expression = arenaAlloc(arena, sizeof(Expression));
+    const char* error = compileExpression(arena, arenaStrndup(arena, body, length), length, expression);
+    if (error != NULL)
+    {
+        fprintf(stderr, "Error: Pass %d, Line %d: %s in operand %.*s\n", pass, lineNumber, error, (int)length, body);
+        exit(EXIT_FAILURE);
+    }
+    return expression;
+}
+
+// The statement's compiled operand, compiled now if pass 1 didn't (or the peephole pass has changed the operand since).
+// With --external nothing is kept per statement, so each pass compiles it again into the line's scratch space
+static inline const Expression* compileOperand(const char* body, size_t length, int pass)
+{
+    if (statementRecords != NULL)
+    {
+        return compileOperandIn(&lineArena, body, length, pass);
+    }
+    int statement = lineNumber / 5;
+    if (statement < statementExpressionCapacity && statementExpressions[statement] != NULL
+        && statementExpressions[statement]->length == length && memcmp(statementExpressions[statement]->text, body, length) == 0)
+    {
+        return statementExpressions[statement];
+    }
+    if (statement >= statementExpressionCapacity)
+    {
+        int capacity = statementExpressionCapacity ? statementExpressionCapacity : 256;
+        while (capacity <= statement)
+        {
+            capacity *= 2;
+        }
+        Expression** grown = arenaAlloc(&assemblyArena, capacity * sizeof(Expression*));
+        memset(grown, 0, capacity * sizeof(Expression*));
+        if (statementExpressionCapacity > 0)
+        {
+            memcpy(grown, statementExpressions, statementExpressionCapacity * sizeof(Expression*));
+        }
+        statementExpressions = grown;
+        statementExpressionCapacity = capacity;
+    }
+    Expression* expression = compileOperandIn(&assemblyArena, body, length, pass);
+    statementExpressions[statement] = expression;
+    return expression;
+}
+
+// Evaluates an operand in pass 2 and records its symbols' uses for the cross-reference.
+// Returns false if it names a symbol that isn't defined
+static inline bool evaluateOperand(const char* OPERAND, ExpressionValue* result)
+{
+    size_t length = 0;
+    int mode = 0;
+    const char* body = operandBody(OPERAND, &length, &mode);
+    lastSymbolUse = -1;
+    result->value = 0;
+    result->relative = 0;
+    if (!isExpression(body, length))
+    {
+        int index = findSymbol(body, length);
+        if (index >= 0)
+        {
+            lastSymbolUse = addSymbolUse(index, lineNumber, mode);
+            result->value = symbolTable[index].address;
+            result->relative = symbolTable[index].absolute ? 0 : 1;
+            return true;
+        }
+        if (length == 0 || !isdigit((unsigned char)body[0]))
+        {
+            return false;
+        }
+        char* end = NULL;
+        long number = strtol(body, &end, 10);
+        if ((size_t)(end - body) == length && number <= 0x7FFFFFFF) // A plain number
+        {
+            result->value = (int)number;
+            return true;
+        }
+    }
+    const char* error = evaluateExpression(compileOperand(body, length, 2), statementAddress, mode, lineNumber, result);
+    if (error == EXPRESSION_UNDEFINED)
+    {
+        return false;
+    }
+    if (error != NULL)
+    {
+        fprintf(stderr, "Error: Pass 2, Line %d: %s in operand %s\n", lineNumber, error, OPERAND);
+        exit(EXIT_FAILURE);
+    }
+    lastSymbolUse = result->lastUse;
+    return true;
+}
+
+// Evaluates an operand pass 1 needs the value of (ORG, RESB, RESW), so every symbol in it has to be defined already
+static inline ExpressionValue evaluateOperandNow(const char* OPCODE, const char* OPERAND)
+{
+    ExpressionValue value = { 0 };
+    if (OPERAND == NULL)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: %s needs an operand\n", lineNumber, OPCODE);
+        exit(EXIT_FAILURE);
+    }
+    char* end = NULL;
+    long number = strtol(OPERAND, &end, 10);
+    if (isdigit((unsigned char)OPERAND[0]) && *end == '\0' && number <= 0x7FFFFFFF) // Usually just a number
+    {
+        value.value = (int)number;
+        return value;
+    }
+    const Expression* expression = compileOperand(OPERAND, strlen(OPERAND), 1);
+    const char* error = evaluateExpression(expression, statementAddress, -1, lineNumber, &value);
+    if (error == EXPRESSION_UNDEFINED)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: %s %s needs the value of %.*s, which has to be known at this point\n",
+            lineNumber, OPCODE, OPERAND, value.missingLength, value.missing);
+        exit(EXIT_FAILURE);
+    }
+    if (error != NULL)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: %s in operand %s\n", lineNumber, error, OPERAND);
+        exit(EXIT_FAILURE);
+    }
+
+    // Addresses are counted from the start of their block until pass 1 ends, so only those in one block can be combined,
+    // and an address has to be in the current one
+    int block = -1;
+    for (int i = 0; programBlockCount > 1 && i < expression->count; i++)
+    {
+        const ExpressionTerm* term = &expression->terms[i];
+        int termBlock = term->kind == TERM_LOCATION ? currentBlock
+            : term->kind == TERM_SYMBOL && !symbolTable[term->value].absolute ? symbolTable[term->value].block : -1;
+        if (termBlock >= 0 && ((block >= 0 && termBlock != block) || (value.relative != 0 && termBlock != currentBlock)))
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: %s %s uses an address in another program block, which isn't placed until pass 1 ends\n",
+                lineNumber, OPCODE, OPERAND);
+            exit(EXIT_FAILURE);
+        }
+        block = termBlock >= 0 ? termBlock : block;
+    }
+    return value;
+}
+
+// The conditionals (IF, IFDEF, IFNDEF) pass 1 is inside, innermost last
+#define MAX_CONDITIONAL_DEPTH 64
+typedef struct Conditional
+{
+    bool taken;  // The IF's own branch is assembled, so its ELSE branch isn't
+    bool inElse;
+    int line;
+} Conditional;
+
+static Conditional conditionals[MAX_CONDITIONAL_DEPTH];
+static int conditionalDepth = 0;
+
+// Pass 1's IF, IFDEF, IFNDEF, ELSE and ENDIF. IF assembles its branch when the operand, which has to be known at this
+// point (EQU constants and -D defines), isn't zero; IFDEF when the operand is a symbol defined by now, IFNDEF when it
+// isn't. The branch left out is skipped by the reader without being lexed, its lines only counted for the line numbers
+static inline void assembleConditional(SourceReader* reader, const char* OPCODE, const char* OPERAND)
+{
+    int skipped = 0;
+    if (conditionalKind(OPCODE, strlen(OPCODE)) == CONDITIONAL_IF)
+    {
+        bool condition;
+        if (OPCODE[2] == '\0')
+        {
+            condition = evaluateOperandNow(OPCODE, OPERAND).value != 0;
+        }
+        else if (OPERAND == NULL)
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: %s needs a symbol\n", lineNumber, OPCODE);
+            exit(EXIT_FAILURE);
+        }
+        else
+        {
+            condition = (findSymbol(OPERAND, strlen(OPERAND)) >= 0) == (OPCODE[2] == 'D');
+        }
+        if (conditionalDepth == MAX_CONDITIONAL_DEPTH)
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: Conditionals nested more than %d deep\n", lineNumber, MAX_CONDITIONAL_DEPTH);
+            exit(EXIT_FAILURE);
+        }
+        Conditional* conditional = &conditionals[conditionalDepth++];
+        conditional->taken = condition;
+        conditional->inElse = false;
+        conditional->line = lineNumber;
+        if (condition)
+        {
+            return;
+        }
+        skipped = skipConditionalBranch(reader);
+    }
+    else
+    {
+        if (conditionalDepth == 0)
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: %s without IF\n", lineNumber, OPCODE);
+            exit(EXIT_FAILURE);
+        }
+        Conditional* conditional = &conditionals[conditionalDepth - 1];
+        if (strcmp(OPCODE, "ENDIF") == 0)
+        {
+            conditionalDepth--;
+            return;
+        }
+        if (conditional->inElse)
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: Second ELSE for the IF on line %d\n", lineNumber, conditional->line);
+            exit(EXIT_FAILURE);
+        }
+        conditional->inElse = true;
+        if (!conditional->taken)
+        {
+            return;
+        }
+        skipped = skipConditionalBranch(reader);
+    }
+    if (skipped < 0)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: IF has no ENDIF in its file\n", conditionals[conditionalDepth - 1].line);
+        exit(EXIT_FAILURE);
+    }
+    lineNumber += 5 * skipped;
+}
+
+// Pass 1 has used the values of EQU, ORG, RESB and RESW operands; pass 2 only records their symbols for the cross-reference
+static inline void recordOperandUses(const char* OPERAND)
+{
+    ExpressionValue value;
+    if (recordSymbolUses && OPERAND != NULL)
+    {
+        evaluateOperand(OPERAND, &value);
+    }
+}
+
+// Returns the address an operand refers to, or -1 if it names a symbol that isn't defined, and records the use for the cross-reference
+static inline int getSymbolAddress(const char* nameInput)
+{
+    ExpressionValue value;
+    if (!evaluateOperand(nameInput, &value))
+    {
+        return -1;
+    }
+    if (value.value < 0)
+    {
+        fprintf(stderr, "Error: Pass 2, Line %d: Negative address in operand %s\n", lineNumber, nameInput);
+        exit(EXIT_FAILURE);
+    }
+    return value.value;
+}
+
+// Adds USE_ bits to the use getSymbolAddress just recorded, once the encoder knows how it was encoded
+static inline void markSymbolUse(int mode)
+{
+    if (lastSymbolUse >= 0)
+    {
+        symbolUses[lastSymbolUse].mode |= mode;
+    }
+}
+
+// A statement in a program block other than the default one has its block number after the address (0006:1)
+static inline void writeToIntermediateFile(FILE* IntermediateFile, int LOCCTR, char* LABEL, char* OPCODE, char* OPERAND)
+{
+    if (statementRecords != NULL)
+    {
+        writeStatementRecord(statementRecords, lineNumber, LOCCTR, currentBlock, LABEL, OPCODE, OPERAND);
+        return;
+    }
+    if (currentBlock > 0)
+    {
+        fprintf(IntermediateFile, "%d\t%04X:%d\t%s\t%s\t%s", lineNumber, LOCCTR, currentBlock,
+            (LABEL != NULL) ? LABEL : "", (OPCODE != NULL) ? OPCODE : "", (OPERAND != NULL) ? OPERAND : "");
+        return;
+    }
+    fprintf(IntermediateFile, "%d\t%04X\t%s\t%s\t%s",
+        lineNumber,
+        LOCCTR,
+        (LABEL != NULL) ? LABEL : "",
+        (OPCODE != NULL) ? OPCODE : "",
+        (OPERAND != NULL) ? OPERAND : "");
+}
+
+// Ends the line writeToIntermediateFile started. A statement record is already complete
+static inline void endIntermediateLine(FILE* IntermediateFile)
+{
+    if (statementRecords == NULL)
+    {
+        fputc('\n', IntermediateFile);
+    }
+}
+
+// A comment line goes through as it is, after its line number (line -1 for the column headings, which have none)
+static inline void writeIntermediateComment(FILE* IntermediateFile, int line, const char* text)
+{
+    if (statementRecords != NULL)
+    {
+        writeCommentRecord(statementRecords, line, text);
+    }
+    else if (line < 0)
+    {
+        fputs(text, IntermediateFile);
+    }
+    else
+    {
+        fprintf(IntermediateFile, "%d\t%s", line, text);
+    }
+}
+
+// Pass 2's listing line for a statement in a program block: the address column becomes the statement's address in the
+// program, then its block and its address in the block (1036 CDATA+0006). The column runs from 'from' up to 'to'
+static inline char* listBlockAddress(const char* lineCopy, size_t from, size_t to, int address, int block, int blockAddress)
+{
+    size_t size = strlen(lineCopy) + strlen(programBlocks[block].name) + 32;
+    char* listed = arenaAlloc(&lineArena, size);
+    snprintf(listed, size, "%.*s%04X %s+%04X%s", (int)from, lineCopy, address, programBlocks[block].name, blockAddress, lineCopy + to);
+    return listed;
+}
+
+// Writes the pending T record, filling in its length, and empties the buffer
+static inline void writeToObjectFile(FILE* ObjectFile, char* buffer)
+{
+    int result = (strlen(buffer) - 9 + 1) / 2;  // +1 for rounding up
+    char resultChars[3];
+    sprintf_s(resultChars, sizeof(resultChars), "%02X", result);
+    buffer[7] = resultChars[0];
+    buffer[8] = resultChars[1];
+    if (ObjectFile != NULL) // NULL when the object file isn't being produced
+    {
+        fprintf(ObjectFile, "%s\n", buffer);
+    }
+    buffer[0] = '\0';
+}
+
+// Writes one line of the listing: the intermediate line, followed by its object code if it has any
+static inline void writeToListingFile(FILE* ListingFile, const char* lineCopy, const char* objectCode)
+{
+    if (ListingFile == NULL) // The listing isn't being produced
+    {
+        return;
+    }
+    if (objectCode != NULL)
+    {
+        fprintf(ListingFile, "%s\t%s\n", lineCopy, objectCode);
+    }
+    else
+    {
+        fprintf(ListingFile, "%s\n", lineCopy);
+    }
+}
+
+static inline void startLineObjectFile(char* buffer, size_t bufferSize, int address)
+{
+    snprintf(buffer, bufferSize, "T%06X@@", address); // @@ holds the place of the record length
+}
+
+// Adds one statement's object code to the pending T record, writing the record out first if the code would not fit.
+// Code too long for any one record (large BYTE constants) fills the pending record and carries on in new ones
+static inline void appendToTextRecord(FILE* ObjectFile, char* buffer, size_t bufferSize, int address, const char* objectCode)
+{
+    if (buffer[0] == '\0') // If buffer is empty, start a new line
+    {
+        startLineObjectFile(buffer, bufferSize, address);
+    }
+    size_t codeLength = strlen(objectCode);
+    if (codeLength > 60)
+    {
+        while (codeLength > 0)
+        {
+            size_t room = (69 - strlen(buffer)) & ~(size_t)1; // Whole bytes only
+            size_t take = codeLength < room ? codeLength : room;
+            strncat(buffer, objectCode, take);
+            objectCode += take;
+            codeLength -= take;
+            address += (int)(take / 2);
+            if (codeLength > 0)
+            {
+                writeToObjectFile(ObjectFile, buffer);
+                startLineObjectFile(buffer, bufferSize, address);
+            }
+        }
+        return;
+    }
+    if (strlen(buffer) + codeLength > 69) // If the buffer would be over 69 characters, write the buffer into the file and start a new one
+    {
+        writeToObjectFile(ObjectFile, buffer);
+        startLineObjectFile(buffer, bufferSize, address);
+        strcat_s(buffer, bufferSize, objectCode); // Once new line has started, add current object code
+    }
+    else // Add the object code to the buffer
+    {
+        strcat_s(buffer, bufferSize, objectCode);
+    }
+}
+
+// Returns the number of characters or hex digits between the quotes of a BYTE operand (C'EOF', X'F1'),
+// or -1 if it isn't one. Nothing may follow the closing quote
+static inline long byteConstantDigits(const char* OPERAND)
+{
+    if ((OPERAND[0] != 'C' && OPERAND[0] != 'X') || OPERAND[1] != '\'')
+    {
+        return -1;
+    }
+    const char* endQuote = strchr(OPERAND + 2, '\'');
+    if (endQuote == NULL || endQuote[1] != '\0')
+    {
+        return -1;
+    }
+    return (long)(endQuote - (OPERAND + 2));
+}
+
+// The number of bytes a BYTE operand assembles to, or -1 if it isn't a valid constant. An odd number of hex digits
+// is padded with a leading 0
+static inline long byteConstantLength(const char* OPERAND)
+{
+    long digits = byteConstantDigits(OPERAND);
+    if (digits < 0)
+    {
+        return -1;
+    }
+    return OPERAND[0] == 'C' ? digits : (digits + 1) / 2;
+}
+
+// Encodes the operand of a BYTE directive, either a character constant (C'EOF') or a hex constant (X'F1').
+// objectCode needs room for 2 * byteConstantLength(OPERAND) digits and a NUL
+static inline void encodeByteConstant(char* objectCode, size_t size, char* OPERAND)
+{
+    long digits = byteConstantDigits(OPERAND);
+    long length = byteConstantLength(OPERAND);
+    if (length < 0 || (size_t)(2 * length + 1) > size)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: Invalid BYTE format for operand %s\n", lineNumber, OPERAND);
+        exit(EXIT_FAILURE);
+    }
+    if (OPERAND[0] == 'C')
+    {
+        encodeCharacterHex((const unsigned char*)OPERAND + 2, (size_t)digits, objectCode);
+    }
+    else
+    {
+        size_t padding = (size_t)(digits & 1); // X'F' is the byte 0F
+        objectCode[0] = '0';
+        if (!normalizeHexDigits(OPERAND + 2, (size_t)digits, objectCode + padding))
+        {
+            fprintf(stderr, "Error: Pass 2, Line %d: Invalid hex digit in BYTE constant %s\n", lineNumber, OPERAND);
+            exit(EXIT_FAILURE);
+        }
+    }
+    objectCode[2 * length] = '\0';
+}
+
+// Splits a repeat count off a BYTE or WORD operand (X'00',64 is 64 zero bytes), leaving the constant in OPERAND.
+// Returns 1 if there is no count, and -1 if the count isn't a positive decimal number
+static inline long splitRepeatCount(char* OPERAND)
+{
+    char* comma = NULL;
+    bool quoted = false;
+    for (char* c = OPERAND; *c != '\0'; c++)
+    {
+        if (*c == '\'')
+        {
+            quoted = !quoted;
+        }
+        else if (*c == ',' && !quoted)
+        {
+            comma = c;
+        }
+    }
+    if (comma == NULL)
+    {
+        return 1;
+    }
+    char* end = NULL;
+    long count = strtol(comma + 1, &end, 10);
+    if (!isdigit((unsigned char)comma[1]) || *end != '\0' || count <= 0)
+    {
+        return -1;
+    }
+    *comma = '\0';
+    return count;
+}
+
+// Returns the next line of the intermediate file, valid until the next call, or NULL at the end
+static inline char* readIntermediateLine(IntermediateSource* source)
+{
+#if PIPELINE_AVAILABLE
+    if (source->lines != NULL)
+    {
+        return nextEntry(source->lines);
+    }
+#endif
+    if (source->records != NULL)
+    {
+        return readStatementRecord(source->records, &lineArena);
+    }
+    return arenaReadLine(&lineArena, source->IntermediateFile);
+}
+
+// Where pass 2's results go: the listing, T records and memory image, or (with --pipeline) a queue to the writer thread.
+// The writer thread replays the queue into its own Pass2Output that writes directly
+typedef struct Pass2Output
+{
+    FILE* ListingFile;
+    FILE* ObjectFile;
+    ImageWriter* imageWriter;
+    char buffer[70]; // The pending T record
+#if PIPELINE_AVAILABLE
+    BlockWriter* queue; // NULL when writing directly
+#endif
+} Pass2Output;
+
+// Queued entries start with one of these, followed by their text
+#define OUTPUT_LISTING 'L' // A listing line, then a newline and the object code column (empty if none)
+#define OUTPUT_CODE 'C'    // 8 hex digit address, the object code, a newline, the listing line
+#define OUTPUT_BREAK 'B'   // End the pending T record
+#define OUTPUT_OBJECT 'O'  // A whole object file line (H, M or E record)
+#define OUTPUT_DATA 'D'    // 8 hex digit address, then object code that isn't listed
+
+#if PIPELINE_AVAILABLE
+static inline void queueOutput(Pass2Output* output, char type, const char* first, const char* second)
+{
+    size_t firstLength = strlen(first);
+    size_t secondLength = second != NULL ? strlen(second) : 0;
+    char* entry = reserveEntry(output->queue, 1 + firstLength + (second != NULL ? 1 + secondLength : 0));
+    entry[0] = type;
+    memcpy(entry + 1, first, firstLength);
+    if (second != NULL)
+    {
+        entry[1 + firstLength] = '\n';
+        memcpy(entry + 2 + firstLength, second, secondLength);
+    }
+}
+#endif
+
+// A line of the listing with no object code for the object file (objectCode may be NULL)
+static inline void emitListing(Pass2Output* output, const char* lineCopy, const char* objectCode)
+{
+#if PIPELINE_AVAILABLE
+    if (output->queue != NULL)
+    {
+        queueOutput(output, OUTPUT_LISTING, lineCopy, objectCode != NULL ? objectCode : "");
+        return;
+    }
+#endif
+    writeToListingFile(output->ListingFile, lineCopy, objectCode);
+}
+
+// A statement's object code: its listing line, its bytes in the memory image and its place in a T record
+static inline void emitCode(Pass2Output* output, int address, const char* lineCopy, const char* objectCode)
+{
+#if PIPELINE_AVAILABLE
+    if (output->queue != NULL)
+    {
+        char prefix[9];
+        snprintf(prefix, sizeof(prefix), "%08X", (unsigned int)address);
+        char* entry = reserveEntry(output->queue, 1 + 8 + strlen(objectCode) + 1 + strlen(lineCopy));
+        entry[0] = OUTPUT_CODE;
+        memcpy(entry + 1, prefix, 8);
+        strcpy(entry + 9, objectCode);
+        strcat(entry + 9, "\n");
+        strcat(entry + 9, lineCopy);
+        return;
+    }
+#endif
+    writeToListingFile(output->ListingFile, lineCopy, objectCode);
+    writeImageCode(output->imageWriter, address, objectCode);
+    appendToTextRecord(output->ObjectFile, output->buffer, sizeof(output->buffer), address, objectCode);
+}
+
+// Object code without a listing line of its own: a piece of a repeated constant or an INCBIN file
+static inline void emitData(Pass2Output* output, int address, const char* objectCode)
+{
+#if PIPELINE_AVAILABLE
+    if (output->queue != NULL)
+    {
+        char prefix[9];
+        snprintf(prefix, sizeof(prefix), "%08X", (unsigned int)address);
+        char* entry = reserveEntry(output->queue, 1 + 8 + strlen(objectCode));
+        entry[0] = OUTPUT_DATA;
+        memcpy(entry + 1, prefix, 8);
+        strcpy(entry + 9, objectCode);
+        return;
+    }
+#endif
+    writeImageCode(output->imageWriter, address, objectCode);
+    appendToTextRecord(output->ObjectFile, output->buffer, sizeof(output->buffer), address, objectCode);
+}
+
+// Statements whose code isn't written in the source (repeated constants, INCBIN) list only the start of it
+#define LISTED_DATA_DIGITS 32
+
+static inline void emitDataListing(Pass2Output* output, const char* lineCopy, const char* objectCode, bool more)
+{
+    char listed[LISTED_DATA_DIGITS + 4];
+    bool cut = more || strlen(objectCode) > LISTED_DATA_DIGITS;
+    snprintf(listed, sizeof(listed), "%.*s%s", LISTED_DATA_DIGITS, objectCode, cut ? "..." : "");
+    emitListing(output, lineCopy, listed[0] != '\0' ? listed : NULL); // An empty INCBIN lists like a directive
+}
+
+// A constant repeated count times. The copies are laid out once, in a chunk of a few kilobytes, which then goes out
+// as many times as needed
+static inline void emitRepeatedCode(Pass2Output* output, int address, const char* lineCopy, const char* unitCode, long count)
+{
+    size_t unitLength = strlen(unitCode);
+    long unitsPerChunk = unitLength < 8192 ? (long)(8192 / unitLength) : 1;
+    if (unitsPerChunk > count)
+    {
+        unitsPerChunk = count;
+    }
+    char* chunk = arenaAlloc(&lineArena, unitsPerChunk * unitLength + 1);
+    for (long i = 0; i < unitsPerChunk; i++)
+    {
+        memcpy(chunk + i * unitLength, unitCode, unitLength);
+    }
+    chunk[unitsPerChunk * unitLength] = '\0';
+    emitDataListing(output, lineCopy, chunk, count > unitsPerChunk);
+
+    for (long done = 0; done < count; done += unitsPerChunk)
+    {
+        if (count - done < unitsPerChunk) // The last chunk may be short
+        {
+            chunk[(count - done) * unitLength] = '\0';
+        }
+        emitData(output, address, chunk);
+        address += (int)(strlen(chunk) / 2);
+    }
+}
+
+// The bytes of an INCBIN file. The file is mapped, so only the pages in the range are read, and turned into
+// hex a few kilobytes at a time. Returns the number of bytes
+static inline long emitBinaryInclusion(Pass2Output* output, int address, const char* lineCopy, const BinaryInclusion* inclusion)
+{
+    MappedFile file = { NULL, 0 };
+    if (inclusion->length > 0 && !mapFile(inclusion->path, &file))
+    {
+        exit(EXIT_FAILURE);
+    }
+    if (inclusion->length > 0 && (long)file.size < inclusion->offset + inclusion->length) // Changed since pass 1 looked at it
+    {
+        fprintf(stderr, "Error: Pass 2, Line %d: INCBIN file '%s' is shorter than it was in pass 1\n", lineNumber, inclusion->path);
+        exit(EXIT_FAILURE);
+    }
+    const unsigned char* bytes = file.data + inclusion->offset;
+    size_t chunkBytes = 4096;
+    char* chunk = arenaAlloc(&lineArena, 2 * chunkBytes + 1);
+
+    size_t listedBytes = inclusion->length < LISTED_DATA_DIGITS / 2 ? (size_t)inclusion->length : LISTED_DATA_DIGITS / 2;
+    encodeCharacterHex(bytes, listedBytes, chunk);
+    chunk[2 * listedBytes] = '\0';
+    emitDataListing(output, lineCopy, chunk, (size_t)inclusion->length > listedBytes);
+
+    for (size_t done = 0; done < (size_t)inclusion->length; done += chunkBytes)
+    {
+        size_t count = (size_t)inclusion->length - done < chunkBytes ? (size_t)inclusion->length - done : chunkBytes;
+        encodeCharacterHex(bytes + done, count, chunk);
+        chunk[2 * count] = '\0';
+        emitData(output, address + (int)done, chunk);
+    }
+    unmapFile(&file);
+    return inclusion->length;
+}
+
+// Writes out the pending T record, if there is one (reserved space and the end of the program break the records)
+static inline void emitRecordBreak(Pass2Output* output)
+{
+#if PIPELINE_AVAILABLE
+    if (output->queue != NULL)
+    {
+        queueOutput(output, OUTPUT_BREAK, "", NULL);
+        return;
+    }
+#endif
+    if (strlen(output->buffer) > 0)
+    {
+        writeToObjectFile(output->ObjectFile, output->buffer);
+    }
+}
+
+// An H, M or E record, written after any pending T record
+static inline void emitObjectLine(Pass2Output* output, const char* record)
+{
+#if PIPELINE_AVAILABLE
+    if (output->queue != NULL)
+    {
+        queueOutput(output, OUTPUT_OBJECT, record, NULL);
+        return;
+    }
+#endif
+    if (output->ObjectFile != NULL)
+    {
+        fputs(record, output->ObjectFile);
+    }
+}
+
+#if PIPELINE_AVAILABLE
+// The writer stage: formats the queued listing lines and records into large buffered writes on its own thread
+typedef struct OutputStage
+{
+    RingBuffer ring;
+    BlockWriter writer; // Pass 2's side
+    BlockReader reader; // The writer thread's side
+    Pass2Output* output;
+    pthread_t thread;
+} OutputStage;
+
+static inline void* writeOutputThread(void* argument)
+{
+    OutputStage* stage = argument;
+    Pass2Output* output = stage->output;
+    char* entry;
+    while ((entry = nextEntry(&stage->reader)) != NULL)
+    {
+        char* text = entry + 1;
+        char* newline = strchr(text, '\n');
+        if (entry[0] == OUTPUT_LISTING)
+        {
+            *newline = '\0';
+            writeToListingFile(output->ListingFile, text, newline[1] != '\0' ? newline + 1 : NULL);
+        }
+        else if (entry[0] == OUTPUT_CODE)
+        {
+            char addressDigits[9];
+            memcpy(addressDigits, text, 8);
+            addressDigits[8] = '\0';
+            *newline = '\0';
+            emitCode(output, (int)strtoul(addressDigits, NULL, 16), newline + 1, text + 8);
+        }
+        else if (entry[0] == OUTPUT_DATA)
+        {
+            char addressDigits[9];
+            memcpy(addressDigits, text, 8);
+            addressDigits[8] = '\0';
+            emitData(output, (int)strtoul(addressDigits, NULL, 16), text + 8);
+        }
+        else if (entry[0] == OUTPUT_BREAK)
+        {
+            emitRecordBreak(output);
+        }
+        else
+        {
+            emitObjectLine(output, text);
+        }
+    }
+    return NULL;
+}
+
+// Starts the writer thread on output, and points queueTo at the queue feeding it
+static inline void startOutputStage(OutputStage* stage, Pass2Output* output, Pass2Output* queueTo)
+{
+    initRingBuffer(&stage->ring);
+    stage->writer.ring = &stage->ring;
+    stage->writer.block = NULL;
+    stage->reader.ring = &stage->ring;
+    stage->reader.block = NULL;
+    stage->reader.position = 0;
+    stage->output = output;
+    output->queue = NULL;
+    *queueTo = *output;
+    queueTo->queue = &stage->writer;
+
+    // Output is handed to the C library a megabyte at a time
+    if (output->ListingFile != NULL && output->ListingFile != stdout)
+    {
+        setvbuf(output->ListingFile, NULL, _IOFBF, 1 << 20);
+    }
+    if (output->ObjectFile != NULL && output->ObjectFile != stdout)
+    {
+        setvbuf(output->ObjectFile, NULL, _IOFBF, 1 << 20);
+    }
+    if (pthread_create(&stage->thread, NULL, writeOutputThread, stage) != 0)
+    {
+        fprintf(stderr, "Error: Could not start the writer thread\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Sends the rest of the queue and waits until the writer has written all of it
+static inline void finishOutputStage(OutputStage* stage)
+{
+    finishBlocks(&stage->writer);
+    pthread_join(stage->thread, NULL);
+}
+#endif
+
+#ifndef SICENGINE_NO_DRIVER
+// Assembles options->inputPath into the outputs options names. Everything but the include cache is reset first
+static inline int assemble(const AssemblerOptions* options, FILE* MessageFile)
+{
+    // Nothing to do if the cache has this input's outputs from an identical assembly
+    ResultCache cache;
+    if (beginResultCache(&cache, options, ISA_NAME))
+    {
+        fprintf(MessageFile, "Outputs of %s copied from the result cache\n", options->inputPath);
+        return 0;
+    }
+
+    FILE* InputFile = openInput(options->inputPath);
+    if (InputFile == NULL)
+    {
+        perror("Error opening file");
+        return EXIT_FAILURE;
+    }
+
+    char* line = NULL, * lineCopy = NULL;
+    char* LABEL = NULL, * OPCODE = NULL, * OPERAND = NULL, * context = NULL;
+    int LOCCTR = 0;
+    bool firstLine = true;
+    lineNumber = 0;
+    arenaReset(&assemblyArena);
+
+    // With --external pass 1 spills statement records to temporary files rather than keep an intermediate file
+    StatementRecords records;
+    FILE* IntermediateFile = NULL;
+    statementRecords = NULL;
+    if (options->external)
+    {
+        openStatementRecords(&records, &assemblyArena);
+        statementRecords = &records;
+    }
+    else
+    {
+        IntermediateFile = openIntermediate(options);
+    }
+    writeIntermediateComment(IntermediateFile, -1, "LINE\tLOCCTR\t   SOURCE_STATEMENT\n");
+
+    resetSymbolTable(&assemblyArena);
+    recordSymbolUses = options->crossReference || options->crossReferencePath != NULL;
+    modifications = NULL;
+    modificationCount = 0;
+    modificationCapacity = 0;
+    binaryInclusions = NULL;
+    binaryInclusionCount = 0;
+    binaryInclusionCapacity = 0;
+    statementExpressions = NULL;
+    statementExpressionCapacity = 0;
+    resetEquates();
+    resetProgramBlocks();
+    conditionalDepth = 0;
+    for (int i = 0; i < options->defineCount; i++) // -D NAME[=value]: a number, as if EQU defined it before the first line
+    {
+        size_t nameLength = strcspn(options->defines[i], "=");
+        const char* value = options->defines[i][nameLength] == '=' ? options->defines[i] + nameLength + 1 : "1";
+        int index = insertSymbol(arenaStrndup(&assemblyArena, options->defines[i], nameLength), (int)strtol(value, NULL, 10));
+        if (index < 0)
+        {
+            fprintf(stderr, "Error: %.*s is defined more than once with -D\n", (int)nameLength, options->defines[i]);
+            exit(EXIT_FAILURE);
+        }
+        symbolTable[index].absolute = true; // So the listing marks it ABS, and sicdisasm -s doesn't take it for an address
+    }
+
+    // Pass 1. The source is read and lexed a block of lines at a time (siclexer.h), so memory use doesn't grow with the
+    // file. Statements of INCLUDE files come already tokenized from the include cache
+    SourceReader reader;
+    SourceStatement statement;
+    openSourceReader(&reader, InputFile, options->inputPath, &lineArena, options->includeDirs, options->includeDirCount);
+    bool pipelined = PIPELINE_AVAILABLE && options->pipeline;
+#if PIPELINE_AVAILABLE
+    LineQueue inputLines;
+    if (pipelined) // The source is read ahead on another thread while this one tokenizes and assigns addresses
+    {
+        startChunkQueue(&inputLines, InputFile);
+        reader.lines = &inputLines.reader;
+    }
+#endif
+    // The line map needs to know where each statement came from, which only pass 1 can see
+    LineMapBuilder lineMap;
+    resetLineMap(&lineMap, &assemblyArena);
+    int highestLOCCTR = 0; // ORG can move back, but the program still runs to the furthest address any statement reached
+    int savedLOCCTR = -1;  // Where ORG with no operand goes back to
+    while (readStatement(&reader, &statement))
+    {
+        // Increase line number by 5 each line
+        lineNumber += 5;
+        if (options->lineMapPath != NULL)
+        {
+            int sourceLine = 0;
+            const char* sourceFile = getSourceLocation(&reader, &sourceLine);
+            recordLineSource(&lineMap, lineNumber / 5, sourceFile, sourceLine);
+        }
+
+        // If the line is a comment
+        if (statement.comment != NULL)
+        {
+            writeIntermediateComment(IntermediateFile, lineNumber, statement.comment); // Copy the line directly to the intermediate file
+            continue;
+        }
+        LABEL = statement.label;
+        OPCODE = statement.opcode;
+        OPERAND = statement.operand;
+
+        // The included file's statements are read next, as if they were pasted in after this line
+        if (strcmp(OPCODE, "INCLUDE") == 0)
+        {
+            if (LABEL != NULL)
+            {
+                addSymbol(LABEL, LOCCTR);
+            }
+            writeToIntermediateFile(IntermediateFile, LOCCTR, LABEL, OPCODE, OPERAND);
+            endIntermediateLine(IntermediateFile);
+            includeSourceFile(&reader, OPERAND, lineNumber);
+            addCacheDependency(&cache, &assemblyArena, reader.stack[reader.depth - 1].file->path);
+            continue;
+        }
+
+        // If first line of file
+        if (firstLine)
+        {
+            if (strcmp(OPCODE, "START") == 0)
+            {
+                LOCCTR = (int)strtol(OPERAND, NULL, 16); // Set LOCCTR to wherever START indicates (read in as hexadecimal)
+                if (LOCCTR < 0 || LOCCTR > MAX_ADDRESS)
+                {
+                    fprintf(stderr, "Error: Pass 1, Line %d: Starting address out of range %s\n", lineNumber, OPERAND);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            writeToIntermediateFile(IntermediateFile, LOCCTR, LABEL, OPCODE, OPERAND); // Write line to file
+            endIntermediateLine(IntermediateFile);
+            if (LABEL != NULL) // If theres a label, add it to symbol table
+            {
+                addSymbol(LABEL, LOCCTR);
+            }
+            firstLine = false; // No longer first line
+            continue;
+        }
+
+        statementAddress = LOCCTR;
+        if (LABEL != NULL && strcmp(OPCODE, "EQU") != 0) // If there is a label, add it to the symbol tabel with its LOCCTR
+        {
+            addSymbol(LABEL, LOCCTR);
+        }
+        if (strcmp(OPCODE, "START") != 0) // If the opcode isn't START (since START should only appear once)
+        {
+            if (isValidDirective(OPCODE)) // If the opcode is an allowed directive...
+            {
+                if (strcmp(OPCODE, "USE") == 0) // Carry on in another program block; the line shows where in it
+                {
+                    switchProgramBlock(OPERAND, &LOCCTR, &highestLOCCTR);
+                }
+                writeToIntermediateFile(IntermediateFile, LOCCTR, LABEL, OPCODE, OPERAND); // Write the line to the file
+                if (strcmp(OPCODE, "END") == 0) // If it's END, end of file
+                {
+                    break;
+                }
+                else if (conditionalKind(OPCODE, strlen(OPCODE)) != CONDITIONAL_NONE) // Skips a branch that isn't assembled
+                {
+                    assembleConditional(&reader, OPCODE, OPERAND);
+                }
+                else if (strcmp(OPCODE, "RESW") == 0 || strcmp(OPCODE, "RESB") == 0) // Increment LOCCTR by 3 bytes per reserved word, 1 per byte
+                {
+                    ExpressionValue count = evaluateOperandNow(OPCODE, OPERAND);
+                    if (count.relative != 0 || count.value < 0 || count.value > MAX_ADDRESS + 1)
+                    {
+                        fprintf(stderr, "Error: Pass 1, Line %d: Invalid %s count %s\n", lineNumber, OPCODE, OPERAND);
+                        exit(EXIT_FAILURE);
+                    }
+                    LOCCTR += (OPCODE[3] == 'W' ? 3 : 1) * count.value;
+                }
+                else if (strcmp(OPCODE, "EQU") == 0) // The label stands for the operand's value, which may have to wait for later labels
+                {
+                    if (LABEL == NULL || OPERAND == NULL)
+                    {
+                        fprintf(stderr, "Error: Pass 1, Line %d: EQU needs a label and an operand\n", lineNumber);
+                        exit(EXIT_FAILURE);
+                    }
+                    addSymbol(LABEL, LOCCTR);
+                    // The equate keeps its expression, which --external would otherwise compile into the line's scratch space
+                    const Expression* expression = statementRecords != NULL ? compileOperandIn(&assemblyArena, OPERAND, strlen(OPERAND), 1)
+                        : compileOperand(OPERAND, strlen(OPERAND), 1);
+                    defineEquate(&assemblyArena, symbolCount - 1, expression, LOCCTR, lineNumber);
+                }
+                else if (strcmp(OPCODE, "ORG") == 0) // Continue at the operand's address, or with no operand where the last ORG left off
+                {
+                    int origin = savedLOCCTR;
+                    if (OPERAND != NULL)
+                    {
+                        ExpressionValue value = evaluateOperandNow(OPCODE, OPERAND);
+                        origin = value.value;
+                        savedLOCCTR = LOCCTR;
+                    }
+                    else if (savedLOCCTR < 0)
+                    {
+                        fprintf(stderr, "Error: Pass 1, Line %d: ORG with no operand has no earlier ORG to return from\n", lineNumber);
+                        exit(EXIT_FAILURE);
+                    }
+                    else
+                    {
+                        savedLOCCTR = -1;
+                    }
+                    if (origin < 0 || origin > MAX_ADDRESS + 1)
+                    {
+                        fprintf(stderr, "Error: Pass 1, Line %d: ORG address out of range %s\n", lineNumber, OPERAND);
+                        exit(EXIT_FAILURE);
+                    }
+                    highestLOCCTR = LOCCTR > highestLOCCTR ? LOCCTR : highestLOCCTR;
+                    LOCCTR = origin;
+                }
+                else if (strcmp(OPCODE, "WORD") == 0 || strcmp(OPCODE, "BYTE") == 0)
+                {
+                    // A repeated constant is sized from one copy; the copies only exist in pass 2's output.
+                    // The operand may be an INCLUDE file's cached statement, so the count is split off a copy
+                    char* constant = OPERAND != NULL ? arenaStrdup(&lineArena, OPERAND) : NULL;
+                    long count = constant != NULL ? splitRepeatCount(constant) : 1;
+                    if (OPCODE[0] == 'W' && constant != NULL && isExpression(constant, strlen(constant)))
+                    {
+                        compileOperand(constant, strlen(constant), 1); // Ready for pass 2
+                    }
+                    if (count < 0 || count > MAX_ADDRESS + 1)
+                    {
+                        fprintf(stderr, "Error: Pass 1, Line %d: Invalid repeat count in operand %s\n", lineNumber, OPERAND);
+                        exit(EXIT_FAILURE);
+                    }
+                    long length = 3; // One byte per character or per two hex digits for BYTE, a word for WORD
+                    if (strcmp(OPCODE, "BYTE") == 0)
+                    {
+                        length = constant != NULL ? byteConstantLength(constant) : -1;
+                        if (length < 0 || length > MAX_ADDRESS + 1)
+                        {
+                            fprintf(stderr, "Error: Pass 1, Line %d: Invalid BYTE format for operand %s\n", lineNumber, OPERAND != NULL ? OPERAND : "");
+                            exit(EXIT_FAILURE);
+                        }
+                    }
+                    long long total = (long long)length * count;
+                    LOCCTR += (int)(total < MAX_ADDRESS + 2 ? total : MAX_ADDRESS + 2); // Too much is caught by the check below
+                }
+                else if (strcmp(OPCODE, "INCBIN") == 0) // The file's bytes, placed here
+                {
+                    BinaryInclusion* inclusion = addBinaryInclusion();
+                    resolveBinaryInclusion(&reader, OPERAND, lineNumber, &assemblyArena, inclusion);
+                    addCacheDependency(&cache, &assemblyArena, inclusion->path);
+                    LOCCTR += (int)(inclusion->length < MAX_ADDRESS + 2 ? inclusion->length : MAX_ADDRESS + 2);
+                }
+                // BASE, NOBASE and USE take no space
+                endIntermediateLine(IntermediateFile); // New line after determining new LOCCTR
+            }
+            else if (isValidOpcode(OPCODE)) // Opcode is valid but NOT a directive
+            {
+                writeToIntermediateFile(IntermediateFile, LOCCTR, LABEL, OPCODE, OPERAND); // Write to file
+                endIntermediateLine(IntermediateFile); // New line
+                LOCCTR += instructionLength(OPCODE);
+                size_t length = 0;
+                int mode = 0;
+                const char* body = OPERAND != NULL ? operandBody(OPERAND, &length, &mode) : NULL;
+                if (body != NULL && isExpression(body, length))
+                {
+                    compileOperand(body, length, 1); // Syntax errors are found now, and pass 2 only evaluates it
+                }
+            }
+            else // Not an opcode or directive
+            {
+                fprintf(stderr, "Error: Pass 1, Line %d: Invalid operation '%s'\n", lineNumber, OPCODE);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // The program has to fit in memory, so it may end at the very top of the address space but not past it
+        if (LOCCTR > MAX_ADDRESS + 1)
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: Program exceeds the address space (LOCCTR %X, last address %X)\n", lineNumber, LOCCTR, MAX_ADDRESS);
+            exit(EXIT_FAILURE);
+        }
+    }
+    closeSourceReader(&reader);
+#if PIPELINE_AVAILABLE
+    if (pipelined)
+    {
+        stopLineQueue(&inputLines);
+    }
+#endif
+    if (conditionalDepth > 0)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: IF has no ENDIF\n", conditionals[conditionalDepth - 1].line);
+        exit(EXIT_FAILURE);
+    }
+    LOCCTR = highestLOCCTR > LOCCTR ? highestLOCCTR : LOCCTR;
+    bool usesBlocks = programBlockCount > 1;
+    if (usesBlocks) // The blocks' lengths are known now, so every label can be given its address in the program
+    {
+        LOCCTR = layOutProgramBlocks(LOCCTR, highestLOCCTR);
+    }
+    resolveEquates(&assemblyArena); // Every label is known now, so the EQUs that refer forward can be evaluated
+    if (usesBlocks)
+    {
+        reevaluateEquates(); // Those evaluated during pass 1 used addresses within their blocks
+    }
+#if ISA_PEEPHOLE
+    if (options->peephole != 0) // The optimizer works on the whole of pass 1's output before pass 2 sees any of it
+    {
+        IntermediateFile = optimizeIntermediate(options, reopenIntermediate(options, IntermediateFile), &LOCCTR, MessageFile);
+    }
+#endif
+    // End of pass 1, close intermediate for writing, open for reading
+    if (statementRecords != NULL)
+    {
+        rewindStatementRecords(statementRecords);
+    }
+    else
+    {
+        IntermediateFile = reopenIntermediate(options, IntermediateFile);
+    }
+
+    // Start of pass 2. Outputs that aren't wanted stay NULL and are never formatted
+    FILE* ListingFile = openOutput(options->listingPath);
+    FILE* ObjectFile = openOutput(options->objectPath);
+    char* LINE = NULL, * ADDRESS = NULL;
+    firstLine = true; bool baseSet = false; int baseAddress = 0;
+    int startingAddress = 0;
+    int entryAddress = 0;
+    ImageWriter imageWriter = { 0 };
+    const char* programName = "";
+    const char* regionLabel = NULL; // The last label seen, for the line map
+    int nextBinaryInclusion = 0;
+    char record[64];
+
+    IntermediateSource intermediate = { IntermediateFile, statementRecords };
+    Pass2Output output = { ListingFile, ObjectFile, &imageWriter };
+#if PIPELINE_AVAILABLE
+    // Pipelined, a reader thread feeds the intermediate lines in and a writer thread formats everything going out
+    LineQueue intermediateLines;
+    OutputStage outputStage;
+    Pass2Output writerOutput = output;
+    if (pipelined)
+    {
+        if (IntermediateFile != NULL) // Statement records are already read a batch at a time
+        {
+            startLineQueue(&intermediateLines, IntermediateFile);
+            intermediate.lines = &intermediateLines.reader;
+        }
+        startOutputStage(&outputStage, &writerOutput, &output);
+    }
+#endif
+
+    // Encoding report, counted as each instruction is encoded
+    bool collectStats = ISA_ENCODING_STATS && (options->statsPath != NULL || options->statsJsonPath != NULL);
+    EncodingStats stats;
+    resetEncodingStats(&stats, &assemblyArena);
+
+    // Pass 2
+    for (arenaReset(&lineArena); (line = readIntermediateLine(&intermediate)) != NULL; arenaReset(&lineArena))
+    {
+        lineCopy = arenaStrdup(&lineArena, line); // Copy line in from intermediate, since tokenizing modifies line
+
+        size_t len = strlen(lineCopy);
+        if (len > 0 && lineCopy[len - 1] == '\n') // Making sure string is properly null terminated for manipulation later on
+        {
+            lineCopy[len - 1] = '\0';
+        }
+
+        if (firstLine && line[0] != '.') // First line AND first line intermediate isn't a comment
+        {
+            emitListing(&output, lineCopy, "OBJ_CODE"); // Append OBJ_CODE to column identifiers
+            firstLine = false;
+            continue;
+        }
+
+        // Tokenize each column in
+        LINE = strtok_s(line, "\t\n", &context);
+        ADDRESS = strtok_s(NULL, " \t\n", &context);
+        // A second tab after the address means the label column is empty, so a labelled statement with no operand
+        // (LOOP FIX) isn't mistaken for an unlabelled one with an operand
+        LABEL = (context != NULL && *context == '\t') ? NULL : splitField(NULL, " \t\n", &context);
+        OPCODE = splitField(NULL, " \t\n", &context);
+        OPERAND = splitField(NULL, " \t\n", &context);
+
+        if (LINE == NULL)
+        {
+            break;
+        }
+        lineNumber = atoi(LINE); // Symbol uses are recorded against the line they appear on
+        if (OPCODE == NULL) // Make sure variables are read in correctly, accounting for whitespace
+        {
+            OPCODE = LABEL;
+            LABEL = NULL;
+        }
+
+        if (strcmp(ADDRESS, ".") == 0) // Comment, directly copy to listing
+        {
+            emitListing(&output, lineCopy, NULL);
+            continue;
+        }
+        char* addressEnd = NULL;
+        int address = (int)strtol(ADDRESS, &addressEnd, 16);
+        if (*addressEnd == ':') // In a program block, which pass 1 has placed since it wrote the address
+        {
+            int block = atoi(addressEnd + 1);
+            int blockAddress = address;
+            address += programBlocks[block].start;
+            lineCopy = listBlockAddress(lineCopy, (size_t)(ADDRESS - line), (size_t)(ADDRESS - line) + strlen(ADDRESS), address, block, blockAddress);
+        }
+        if (strcmp(OPCODE, "START") == 0) // START directive, only appears once, copy line to listing and start object file
+        {
+            startingAddress = address;
+            beginImage(&imageWriter, options->imagePath, startingAddress, LOCCTR - startingAddress);
+            programName = LABEL != NULL ? arenaStrdup(&assemblyArena, LABEL) : "";
+            emitListing(&output, lineCopy, NULL);
+            // H (1) + program name (2-7) + starting address in hex (8-13) + length of program in bytes, in hex (14-19)
+            char* header = arenaAlloc(&lineArena, strlen(lineCopy) + 32);
+            sprintf(header, "H%s\t%06X%06X\n", LABEL, startingAddress, LOCCTR - startingAddress);
+            emitObjectLine(&output, header);
+            continue;
+        }
+
+        // Instructions and words fit in a few digits; a BYTE constant may be any length, and gets room in lineArena
+        char objectCodeBuffer[33];
+        char* objectCode = objectCodeBuffer;
+        size_t objectCodeSize = sizeof(objectCodeBuffer);
+        long repeatCount = 1; // BYTE and WORD can repeat their constant
+        statementAddress = address;
+        if (strcmp(OPCODE, "EQU") == 0 || strcmp(OPCODE, "ORG") == 0) // Pass 1 did all they do. Code after ORG goes somewhere else, so it needs a new T record
+        {
+            recordOperandUses(OPERAND);
+            emitListing(&output, lineCopy, NULL);
+            if (OPCODE[0] == 'O')
+            {
+                emitRecordBreak(&output);
+            }
+            continue;
+        }
+        if (conditionalKind(OPCODE, strlen(OPCODE)) != CONDITIONAL_NONE) // Pass 1 left out the branch that isn't assembled
+        {
+            if (OPCODE[0] == 'I')
+            {
+                recordOperandUses(OPERAND);
+            }
+            emitListing(&output, lineCopy, NULL);
+            continue;
+        }
+        if (strcmp(OPCODE, "USE") == 0) // The code after it goes somewhere else
+        {
+            emitListing(&output, lineCopy, NULL);
+            emitRecordBreak(&output);
+            continue;
+        }
+        if (collectStats && LABEL != NULL) // Each label starts a new region of the encoding report
+        {
+            beginEncodingRegion(&stats, LABEL, address);
+        }
+        if (options->lineMapPath != NULL && LABEL != NULL)
+        {
+            regionLabel = arenaStrdup(&assemblyArena, LABEL);
+        }
+
+        if (strcmp(OPCODE, "BASE") == 0) // Use base addressing if PC addressing not available. LOCCTR - B where B is the address of the symbol BASE indicates
+        {
+            baseSet = true;
+            baseAddress = getSymbolAddress(OPERAND);
+            if (baseAddress < 0)
+            {
+                fprintf(stderr, "Error: Pass 2, Line %s: Symbol not found %s\n", LINE, OPERAND);
+                exit(EXIT_FAILURE);
+            }
+            emitListing(&output, lineCopy, NULL);
+            continue;
+        }
+        else if (strcmp(OPCODE, "NOBASE") == 0) // Turn off base addressing
+        {
+            baseSet = false;
+            emitListing(&output, lineCopy, NULL);
+            continue;
+        }
+        else if (strcmp(OPCODE, "INCLUDE") == 0) // Pass 1 already put the included statements after this line
+        {
+            emitListing(&output, lineCopy, NULL);
+            continue;
+        }
+        else if (strcmp(OPCODE, "RESW") == 0 || strcmp(OPCODE, "RESB") == 0)
+        {
+            recordOperandUses(OPERAND);
+            emitListing(&output, lineCopy, NULL);
+            emitRecordBreak(&output);
+            continue;
+        }
+        else if (strcmp(OPCODE, "END") == 0)
+        {
+            // The program starts at the symbol END names, or at its first address if END has no operand
+            entryAddress = startingAddress;
+            if (OPERAND != NULL)
+            {
+                entryAddress = getSymbolAddress(OPERAND);
+                if (entryAddress < 0)
+                {
+                    fprintf(stderr, "Error: Pass 2, Line %s: Symbol not found %s\n", LINE, OPERAND);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            emitListing(&output, lineCopy, NULL);
+            emitRecordBreak(&output);
+            // M records: where each absolute address field is, relative to the start of the program, and its length in half-bytes
+            Modification modification;
+            for (int i = 0; nextModification(&i, &modification);)
+            {
+                snprintf(record, sizeof(record), "M%06X%02X\n", modification.address - startingAddress, modification.halfBytes);
+                emitObjectLine(&output, record);
+            }
+            snprintf(record, sizeof(record), "E%06X", entryAddress);
+            emitObjectLine(&output, record);
+            break;
+        }
+        else if (strcmp(OPCODE, "INCBIN") == 0)
+        {
+            long length = emitBinaryInclusion(&output, address, lineCopy, &binaryInclusions[nextBinaryInclusion++]);
+            if (options->lineMapPath != NULL && length > 0)
+            {
+                addLineMapEntry(&lineMap, address, (int)length, lineNumber / 5, regionLabel);
+            }
+            continue;
+        }
+        else if (strcmp(OPCODE, "WORD") == 0) // One 24 bit word: an absolute value, or an address (which needs an M record)
+        {
+            repeatCount = splitRepeatCount(OPERAND);
+            ExpressionValue value;
+            if (!evaluateOperand(OPERAND, &value))
+            {
+                fprintf(stderr, "Error: Pass 2, Line %s: Symbol not found %s\n", LINE, OPERAND);
+                exit(EXIT_FAILURE);
+            }
+            for (long i = 0; ISA_RELOCATABLE && value.relative != 0 && i < repeatCount; i++)
+            {
+                addModification(address + 3 * (int)i, 6);
+            }
+            snprintf(objectCode, objectCodeSize, "%06X", value.value & 0xFFFFFF);
+        }
+        else if (strcmp(OPCODE, "BYTE") == 0)
+        {
+            repeatCount = splitRepeatCount(OPERAND);
+            long length = byteConstantLength(OPERAND);
+            if (length >= 0 && (size_t)(2 * length + 1) > objectCodeSize)
+            {
+                objectCodeSize = (size_t)(2 * length + 1);
+                objectCode = arenaAlloc(&lineArena, objectCodeSize);
+            }
+            encodeByteConstant(objectCode, objectCodeSize, OPERAND);
+        }
+        else // An instruction; pass 1 has already checked the opcode
+        {
+            InstructionContext instruction = { address, baseSet, baseAddress, LINE, collectStats ? &stats : NULL };
+            encodeInstruction(objectCode, objectCodeSize, OPCODE, OPERAND, &instruction);
+        }
+
+        if (repeatCount > 1)
+        {
+            emitRepeatedCode(&output, address, lineCopy, objectCode, repeatCount);
+        }
+        else
+        {
+            emitCode(&output, address, lineCopy, objectCode);
+        }
+        if (options->lineMapPath != NULL)
+        {
+            addLineMapEntry(&lineMap, address, (int)(repeatCount * ((strlen(objectCode) + 1) / 2)), lineNumber / 5, regionLabel);
+        }
+    }
+#if PIPELINE_AVAILABLE
+    if (pipelined)
+    {
+        finishOutputStage(&outputStage);
+        if (intermediate.lines != NULL)
+        {
+            stopLineQueue(&intermediateLines);
+        }
+    }
+#endif
+
+    if (finishImage(&imageWriter, entryAddress))
+    {
+        fprintf(MessageFile, "Memory image created: %s\n", options->imagePath);
+    }
+
+    if (options->lineMapPath != NULL)
+    {
+        writeLineMap(&lineMap, options->lineMapPath);
+        fprintf(MessageFile, "Line map created: %s\n", options->lineMapPath);
+    }
+
+    if (options->symbolsPath != NULL)
+    {
+        SymbolIndexEntry* entries = arenaAlloc(&assemblyArena, (symbolCount > 0 ? symbolCount : 1) * sizeof(SymbolIndexEntry));
+        for (int i = 0; i < symbolCount; i++)
+        {
+            entries[i].name = symbolTable[i].name;
+            entries[i].address = symbolTable[i].address;
+            entries[i].line = symbolTable[i].definedLine;
+            entries[i].absolute = symbolTable[i].absolute;
+        }
+        writeSymbolIndex(entries, symbolCount, &assemblyArena, options->symbolsPath);
+        fprintf(MessageFile, "Symbol index created: %s\n", options->symbolsPath);
+    }
+
+    // Encoding report, as text and/or JSON
+    if (collectStats && options->statsPath != NULL)
+    {
+        FILE* StatsFile = openOutput(options->statsPath);
+        writeEncodingReport(StatsFile, &stats, programName);
+        closeStream(StatsFile);
+    }
+    if (collectStats && options->statsJsonPath != NULL)
+    {
+        FILE* StatsFile = openOutput(options->statsJsonPath);
+        writeEncodingReportJson(StatsFile, &stats, programName);
+        closeStream(StatsFile);
+    }
+
+    // Prints symbol table to listing. Absolute symbols (EQU numbers) are marked ABS, as their value is not an address
+    if (ListingFile != NULL)
+    {
+        fprintf(ListingFile, "\nSYMBOL\tADDRESS\n");
+        for (int i = 0; i < symbolCount; i++)
+        {
+            fprintf(ListingFile, "%s\t%04X%s", symbolTable[i].name, symbolTable[i].address, symbolTable[i].absolute ? "\tABS" : "");
+            if (i < symbolCount - 1)
+            {
+                fprintf(ListingFile, "\n");
+            }
+        }
+        if (usesBlocks) // Where each program block went
+        {
+            fprintf(ListingFile, "\n\nBLOCK\tADDRESS\tLENGTH");
+            for (int i = 0; i < programBlockCount; i++)
+            {
+                int start = i == 0 ? startingAddress : programBlocks[i].start;
+                fprintf(ListingFile, "\n%s\t%04X\t%04X", i == 0 ? "(default)" : programBlocks[i].name, start, programBlocks[i].start + programBlocks[i].highest - start);
+            }
+        }
+    }
+    if (options->crossReference)
+    {
+        writeCrossReference(ListingFile, &assemblyArena);
+    }
+    if (options->crossReferencePath != NULL)
+    {
+        writeCrossReferenceFile(options->crossReferencePath, &assemblyArena);
+        fprintf(MessageFile, "Cross-reference file created: %s\n", options->crossReferencePath);
+    }
+
+    if (statementRecords != NULL)
+    {
+        closeStatementRecords(statementRecords);
+        statementRecords = NULL;
+    }
+    else
+    {
+        fclose(IntermediateFile);
+    }
+    if (options->intermediatePath != NULL)
+    {
+        fprintf(MessageFile, "Listing file created (this can be safely deleted): %s\n", options->intermediatePath);
+    }
+    closeStream(ListingFile);
+    if (options->listingPath != NULL && ListingFile != stdout)
+    {
+        fprintf(MessageFile, "Listing file created: %s\n", options->listingPath);
+    }
+    closeStream(ObjectFile);
+    if (options->objectPath != NULL && ObjectFile != stdout)
+    {
+        fprintf(MessageFile, "Object file created: %s\n", options->objectPath);
+    }
+    closeStream(InputFile);
+    storeResultCache(&cache, options);
+    return 0;
+}
+
+// The whole program: parses the command line and assembles each input in turn
+static inline int runAssembler(int argc, char* argv[])
+{
+    AssemblerOptions options;
+    if (!parseArguments(argc, argv, &options))
+    {
+        return 1;
+    }
+    if (options.inputCount == 0) // Only --cache-stats
+    {
+        printCacheStats(stdout);
+        free(options.inputPaths);
+        return 0;
+    }
+    if (options.pipeline && !PIPELINE_AVAILABLE)
+    {
+        fprintf(stderr, "Note: --pipeline isn't available in this build, so the input is assembled on one thread\n");
+    }
+    if (!ISA_ENCODING_STATS && (options.statsPath != NULL || options.statsJsonPath != NULL))
+    {
+        fprintf(stderr, "Error: --stats and --stats-json are only available in the SIC/XE assembler\n");
+        return 1;
+    }
+    if (!ISA_PEEPHOLE && options.peephole != 0)
+    {
+        fprintf(stderr, "Error: -O and --peephole are only available in the SIC/XE assembler\n");
+        return 1;
+    }
+
+    // Status messages move to stderr when stdout carries the object records
+    selectInput(&options, 0, ISA_NAME);
+    FILE* MessageFile = messageStream(&options);
+    fprintf(MessageFile, "\nAuthor Info: Hannah Simon & Charlie Strickland\n\n");
+
+    // Each input is assembled in turn. INCLUDE files stay cached between them, so shared ones are tokenized once
+    int result = 0;
+    for (int i = 0; i < options.inputCount && result == 0; i++)
+    {
+        selectInput(&options, i, ISA_NAME);
+        result = assemble(&options, MessageFile);
+    }
+    if (options.inputCount > 1 && includeCacheHits + includeCacheMisses > 0)
+    {
+        fprintf(MessageFile, "INCLUDE files: %d read, %d reused from the cache\n", includeCacheMisses, includeCacheHits);
+    }
+    if (options.cacheStats)
+    {
+        printCacheStats(MessageFile);
+    }
+
+    // Release every string and record at once
+    arenaFree(&lineArena);
+    arenaFree(&assemblyArena);
+    freeIncludeCache();
+    free(options.inputPaths);
+    return result;
+}
+#endif
+
+#endif
@@ -0,0 +1,515 @@
+// Operand expressions: decimal numbers, symbols and * (the address of the statement itself) joined by + - * / and
+// parentheses, as in BUFEND-BUFFER or TABLE+3*(N-1). Every value is absolute (a plain number) or relative (an address,
+// which moves with the program). Relative terms may only be added and subtracted, and the whole expression has to come
+// out absolute or relative, so BUFEND-BUFFER is an absolute length and BUFFER+3 is an address.
+// Expressions are compiled to postfix once and evaluated as often as needed.
+// EQU symbols may refer to symbols defined after them. Those EQUs are put off until the end of pass 1, when every label
+// is known, and then evaluated in dependency order (Kahn's algorithm over the graph of EQUs naming other EQUs), so a
+// chain of any length costs one evaluation per EQU and a cycle is found rather than looped on
+#ifndef SICEXPR_H
+#define SICEXPR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include "sicarena.h"
+#include "sicsymtab.h"
+
+#define EXPRESSION_MAX_DEPTH 32   // Values on the evaluation stack at once
+#define EXPRESSION_MAX_NESTING 32 // Parentheses inside parentheses
+
+// One step of a compiled expression, in postfix order
+#define TERM_NUMBER 'n'
+#define TERM_SYMBOL 's'
+#define TERM_LOCATION 'l' // *
+#define TERM_NEGATE '~'   // Unary minus; the binary operators are their own characters
+
+typedef struct ExpressionTerm
+{
+    char kind;        // TERM_ kind, or + - * /
+    int value;        // The number, or the symbol's index once it has been found (-1 before)
+    const char* name; // A symbol's name, not NUL terminated
+    int length;
+} ExpressionTerm;
+
+typedef struct Expression
+{
+    const char* text; // What was compiled, not NUL terminated
+    size_t length;
+    ExpressionTerm* terms;
+    int count;
+} Expression;
+
+typedef struct ExpressionValue
+{
+    int value;
+    int relative;        // Relative terms, +1 for each one added and -1 for each one subtracted: 0 absolute, 1 an address
+    int lastUse;         // The last symbol use recorded, -1 if none
+    const char* missing; // The symbol that wasn't defined, when evaluation returns EXPRESSION_UNDEFINED
+    int missingLength;
+} ExpressionValue;
+
+// Returned by evaluateExpression when a symbol isn't defined (yet). Other errors are returned as their message
+static const char EXPRESSION_UNDEFINED[] = "Symbol not found";
+
+//////////////////// Compiling ////////////////////
+
+typedef struct ExpressionParser
+{
+    const char* c;
+    const char* end;
+    ExpressionTerm* terms;
+    int count;
+    int depth;    // Values the terms so far leave on the stack
+    int nesting;
+    const char* error;
+} ExpressionParser;
+
+static inline void addExpressionTerm(ExpressionParser* parser, char kind, int value, const char* name, int length)
+{
+    ExpressionTerm* term = &parser->terms[parser->count++];
+    term->kind = kind;
+    term->value = value;
+    term->name = name;
+    term->length = length;
+    if (kind == TERM_NUMBER || kind == TERM_SYMBOL || kind == TERM_LOCATION)
+    {
+        if (++parser->depth > EXPRESSION_MAX_DEPTH && parser->error == NULL)
+        {
+            parser->error = "Expression too complex";
+        }
+    }
+    else if (kind != TERM_NEGATE)
+    {
+        parser->depth--;
+    }
+}
+
+static inline void parseExpressionSum(ExpressionParser* parser);
+
+// A number, a symbol, *, a signed factor or a parenthesized sum
+static inline void parseExpressionFactor(ExpressionParser* parser)
+{
+    const char* c = parser->c;
+    if (parser->error != NULL)
+    {
+        return;
+    }
+    if (c == parser->end)
+    {
+        parser->error = "Missing term";
+    }
+    else if (*c == '-' || *c == '+')
+    {
+        parser->c++;
+        parseExpressionFactor(parser);
+        if (*c == '-')
+        {
+            addExpressionTerm(parser, TERM_NEGATE, 0, NULL, 0);
+        }
+    }
+    else if (*c == '(')
+    {
+        if (++parser->nesting > EXPRESSION_MAX_NESTING)
+        {
+            parser->error = "Expression too complex";
+            return;
+        }
+        parser->c++;
+        parseExpressionSum(parser);
+        if (parser->error == NULL && (parser->c == parser->end || *parser->c != ')'))
+        {
+            parser->error = "Missing )";
+        }
+        parser->c++;
+        parser->nesting--;
+    }
+    else if (*c == '*')
+    {
+        parser->c++;
+        addExpressionTerm(parser, TERM_LOCATION, 0, NULL, 0);
+    }
+    else if (isdigit((unsigned char)*c))
+    {
+        long long number = 0;
+        while (c < parser->end && isdigit((unsigned char)*c))
+        {
+            number = number * 10 + (*c++ - '0');
+            if (number > 0x7FFFFFFF)
+            {
+                parser->error = "Number too large";
+                return;
+            }
+        }
+        parser->c = c;
+        addExpressionTerm(parser, TERM_NUMBER, (int)number, NULL, 0);
+    }
+    else if (isalpha((unsigned char)*c))
+    {
+        while (c < parser->end && (isalnum((unsigned char)*c) || *c == '_'))
+        {
+            c++;
+        }
+        addExpressionTerm(parser, TERM_SYMBOL, -1, parser->c, (int)(c - parser->c));
+        parser->c = c;
+    }
+    else
+    {
+        parser->error = "Invalid character";
+    }
+}
+
+static inline void parseExpressionProduct(ExpressionParser* parser)
+{
+    parseExpressionFactor(parser);
+    while (parser->error == NULL && parser->c < parser->end && (*parser->c == '*' || *parser->c == '/'))
+    {
+        char operation = *parser->c++;
+        parseExpressionFactor(parser);
+        addExpressionTerm(parser, operation, 0, NULL, 0);
+    }
+}
+
+static inline void parseExpressionSum(ExpressionParser* parser)
+{
+    parseExpressionProduct(parser);
+    while (parser->error == NULL && parser->c < parser->end && (*parser->c == '+' || *parser->c == '-'))
+    {
+        char operation = *parser->c++;
+        parseExpressionProduct(parser);
+        addExpressionTerm(parser, operation, 0, NULL, 0);
+    }
+}
+
+// Compiles the length characters of text into expression, its terms allocated from arena (text has to outlive it).
+// Returns NULL, or what is wrong with the expression
+static inline const char* compileExpression(Arena* arena, const char* text, size_t length, Expression* expression)
+{
+    ExpressionParser parser = { text, text + length, NULL, 0, 0, 0, NULL };
+    parser.terms = arenaAlloc(arena, (length + 1) * sizeof(ExpressionTerm)); // No more terms than characters
+    parseExpressionSum(&parser);
+    if (parser.error == NULL && parser.c != parser.end)
+    {
+        parser.error = *parser.c == ')' ? "Unmatched )" : "Missing operator";
+    }
+    expression->text = text;
+    expression->length = length;
+    expression->terms = parser.terms;
+    expression->count = parser.error == NULL ? parser.count : 0;
+    return parser.error;
+}
+
+//////////////////// Evaluating ////////////////////
+
+// Evaluates expression with * standing for location. Each symbol it names is recorded as a use on line with the USE_ bits
+// mode, unless mode is negative. Returns NULL, EXPRESSION_UNDEFINED if a symbol isn't defined (or is an EQU still
+// waiting for its value), or what else is wrong
+static inline const char* evaluateExpression(const Expression* expression, int location, int mode, int line, ExpressionValue* result)
+{
+    ExpressionValue stack[EXPRESSION_MAX_DEPTH];
+    int depth = 0;
+    result->lastUse = -1;
+    for (int i = 0; i < expression->count; i++)
+    {
+        ExpressionTerm* term = &expression->terms[i];
+        if (term->kind == TERM_NUMBER || term->kind == TERM_LOCATION)
+        {
+            stack[depth].value = term->kind == TERM_NUMBER ? term->value : location;
+            stack[depth++].relative = term->kind == TERM_NUMBER ? 0 : 1;
+            continue;
+        }
+        if (term->kind == TERM_SYMBOL)
+        {
+            if (term->value < 0)
+            {
+                term->value = findSymbol(term->name, (size_t)term->length); // Indexes never change, so this is kept
+            }
+            if (term->value < 0 || symbolTable[term->value].pending)
+            {
+                result->missing = term->name;
+                result->missingLength = term->length;
+                return EXPRESSION_UNDEFINED;
+            }
+            if (mode >= 0)
+            {
+                int use = addSymbolUse(term->value, line, mode);
+                result->lastUse = use >= 0 ? use : result->lastUse;
+            }
+            stack[depth].value = symbolTable[term->value].address;
+            stack[depth++].relative = symbolTable[term->value].absolute ? 0 : 1;
+            continue;
+        }
+        if (term->kind == TERM_NEGATE)
+        {
+            stack[depth - 1].value = -stack[depth - 1].value;
+            stack[depth - 1].relative = -stack[depth - 1].relative;
+            continue;
+        }
+
+        ExpressionValue* left = &stack[depth - 2];
+        const ExpressionValue* right = &stack[depth - 1];
+        depth--;
+        if (term->kind == '+' || term->kind == '-')
+        {
+            left->value = term->kind == '+' ? left->value + right->value : left->value - right->value;
+            left->relative = term->kind == '+' ? left->relative + right->relative : left->relative - right->relative;
+            continue;
+        }
+        if (left->relative != 0 || right->relative != 0)
+        {
+            return "Relative terms can only be added and subtracted";
+        }
+        if (term->kind == '/' && right->value == 0)
+        {
+            return "Division by zero";
+        }
+        left->value = term->kind == '*' ? left->value * right->value : left->value / right->value;
+    }
+    if (depth != 1)
+    {
+        return "Invalid expression";
+    }
+    if (stack[0].relative != 0 && stack[0].relative != 1)
+    {
+        return "Expression is neither absolute nor relative";
+    }
+    result->value = stack[0].value;
+    result->relative = stack[0].relative;
+    return NULL;
+}
+
+//////////////////// EQU ////////////////////
+
+typedef struct Equate
+{
+    int symbol;
+    int line;       // Line number of the EQU statement
+    int location;   // Its address, the value of *
+    const Expression* expression;
+} Equate;
+
+// EQUs in statement order, and the order they were given their values in (which re-evaluating has to follow)
+static Equate* equates = NULL;
+static int equateCount = 0;
+static int equateCapacity = 0;
+static int* equateOrder = NULL;
+static int equateOrderCount = 0;
+
+static inline void resetEquates(void)
+{
+    equates = NULL;
+    equateCount = 0;
+    equateCapacity = 0;
+    equateOrder = NULL;
+    equateOrderCount = 0;
+}
+
+static inline void setEquateValue(int index, const ExpressionValue* value)
+{
+    Symbol* symbol = &symbolTable[equates[index].symbol];
+    symbol->address = value->value;
+    symbol->absolute = value->relative == 0;
+    symbol->pending = false;
+    equateOrder[equateOrderCount++] = index;
+}
+
+// Defines symbol (already in the table) as expression. It gets its value now if everything it names is known,
+// and at resolveEquates otherwise
+static inline void defineEquate(Arena* arena, int symbol, const Expression* expression, int location, int line)
+{
+    if (equateCount == equateCapacity)
+    {
+        int capacity = equateCapacity ? equateCapacity * 2 : 16;
+        Equate* grown = arenaAlloc(arena, capacity * sizeof(Equate));
+        int* order = arenaAlloc(arena, capacity * sizeof(int));
+        if (equateCount > 0)
+        {
+            memcpy(grown, equates, equateCount * sizeof(Equate));
+            memcpy(order, equateOrder, equateOrderCount * sizeof(int));
+        }
+        equates = grown;
+        equateOrder = order;
+        equateCapacity = capacity;
+    }
+    Equate* equate = &equates[equateCount++];
+    equate->symbol = symbol;
+    equate->line = line;
+    equate->location = location;
+    equate->expression = expression;
+
+    ExpressionValue value;
+    const char* error = evaluateExpression(expression, location, -1, line, &value);
+    symbolTable[symbol].pending = error != NULL;
+    if (error == NULL)
+    {
+        setEquateValue(equateCount - 1, &value);
+    }
+    else if (error != EXPRESSION_UNDEFINED)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: %s in EQU %.*s\n", line, error, (int)expression->length, expression->text);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// The EQU a pending EQU is waiting on: the first symbol it names that is itself pending, or -1
+static inline int pendingDependency(const Equate* equate, const int* equateOfSymbol)
+{
+    for (int i = 0; i < equate->expression->count; i++)
+    {
+        const ExpressionTerm* term = &equate->expression->terms[i];
+        if (term->kind == TERM_SYMBOL && term->value >= 0 && symbolTable[term->value].pending)
+        {
+            return equateOfSymbol[term->value];
+        }
+    }
+    return -1;
+}
+
+// Gives every EQU left waiting by pass 1 its value. Each pending EQU is a node with an edge from every pending EQU it
+// names; those with no incoming edges are evaluated first, which releases the ones waiting on them, and so on. Nodes
+// never released are on (or behind) a cycle, which is reported
+static inline void resolveEquates(Arena* arena)
+{
+    int pendingCount = equateCount - equateOrderCount;
+    if (pendingCount == 0)
+    {
+        return;
+    }
+    int* equateOfSymbol = arenaAlloc(arena, symbolCount * sizeof(int));
+    int* waiting = arenaAlloc(arena, equateCount * sizeof(int));    // Incoming edges not yet released
+    int* firstEdge = arenaAlloc(arena, (equateCount + 1) * sizeof(int));
+    memset(waiting, 0, equateCount * sizeof(int));
+    memset(firstEdge, 0, (equateCount + 1) * sizeof(int));
+    for (int i = 0; i < equateCount; i++)
+    {
+        equateOfSymbol[equates[i].symbol] = i;
+    }
+
+    // Count the edges out of each EQU, find every symbol (a name still missing now will never be defined)
+    int edgeCount = 0;
+    for (int i = 0; i < equateCount; i++)
+    {
+        if (!symbolTable[equates[i].symbol].pending)
+        {
+            continue;
+        }
+        for (int t = 0; t < equates[i].expression->count; t++)
+        {
+            ExpressionTerm* term = &equates[i].expression->terms[t];
+            if (term->kind != TERM_SYMBOL)
+            {
+                continue;
+            }
+            term->value = term->value >= 0 ? term->value : findSymbol(term->name, (size_t)term->length);
+            if (term->value < 0)
+            {
+                fprintf(stderr, "Error: Pass 1, Line %d: Symbol not found %.*s in EQU %.*s\n", equates[i].line,
+                    term->length, term->name, (int)equates[i].expression->length, equates[i].expression->text);
+                exit(EXIT_FAILURE);
+            }
+            if (symbolTable[term->value].pending)
+            {
+                firstEdge[equateOfSymbol[term->value] + 1]++;
+                waiting[i]++;
+                edgeCount++;
+            }
+        }
+    }
+    // Then lay the edges out by source (a prefix sum turns the counts into offsets) and fill them in
+    for (int i = 0; i < equateCount; i++)
+    {
+        firstEdge[i + 1] += firstEdge[i];
+    }
+    int* edges = arenaAlloc(arena, (edgeCount > 0 ? edgeCount : 1) * sizeof(int));
+    int* filled = arenaAlloc(arena, equateCount * sizeof(int));
+    memcpy(filled, firstEdge, equateCount * sizeof(int));
+    for (int i = 0; i < equateCount; i++)
+    {
+        for (int t = 0; symbolTable[equates[i].symbol].pending && t < equates[i].expression->count; t++)
+        {
+            const ExpressionTerm* term = &equates[i].expression->terms[t];
+            if (term->kind == TERM_SYMBOL && symbolTable[term->value].pending)
+            {
+                edges[filled[equateOfSymbol[term->value]]++] = i;
+            }
+        }
+    }
+
+    // Evaluate in topological order. The queue is the tail of equateOrder, which setEquateValue appends to
+    int* ready = arenaAlloc(arena, pendingCount * sizeof(int));
+    int readyCount = 0;
+    for (int i = 0; i < equateCount; i++)
+    {
+        if (symbolTable[equates[i].symbol].pending && waiting[i] == 0)
+        {
+            ready[readyCount++] = i;
+        }
+    }
+    for (int next = 0; next < readyCount; next++)
+    {
+        int i = ready[next];
+        ExpressionValue value;
+        const char* error = evaluateExpression(equates[i].expression, equates[i].location, -1, equates[i].line, &value);
+        if (error != NULL)
+        {
+            fprintf(stderr, "Error: Pass 1, Line %d: %s in EQU %.*s\n", equates[i].line, error,
+                (int)equates[i].expression->length, equates[i].expression->text);
+            exit(EXIT_FAILURE);
+        }
+        setEquateValue(i, &value);
+        for (int e = firstEdge[i]; e < firstEdge[i + 1]; e++)
+        {
+            if (--waiting[edges[e]] == 0)
+            {
+                ready[readyCount++] = edges[e];
+            }
+        }
+    }
+    if (readyCount == pendingCount)
+    {
+        return;
+    }
+
+    // Something is still waiting. Following what it waits on has to come back around, and that loop is the cycle
+    int start = 0;
+    while (!symbolTable[equates[start].symbol].pending)
+    {
+        start++;
+    }
+    bool* seen = arenaAlloc(arena, equateCount * sizeof(bool));
+    memset(seen, 0, equateCount * sizeof(bool));
+    int first = start;
+    while (!seen[first])
+    {
+        seen[first] = true;
+        first = pendingDependency(&equates[first], equateOfSymbol);
+    }
+    fprintf(stderr, "Error: Pass 1, Line %d: Circular EQU definition: %s", equates[first].line, symbolTable[equates[first].symbol].name);
+    int i = first;
+    do
+    {
+        i = pendingDependency(&equates[i], equateOfSymbol);
+        fprintf(stderr, " -> %s", symbolTable[equates[i].symbol].name);
+    } while (i != first);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+// Evaluates every EQU again, in the order they were first resolved, after the labels they name have moved
+static inline void reevaluateEquates(void)
+{
+    for (int i = 0; i < equateOrderCount; i++)
+    {
+        const Equate* equate = &equates[equateOrder[i]];
+        ExpressionValue value;
+        if (evaluateExpression(equate->expression, equate->location, -1, equate->line, &value) == NULL)
+        {
+            symbolTable[equate->symbol].address = value.value;
+            symbolTable[equate->symbol].absolute = value.relative == 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,274 @@
+// Flat binary memory images (--image): the program's bytes laid out at their addresses, ready to mmap.
+// Layout, all integers little-endian 32 bit:
+//   0     header: "SICIMG1" and a NUL, startAddress, length, entryAddress, extentCount, dataOffset, extentOffset
+//   4096  length bytes of memory, memory[0] being the byte at startAddress
+//   then  extentCount {offset, length} pairs in address order, the byte ranges the program actually supplies
+// Anything outside the extents (RESB/RESW areas) is never written, so it is a hole in the file and reads as zero
+#ifndef SICIMAGE_H
+#define SICIMAGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#include "sicmapfile.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define IMAGE_MAGIC "SICIMG1"
+#define IMAGE_HEADER_SIZE 32
+#define IMAGE_DATA_OFFSET 4096 // Page aligned, so the memory can be mapped on its own
+
+typedef struct ImageExtent
+{
+    unsigned int offset;
+    unsigned int length;
+} ImageExtent;
+
+//////////////////// Writing ////////////////////
+
+// Pass 2 hands each statement's object code to writeImageCode. Bytes go straight to their place in the file,
+// and consecutive ones are merged into the current extent
+typedef struct ImageWriter
+{
+    FILE* ImageFile;
+    unsigned int startAddress;
+    unsigned int length;
+    ImageExtent* extents;
+    int extentCount;
+    int extentCapacity;
+    long position; // Where the next byte would go without seeking, -1 if unknown
+} ImageWriter;
+
+// Opens path for a program of length bytes starting at startAddress. Does nothing if path is NULL
+static inline void beginImage(ImageWriter* writer, const char* path, int startAddress, int length)
+{
+    memset(writer, 0, sizeof(*writer));
+    if (path == NULL)
+    {
+        return;
+    }
+    writer->ImageFile = fopen(path, "wb");
+    if (writer->ImageFile == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    writer->startAddress = (unsigned int)startAddress;
+    writer->length = (unsigned int)length;
+    writer->position = -1;
+}
+
+// Object code is uppercase hex, so this is all a digit needs
+static inline int imageHexDigit(char digit)
+{
+    return digit <= '9' ? digit - '0' : digit - 'A' + 10;
+}
+
+// Writes the object code (hex digits) of the statement at address
+static inline void writeImageCode(ImageWriter* writer, int address, const char* objectCode)
+{
+    if (writer->ImageFile == NULL)
+    {
+        return;
+    }
+    unsigned int offset = (unsigned int)address - writer->startAddress;
+    size_t digits = strlen(objectCode);
+    unsigned int count = (unsigned int)((digits + 1) / 2);
+    if (count == 0 || offset + count > writer->length)
+    {
+        return;
+    }
+
+    long filePosition = IMAGE_DATA_OFFSET + (long)offset;
+    if (writer->position != filePosition)
+    {
+        fseek(writer->ImageFile, filePosition, SEEK_SET); // Skipping ahead leaves a hole
+    }
+    for (size_t i = 0; i < digits; i += 2)
+    {
+        int high = imageHexDigit(objectCode[i]);
+        int low = i + 1 < digits ? imageHexDigit(objectCode[i + 1]) : 0;
+        fputc(high << 4 | low, writer->ImageFile);
+    }
+    writer->position = filePosition + count;
+
+    ImageExtent* last = writer->extentCount > 0 ? &writer->extents[writer->extentCount - 1] : NULL;
+    if (last != NULL && last->offset + last->length == offset)
+    {
+        last->length += count;
+        return;
+    }
+    if (writer->extentCount == writer->extentCapacity)
+    {
+        writer->extentCapacity = writer->extentCapacity ? writer->extentCapacity * 2 : 64;
+        writer->extents = realloc(writer->extents, writer->extentCapacity * sizeof(ImageExtent));
+        if (writer->extents == NULL)
+        {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    writer->extents[writer->extentCount].offset = offset;
+    writer->extents[writer->extentCount].length = count;
+    writer->extentCount++;
+}
+
+static inline int compareImageExtents(const void* a, const void* b)
+{
+    const ImageExtent* x = a, * y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Writes the extent table and header, and closes the file. Returns false if no image was being written
+static inline bool finishImage(ImageWriter* writer, int entryAddress)
+{
+    if (writer->ImageFile == NULL)
+    {
+        return false;
+    }
+    // Code after an ORG back to an earlier address arrives out of order, and may overlap what is there
+    int merged = 0;
+    if (writer->extentCount > 1)
+    {
+        qsort(writer->extents, writer->extentCount, sizeof(ImageExtent), compareImageExtents);
+    }
+    for (int i = 0; i < writer->extentCount; i++)
+    {
+        ImageExtent* last = merged > 0 ? &writer->extents[merged - 1] : NULL;
+        if (last != NULL && writer->extents[i].offset <= last->offset + last->length)
+        {
+            unsigned int end = writer->extents[i].offset + writer->extents[i].length;
+            last->length = end > last->offset + last->length ? end - last->offset : last->length;
+        }
+        else
+        {
+            writer->extents[merged++] = writer->extents[i];
+        }
+    }
+    writer->extentCount = merged;
+    // The extent table goes after the memory, 8 byte aligned. The file is sized to cover the memory even if it ends in a hole
+    long extentOffset = (IMAGE_DATA_OFFSET + (long)writer->length + 7) & ~7L;
+    fflush(writer->ImageFile);
+#ifdef _WIN32
+    _chsize_s(_fileno(writer->ImageFile), extentOffset);
+#else
+    if (ftruncate(fileno(writer->ImageFile), extentOffset) != 0)
+    {
+        perror("Error sizing image file");
+    }
+#endif
+    fseek(writer->ImageFile, extentOffset, SEEK_SET);
+    for (int i = 0; i < writer->extentCount; i++)
+    {
+        unsigned char entry[8];
+        putFileWord(entry, writer->extents[i].offset);
+        putFileWord(entry + 4, writer->extents[i].length);
+        fwrite(entry, 1, sizeof(entry), writer->ImageFile);
+    }
+
+    unsigned char header[IMAGE_HEADER_SIZE] = { 0 };
+    memcpy(header, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    putFileWord(header + 8, writer->startAddress);
+    putFileWord(header + 12, writer->length);
+    putFileWord(header + 16, (unsigned int)entryAddress);
+    putFileWord(header + 20, (unsigned int)writer->extentCount);
+    putFileWord(header + 24, IMAGE_DATA_OFFSET);
+    putFileWord(header + 28, (unsigned int)extentOffset);
+    fseek(writer->ImageFile, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), writer->ImageFile);
+
+    fclose(writer->ImageFile);
+    free(writer->extents);
+    memset(writer, 0, sizeof(*writer));
+    return true;
+}
+
+//////////////////// Reading ////////////////////
+
+// A mapped image. memory[i] is the byte at startAddress + i; bytes outside every extent are reserved space
+typedef struct MemoryImage
+{
+    int startAddress;
+    int length;
+    int entryAddress;
+    const unsigned char* memory;
+    ImageExtent* extents;
+    int extentCount;
+    MappedFile file;
+} MemoryImage;
+
+static inline void closeMemoryImage(MemoryImage* image)
+{
+    unmapFile(&image->file);
+    free(image->extents);
+    memset(image, 0, sizeof(*image));
+}
+
+// Maps an image file. The memory is used where it lies in the mapping, so pages of a hole are never even read
+static inline bool openMemoryImage(const char* path, MemoryImage* image)
+{
+    memset(image, 0, sizeof(*image));
+    if (!mapFile(path, &image->file))
+    {
+        return false;
+    }
+
+    const unsigned char* header = image->file.data;
+    if (image->file.size < IMAGE_HEADER_SIZE || memcmp(header, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a memory image\n", path);
+        closeMemoryImage(image);
+        return false;
+    }
+    image->startAddress = (int)getFileWord(header + 8);
+    image->length = (int)getFileWord(header + 12);
+    image->entryAddress = (int)getFileWord(header + 16);
+    image->extentCount = (int)getFileWord(header + 20);
+    size_t dataOffset = getFileWord(header + 24);
+    size_t extentOffset = getFileWord(header + 28);
+    if (dataOffset + image->length > image->file.size || extentOffset + (size_t)image->extentCount * 8 > image->file.size)
+    {
+        fprintf(stderr, "Error: Image file %s is truncated\n", path);
+        closeMemoryImage(image);
+        return false;
+    }
+    image->memory = image->file.data + dataOffset;
+    image->extents = malloc((image->extentCount > 0 ? image->extentCount : 1) * sizeof(ImageExtent));
+    for (int i = 0; image->extents != NULL && i < image->extentCount; i++)
+    {
+        image->extents[i].offset = getFileWord(image->file.data + extentOffset + 8 * i);
+        image->extents[i].length = getFileWord(image->file.data + extentOffset + 8 * i + 4);
+    }
+    return image->extents != NULL;
+}
+
+// Returns whether the program supplies the byte at offset (false inside RESB/RESW areas), by binary search of the extents
+static inline bool isImageByteLoaded(const MemoryImage* image, int offset)
+{
+    int low = 0, high = image->extentCount - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        const ImageExtent* extent = &image->extents[middle];
+        if ((unsigned int)offset < extent->offset)
+        {
+            high = middle - 1;
+        }
+        else if ((unsigned int)offset >= extent->offset + extent->length)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
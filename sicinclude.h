@@ -0,0 +1,525 @@
+// Source statements for pass 1: lines of the file being assembled, with INCLUDE files spliced in from a process-wide cache
+#ifndef SICINCLUDE_H
+#define SICINCLUDE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "siccompat.h"
+#include "sicarena.h"
+#include "sicpipeline.h"
+#include "siclexer.h"
+
+#define MAX_INCLUDE_DEPTH 32
+#define INCLUDE_CACHE_BUCKETS 256
+#define SOURCE_BLOCK_SIZE (256 * 1024) // Bytes of the input file lexed at once
+
+//////////////////// Include cache ////////////////////
+
+// An include file tokenized once. Entries live for the whole process, so every assembly in a batch shares them
+typedef struct IncludeFile
+{
+    char* path;                    // Canonical path, the cache key
+    long long modifiedTime;
+    long long size;
+    unsigned long long contentHash;
+    SourceStatement* statements;
+    int statementCount;
+    struct IncludeFile* next;      // Next entry in the same bucket
+} IncludeFile;
+
+static Arena includeArena;         // Never reset between assemblies, only freed at exit
+static IncludeFile* includeCache[INCLUDE_CACHE_BUCKETS];
+static int includeCacheHits = 0;
+static int includeCacheMisses = 0;
+
+static inline unsigned long long hashIncludeContent(const char* text, size_t length)
+{
+    unsigned long long hash = 14695981039346656037ull; // 64-bit FNV-1a
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Splits the file's text into statements stored in includeArena, the whole file lexed as one block
+static inline void tokenizeIncludeFile(IncludeFile* file, const char* text, size_t length)
+{
+    // Every stored line ends in a newline, since comments are written out exactly as stored
+    char* block = arenaAlloc(&includeArena, length + 2);
+    memcpy(block, text, length);
+    if (length > 0 && block[length - 1] != '\n')
+    {
+        block[length++] = '\n';
+    }
+    block[length] = '\0';
+    size_t consumed = 0;
+    file->statementCount = lexSourceBlock(&includeArena, block, length, true, &file->statements, &consumed);
+}
+
+// Returns the tokenized contents of the file at canonicalPath, reading it only if it isn't cached or has changed since
+static inline IncludeFile* loadIncludeFile(const char* canonicalPath)
+{
+    struct stat info;
+    if (stat(canonicalPath, &info) != 0)
+    {
+        return NULL;
+    }
+    unsigned int bucket = (unsigned int)(hashIncludeContent(canonicalPath, strlen(canonicalPath)) % INCLUDE_CACHE_BUCKETS);
+    IncludeFile* file = includeCache[bucket];
+    while (file != NULL && strcmp(file->path, canonicalPath) != 0)
+    {
+        file = file->next;
+    }
+
+    // Unchanged timestamp and size: reuse it without opening the file
+    if (file != NULL && file->modifiedTime == (long long)info.st_mtime && file->size == (long long)info.st_size)
+    {
+        includeCacheHits++;
+        return file;
+    }
+
+    FILE* IncludedFile = fopen(canonicalPath, "rb");
+    if (IncludedFile == NULL)
+    {
+        return NULL;
+    }
+    size_t length = (size_t)info.st_size;
+    char* text = malloc(length > 0 ? length : 1);
+    if (text == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    length = fread(text, 1, length, IncludedFile);
+    fclose(IncludedFile);
+    unsigned long long contentHash = hashIncludeContent(text, length);
+
+    if (file == NULL)
+    {
+        file = arenaAlloc(&includeArena, sizeof(IncludeFile));
+        file->path = arenaStrdup(&includeArena, canonicalPath);
+        file->contentHash = ~contentHash;
+        file->next = includeCache[bucket];
+        includeCache[bucket] = file;
+    }
+    file->modifiedTime = (long long)info.st_mtime;
+    file->size = (long long)info.st_size;
+
+    // Touched but not edited (a checkout, a build step copying headers around): the statements are still good
+    if (file->contentHash == contentHash)
+    {
+        includeCacheHits++;
+    }
+    else
+    {
+        includeCacheMisses++;
+        file->contentHash = contentHash;
+        tokenizeIncludeFile(file, text, length); // A stale copy stays in the arena; edits during one run are rare
+    }
+    free(text);
+    return file;
+}
+
+static inline void freeIncludeCache(void)
+{
+    memset(includeCache, 0, sizeof(includeCache));
+    arenaFree(&includeArena);
+}
+
+//////////////////// Reading statements ////////////////////
+
+typedef struct IncludeFrame
+{
+    IncludeFile* file;
+    int next; // Index of the next statement to hand out
+} IncludeFrame;
+
+// Hands out pass 1's statements: lines of the input file, and while an INCLUDE is open, that file's cached statements
+typedef struct SourceReader
+{
+    FILE* InputFile;
+    const char* inputPath;          // As given, "-" for standard input
+    char inputCanonical[PATH_MAX];  // Empty for standard input
+    Arena* lineArena;               // Scratch space for the current statement, reset before each one is read
+#if PIPELINE_AVAILABLE
+    BlockReader* lines;             // Blocks of input lines read ahead by another thread (--pipeline), NULL to read InputFile here
+#endif
+    const char* const* includeDirs; // Searched, in order, after the including file's directory
+    int includeDirCount;
+    IncludeFrame stack[MAX_INCLUDE_DEPTH];
+    int depth;
+    int lineCount;                  // Lines of the input file read so far
+
+    // The input file is lexed a block of lines at a time. Without --pipeline the block is read here, and a line
+    // cut off at its end is carried over to the front of the next one
+    char* block;
+    size_t blockCapacity;
+    size_t blockLength;             // Bytes read into block
+    bool inputFinished;
+    Arena blockArena;               // The block's bitmaps and comments, reset for each block
+    LexedBlock lexed;               // Its lines, split as they are read; lexed.position is where the next one starts
+} SourceReader;
+
+static inline void openSourceReader(SourceReader* reader, FILE* InputFile, const char* inputPath, Arena* lineArena, const char* const* includeDirs, int includeDirCount)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->InputFile = InputFile;
+    reader->inputPath = inputPath;
+    reader->lineArena = lineArena;
+    reader->includeDirs = includeDirs;
+    reader->includeDirCount = includeDirCount;
+    if (strcmp(inputPath, "-") == 0 || realpath(inputPath, reader->inputCanonical) == NULL)
+    {
+        reader->inputCanonical[0] = '\0';
+    }
+}
+
+static inline void closeSourceReader(SourceReader* reader)
+{
+    free(reader->block);
+    arenaFree(&reader->blockArena);
+    reader->block = NULL;
+}
+
+// Reads and classifies the input file's next block of lines, starting with any line the last one cut off.
+// Returns false at the end of the file
+static inline bool lexNextBlock(SourceReader* reader)
+{
+    arenaReset(&reader->blockArena);
+#if PIPELINE_AVAILABLE
+    if (reader->lines != NULL) // The reader thread hands over blocks of whole lines
+    {
+        char* chunk = nextEntry(reader->lines);
+        if (chunk == NULL)
+        {
+            return false;
+        }
+        beginLexedBlock(&reader->blockArena, chunk, strlen(chunk), true, &reader->lexed);
+        return true;
+    }
+#endif
+    size_t rest = reader->blockLength - reader->lexed.position;
+    if (reader->inputFinished && rest == 0)
+    {
+        return false;
+    }
+    memmove(reader->block, reader->block + reader->lexed.position, rest);
+    reader->blockLength = rest;
+    if (rest + 1 >= reader->blockCapacity) // Empty, or one line fills it, so it grows
+    {
+        reader->blockCapacity = reader->blockCapacity ? reader->blockCapacity * 2 : SOURCE_BLOCK_SIZE;
+        reader->block = realloc(reader->block, reader->blockCapacity);
+        if (reader->block == NULL)
+        {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    reader->blockLength += fread(reader->block + rest, 1, reader->blockCapacity - 1 - rest, reader->InputFile);
+    reader->inputFinished = feof(reader->InputFile) || ferror(reader->InputFile);
+    beginLexedBlock(&reader->blockArena, reader->block, reader->blockLength, reader->inputFinished, &reader->lexed);
+    return true;
+}
+
+// Returns false once the input file is finished
+static inline bool readStatement(SourceReader* reader, SourceStatement* statement)
+{
+    while (reader->depth > 0)
+    {
+        IncludeFrame* frame = &reader->stack[reader->depth - 1];
+        if (frame->next < frame->file->statementCount)
+        {
+            *statement = frame->file->statements[frame->next++];
+            return true;
+        }
+        reader->depth--;
+    }
+
+    arenaReset(reader->lineArena);
+    while (!lexNextLine(&reader->blockArena, &reader->lexed, statement))
+    {
+        if (!lexNextBlock(reader))
+        {
+            return false;
+        }
+    }
+    reader->lineCount++;
+    return true;
+}
+
+// Where the statement readStatement returned last came from: its file (as given, or canonical for an INCLUDE file)
+// and its line number in that file
+static inline const char* getSourceLocation(const SourceReader* reader, int* line)
+{
+    if (reader->depth > 0)
+    {
+        const IncludeFrame* frame = &reader->stack[reader->depth - 1];
+        *line = frame->next;
+        return frame->file->path;
+    }
+    *line = reader->lineCount;
+    return reader->inputPath;
+}
+
+// Builds directory + name into path, returning whether that file exists (a path too long for size never does)
+static inline bool tryIncludePath(char* path, size_t size, const char* directory, size_t directoryLength, const char* name)
+{
+    struct stat info;
+    int length;
+    if (directoryLength > 0)
+    {
+        length = snprintf(path, size, "%.*s/%s", (int)directoryLength, directory, name);
+    }
+    else
+    {
+        length = snprintf(path, size, "%s", name);
+    }
+    return length < (int)size && stat(path, &info) == 0 && !(info.st_mode & S_IFDIR);
+}
+
+// Finds the file an INCLUDE or INCBIN names, building its path into path. Relative names are looked for next to the
+// including file, then in each -I directory
+static inline bool findIncludedFile(const SourceReader* reader, const char* name, char* path, size_t size)
+{
+    const char* including = reader->depth > 0 ? reader->stack[reader->depth - 1].file->path : reader->inputPath;
+    if (reader->depth == 0 && strcmp(including, "-") == 0)
+    {
+        including = "";
+    }
+    bool found = false;
+    if (name[0] == '/' || name[0] == '\\' || (name[0] != '\0' && name[1] == ':'))
+    {
+        found = tryIncludePath(path, size, NULL, 0, name);
+    }
+    else
+    {
+        const char* slash = strrchr(including, '/');
+        const char* backslash = strrchr(including, '\\');
+        if (backslash != NULL && (slash == NULL || backslash > slash))
+        {
+            slash = backslash;
+        }
+        found = tryIncludePath(path, size, including, slash != NULL ? (size_t)(slash - including) : 0, name);
+        for (int i = 0; !found && i < reader->includeDirCount; i++)
+        {
+            found = tryIncludePath(path, size, reader->includeDirs[i], strlen(reader->includeDirs[i]), name);
+        }
+    }
+    return found;
+}
+
+// Copies the file name at the start of an operand into name, without its quotes if it has them, and returns what
+// follows it. An unquoted name runs up to the first character in stop
+static inline const char* parseIncludeName(const char* OPERAND, char* name, size_t size, const char* stop)
+{
+    const char* closeQuote = (OPERAND[0] == '\'' || OPERAND[0] == '"') ? strchr(OPERAND + 1, OPERAND[0]) : NULL;
+    if (closeQuote != NULL)
+    {
+        snprintf(name, size, "%.*s", (int)(closeQuote - OPERAND - 1), OPERAND + 1);
+        return closeQuote + 1;
+    }
+    size_t nameLength = strcspn(OPERAND, stop);
+    snprintf(name, size, "%.*s", (int)nameLength, OPERAND);
+    return OPERAND + nameLength;
+}
+
+// Opens the file named by an INCLUDE operand so readStatement continues with its statements
+static inline void includeSourceFile(SourceReader* reader, const char* OPERAND, int lineNumber)
+{
+    if (OPERAND == NULL)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: INCLUDE needs a file name\n", lineNumber);
+        exit(EXIT_FAILURE);
+    }
+
+    // The name may be quoted
+    char name[PATH_MAX];
+    parseIncludeName(OPERAND, name, sizeof(name), "");
+
+    char path[PATH_MAX];
+    bool found = findIncludedFile(reader, name, path, sizeof(path));
+    char canonical[PATH_MAX];
+    if (!found || realpath(path, canonical) == NULL)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: INCLUDE file '%s' not found\n", lineNumber, name);
+        exit(EXIT_FAILURE);
+    }
+
+    // A file that is already open further up the chain would include itself forever
+    bool circular = strcmp(canonical, reader->inputCanonical) == 0;
+    for (int i = 0; !circular && i < reader->depth; i++)
+    {
+        circular = strcmp(canonical, reader->stack[i].file->path) == 0;
+    }
+    if (circular)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: Circular INCLUDE of '%s'\n", lineNumber, name);
+        exit(EXIT_FAILURE);
+    }
+    if (reader->depth == MAX_INCLUDE_DEPTH)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: INCLUDE files nested more than %d deep\n", lineNumber, MAX_INCLUDE_DEPTH);
+        exit(EXIT_FAILURE);
+    }
+
+    IncludeFile* file = loadIncludeFile(canonical);
+    if (file == NULL)
+    {
+        perror(canonical);
+        exit(EXIT_FAILURE);
+    }
+    reader->stack[reader->depth].file = file;
+    reader->stack[reader->depth].next = 0;
+    reader->depth++;
+}
+
+//////////////////// Conditional assembly ////////////////////
+
+#define CONDITIONAL_NONE 0
+#define CONDITIONAL_IF 1    // IF, IFDEF or IFNDEF
+#define CONDITIONAL_ELSE 2
+#define CONDITIONAL_ENDIF 3
+
+// Which of the conditional directives the length characters of opcode are
+static inline int conditionalKind(const char* opcode, size_t length)
+{
+    if ((length == 2 && memcmp(opcode, "IF", 2) == 0) || (length == 5 && memcmp(opcode, "IFDEF", 5) == 0)
+        || (length == 6 && memcmp(opcode, "IFNDEF", 6) == 0))
+    {
+        return CONDITIONAL_IF;
+    }
+    if (length == 4 && memcmp(opcode, "ELSE", 4) == 0)
+    {
+        return CONDITIONAL_ELSE;
+    }
+    return length == 5 && memcmp(opcode, "ENDIF", 5) == 0 ? CONDITIONAL_ENDIF : CONDITIONAL_NONE;
+}
+
+// Skips the branch of a conditional that isn't assembled. Only each line's opcode is found, to follow nested
+// conditionals; nothing is lexed. Stops in front of the ELSE or ENDIF that ends the branch, so readStatement returns
+// that next. Returns how many lines were skipped, or -1 if the file ends first (a branch has to end in the file it
+// starts in)
+static inline int skipConditionalBranch(SourceReader* reader)
+{
+    int skipped = 0, depth = 0;
+    if (reader->depth > 0) // An INCLUDE file's statements are already lexed, and only their opcodes are looked at
+    {
+        IncludeFrame* frame = &reader->stack[reader->depth - 1];
+        for (; frame->next < frame->file->statementCount; frame->next++, skipped++)
+        {
+            const char* opcode = frame->file->statements[frame->next].opcode;
+            int kind = opcode != NULL ? conditionalKind(opcode, strlen(opcode)) : CONDITIONAL_NONE;
+            if (depth == 0 && (kind == CONDITIONAL_ELSE || kind == CONDITIONAL_ENDIF))
+            {
+                return skipped;
+            }
+            depth += kind == CONDITIONAL_IF ? 1 : kind == CONDITIONAL_ENDIF ? -1 : 0;
+        }
+        return -1;
+    }
+    for (;;)
+    {
+        size_t start = reader->lexed.position;
+        const char* opcode;
+        size_t length;
+        if (!skipLexedLine(&reader->lexed, &opcode, &length))
+        {
+            if (!lexNextBlock(reader))
+            {
+                return -1;
+            }
+            continue;
+        }
+        int kind = conditionalKind(opcode, length);
+        if (depth == 0 && (kind == CONDITIONAL_ELSE || kind == CONDITIONAL_ENDIF))
+        {
+            reader->lexed.position = start;
+            return skipped;
+        }
+        depth += kind == CONDITIONAL_IF ? 1 : kind == CONDITIONAL_ENDIF ? -1 : 0;
+        skipped++;
+        reader->lineCount++;
+    }
+}
+
+//////////////////// Binary files ////////////////////
+
+// The bytes an INCBIN statement puts in the program: length bytes of the file at path, from offset on
+typedef struct BinaryInclusion
+{
+    const char* path;
+    long offset;
+    long length;
+} BinaryInclusion;
+
+// Reads an INCBIN offset or length: decimal, or hex with a 0x prefix. Returns -1 if it isn't a number
+static inline long parseIncludeNumber(const char* text, const char** end)
+{
+    int base = (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) ? 16 : 10;
+    char* numberEnd = NULL;
+    long value = strtol(base == 16 ? text + 2 : text, &numberEnd, base);
+    if (numberEnd == text || numberEnd == text + (base == 16 ? 2 : 0) || value < 0)
+    {
+        return -1;
+    }
+    *end = numberEnd;
+    return value;
+}
+
+// Resolves an INCBIN operand, file[,offset[,length]], the way INCLUDE finds files. The length defaults to the rest of
+// the file, and the range has to lie within it. The path is kept in arena for pass 2
+static inline void resolveBinaryInclusion(const SourceReader* reader, const char* OPERAND, int lineNumber, Arena* arena, BinaryInclusion* inclusion)
+{
+    if (OPERAND == NULL)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: INCBIN needs a file name\n", lineNumber);
+        exit(EXIT_FAILURE);
+    }
+    char name[PATH_MAX];
+    const char* rest = parseIncludeName(OPERAND, name, sizeof(name), ",");
+    char path[PATH_MAX];
+    struct stat info;
+    if (!findIncludedFile(reader, name, path, sizeof(path)) || stat(path, &info) != 0)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: INCBIN file '%s' not found\n", lineNumber, name);
+        exit(EXIT_FAILURE);
+    }
+
+    long size = (long)info.st_size;
+    long offset = 0, length = -1;
+    if (*rest == ',')
+    {
+        offset = parseIncludeNumber(rest + 1, &rest);
+        if (offset >= 0 && *rest == ',')
+        {
+            length = parseIncludeNumber(rest + 1, &rest);
+            if (length < 0)
+            {
+                offset = -1;
+            }
+        }
+    }
+    if (offset < 0 || *rest != '\0')
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: Invalid INCBIN operand %s\n", lineNumber, OPERAND);
+        exit(EXIT_FAILURE);
+    }
+    if (length < 0)
+    {
+        length = offset <= size ? size - offset : 0;
+    }
+    if (offset > size || length > size - offset)
+    {
+        fprintf(stderr, "Error: Pass 1, Line %d: INCBIN range %ld+%ld is past the end of '%s' (%ld bytes)\n", lineNumber, offset, length, name, size);
+        exit(EXIT_FAILURE);
+    }
+    inclusion->path = arenaStrdup(arena, path);
+    inclusion->offset = offset;
+    inclusion->length = length;
+}
+
+#endif
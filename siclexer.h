@@ -0,0 +1,390 @@
+// Pass 1's lexer: source lines split into label, opcode and operand.
+// lexSourceBlock gives the fields of a whole block of lines at once, exactly as splitting each line with splitField
+// would (sicbench keeps that one-line-at-a-time version, tokenizeSourceLine, as its reference). It first classifies the block 64 bytes at a time into bitmaps of newlines, delimiters
+// (space and newline) and quotes, using SSE2, or AVX2 where the processor has it (checked once, at run time), and
+// scalar code elsewhere. Each line's fields are then found by scanning those bitmaps for set and clear bits, so no
+// byte is examined twice. The fields are cut out in place by writing NULs into the block, as strtok would.
+// Lines can also be stepped over with only their opcode found (skipLexedLine), for conditional assembly
+#ifndef SICLEXER_H
+#define SICLEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "siccompat.h"
+#include "sicarena.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEXER_SSE2 1
+#include <emmintrin.h>
+#else
+#define LEXER_SSE2 0
+#endif
+// The AVX2 classifier is compiled for AVX2 on its own, so the rest of the program still runs on any x86-64
+#if LEXER_SSE2 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEXER_AVX2 1
+#include <immintrin.h>
+#else
+#define LEXER_AVX2 0
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// One source line split the way pass 1 sees it
+typedef struct SourceStatement
+{
+    char* comment; // The whole line (newline included) if it is a comment, otherwise NULL
+    char* label;   // NULL if the line has no label
+    char* opcode;
+    char* operand;
+} SourceStatement;
+
+// strtok_s, except that a quoted part of a token (the text of C'..' and X'..') is never split, so character constants
+// may contain spaces. A quote with no closing one on the line splits as usual
+static inline char* splitField(char* text, const char* delimiters, char** context)
+{
+    char* start = text != NULL ? text : *context;
+    if (start == NULL)
+    {
+        return NULL;
+    }
+    start += strspn(start, delimiters);
+    if (*start == '\0')
+    {
+        *context = start;
+        return NULL;
+    }
+    char* end = start;
+    while (*end != '\0' && strchr(delimiters, *end) == NULL)
+    {
+        if (*end == '\'')
+        {
+            char* close = strpbrk(end + 1, "'\n");
+            if (close != NULL && *close == '\'')
+            {
+                end = close;
+            }
+        }
+        end++;
+    }
+    if (*end != '\0')
+    {
+        *end++ = '\0';
+    }
+    *context = end;
+    return start;
+}
+
+//////////////////// Block lexer ////////////////////
+
+// Bit i of word i / 64 stands for byte i of the block
+typedef struct LexerMasks
+{
+    uint64_t* newlines;
+    uint64_t* delimiters; // Space or newline, what splitField splits on
+    uint64_t* quotes;
+} LexerMasks;
+
+static inline int lexerTrailingZeros(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+static inline void classifyScalar(const char* text, size_t from, size_t length, LexerMasks* masks)
+{
+    for (size_t i = from; i < length; i++)
+    {
+        uint64_t bit = 1ull << (i & 63);
+        char c = text[i];
+        if (c == '\n')
+        {
+            masks->newlines[i >> 6] |= bit;
+        }
+        if (c == '\n' || c == ' ')
+        {
+            masks->delimiters[i >> 6] |= bit;
+        }
+        if (c == '\'')
+        {
+            masks->quotes[i >> 6] |= bit;
+        }
+    }
+}
+
+#if LEXER_SSE2
+// The bytes of 16 equal to c, as the low 16 bits
+static inline uint64_t matchBytes128(__m128i bytes, char c)
+{
+    return (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+}
+
+// Returns how many bytes it classified, a multiple of 64
+static inline size_t classifySse2(const char* text, size_t length, LexerMasks* masks)
+{
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        uint64_t newlines = 0, spaces = 0, quotes = 0;
+        for (int part = 0; part < 4; part++)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(text + i + 16 * part));
+            newlines |= matchBytes128(bytes, '\n') << (16 * part);
+            spaces |= matchBytes128(bytes, ' ') << (16 * part);
+            quotes |= matchBytes128(bytes, '\'') << (16 * part);
+        }
+        masks->newlines[i >> 6] = newlines;
+        masks->delimiters[i >> 6] = newlines | spaces;
+        masks->quotes[i >> 6] = quotes;
+    }
+    return i;
+}
+#endif
+
+#if LEXER_AVX2
+__attribute__((target("avx2"))) static uint64_t matchBytes256(__m256i low, __m256i high, char c)
+{
+    __m256i match = _mm256_set1_epi8(c);
+    uint64_t lowBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, match));
+    uint64_t highBits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, match));
+    return lowBits | highBits << 32;
+}
+
+__attribute__((target("avx2"))) static size_t classifyAvx2(const char* text, size_t length, LexerMasks* masks)
+{
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i high = _mm256_loadu_si256((const __m256i*)(text + i + 32));
+        uint64_t newlines = matchBytes256(low, high, '\n');
+        masks->newlines[i >> 6] = newlines;
+        masks->delimiters[i >> 6] = newlines | matchBytes256(low, high, ' ');
+        masks->quotes[i >> 6] = matchBytes256(low, high, '\'');
+    }
+    return i;
+}
+
+static inline bool lexerHasAvx2(void)
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported == 1;
+}
+#endif
+
+// Fills in the masks (allocated from arena) for the length bytes of text
+static inline void classifySourceBlock(Arena* arena, const char* text, size_t length, LexerMasks* masks)
+{
+    size_t words = length / 64 + 1;
+    masks->newlines = arenaAlloc(arena, 3 * words * sizeof(uint64_t));
+    masks->delimiters = masks->newlines + words;
+    masks->quotes = masks->delimiters + words;
+    memset(masks->newlines, 0, 3 * words * sizeof(uint64_t));
+    size_t done = 0;
+#if LEXER_AVX2
+    if (lexerHasAvx2())
+    {
+        done = classifyAvx2(text, length, masks);
+    }
+#endif
+#if LEXER_SSE2
+    if (done == 0)
+    {
+        done = classifySse2(text, length, masks);
+    }
+#endif
+    classifyScalar(text, done, length, masks); // The last partial 64 bytes, or everything without SSE2
+}
+
+// The first position in [from, limit) whose bit is set (or clear, with flip all ones), or limit if there is none
+static inline size_t nextLexerBit(const uint64_t* mask, size_t from, size_t limit, uint64_t flip)
+{
+    while (from < limit)
+    {
+        uint64_t bits = (mask[from >> 6] ^ flip) >> (from & 63);
+        if (bits != 0)
+        {
+            size_t found = from + (size_t)lexerTrailingZeros(bits);
+            return found < limit ? found : limit;
+        }
+        from = (from | 63) + 1;
+    }
+    return limit;
+}
+
+// splitField over [*position, end), where end is the line's newline or the end of the text. Returns the field,
+// NUL terminated in place, or NULL when the line has no more (including once *position is past end)
+static inline char* nextLexedField(char* text, const LexerMasks* masks, size_t* position, size_t end)
+{
+    size_t start = nextLexerBit(masks->delimiters, *position, end, ~0ull);
+    if (start >= end)
+    {
+        *position = end + 1;
+        return NULL;
+    }
+    size_t scan = start, stop;
+    for (;;)
+    {
+        stop = nextLexerBit(masks->delimiters, scan, end, 0);
+        size_t quote = nextLexerBit(masks->quotes, scan, stop, 0);
+        if (quote == stop)
+        {
+            break;
+        }
+        // A quote closed before the end of the line takes everything up to the closing quote into the field
+        size_t close = nextLexerBit(masks->quotes, quote + 1, end, 0);
+        scan = close < end ? close + 1 : quote + 1;
+    }
+    text[stop] = '\0';
+    *position = stop + 1;
+    return text + start;
+}
+
+// A block of lines classified up front and split into fields a line at a time, so lines that are only stepped over
+// (a conditional's false branch) are never split
+typedef struct LexedBlock
+{
+    char* text;
+    size_t length;
+    bool final;        // The last line counts even without a newline
+    LexerMasks masks;
+    size_t position;   // Where the next line starts
+} LexedBlock;
+
+// Classifies the length bytes of text (with room for a NUL after them), using arena for the masks
+static inline void beginLexedBlock(Arena* arena, char* text, size_t length, bool final, LexedBlock* block)
+{
+    block->text = text;
+    block->length = length;
+    block->final = final;
+    block->position = 0;
+    classifySourceBlock(arena, text, length, &block->masks);
+}
+
+// Finds where the next line ends: its newline, or the end of the text. Returns false if there is no whole line left
+static inline bool findLexedLine(const LexedBlock* block, size_t* newline)
+{
+    if (block->position >= block->length)
+    {
+        return false;
+    }
+    *newline = nextLexerBit(block->masks.newlines, block->position, block->length, 0);
+    return *newline < block->length || block->final;
+}
+
+// Splits the next line into statement, returning false if there is no whole line left. Comments are copied into arena;
+// the other fields point into the block's text, which is modified
+static inline bool lexNextLine(Arena* arena, LexedBlock* block, SourceStatement* statement)
+{
+    size_t newline;
+    if (!findLexedLine(block, &newline))
+    {
+        return false;
+    }
+    char* text = block->text;
+    size_t start = block->position;
+    size_t next = newline < block->length ? newline + 1 : block->length;
+
+    // Sources saved with Windows line endings assemble the same everywhere: a carriage return before the last
+    // character becomes the newline, and that last character is dropped
+    size_t end = newline;
+    if (next - start >= 2 && text[next - 2] == '\r')
+    {
+        end = next - 2;
+        text[end] = '\n';
+    }
+    bool hasNewline = end < block->length && text[end] == '\n';
+
+    statement->comment = NULL;
+    statement->label = NULL;
+    if (text[start] == '.')
+    {
+        statement->comment = arenaStrndup(arena, text + start, end - start + (hasNewline ? 1 : 0));
+        statement->opcode = statement->operand = NULL;
+    }
+    else
+    {
+        size_t position = start;
+        if (text[start] != ' ')
+        {
+            statement->label = nextLexedField(text, &block->masks, &position, end);
+        }
+        statement->opcode = nextLexedField(text, &block->masks, &position, end);
+        statement->operand = nextLexedField(text, &block->masks, &position, end);
+    }
+    block->position = next;
+    return true;
+}
+
+// Steps over the next line without splitting it, pointing opcode at its opcode field (length 0 for a comment or a line
+// without one). Only the bitmaps are scanned and the text isn't modified. Returns false if there is no whole line left
+static inline bool skipLexedLine(LexedBlock* block, const char** opcode, size_t* length)
+{
+    size_t newline;
+    if (!findLexedLine(block, &newline))
+    {
+        return false;
+    }
+    const char* text = block->text;
+    size_t start = block->position;
+    size_t end = newline > start && text[newline - 1] == '\r' ? newline - 1 : newline;
+    block->position = newline < block->length ? newline + 1 : block->length;
+
+    *opcode = text + start;
+    *length = 0;
+    if (start == end || text[start] == '.')
+    {
+        return true;
+    }
+    size_t field = start;
+    if (text[start] != ' ') // Past the label
+    {
+        field = nextLexerBit(block->masks.delimiters, start, end, 0);
+    }
+    field = nextLexerBit(block->masks.delimiters, field, end, ~0ull);
+    *opcode = text + field;
+    *length = nextLexerBit(block->masks.delimiters, field, end, 0) - field;
+    return true;
+}
+
+// Lexes the lines of text (length bytes, with room for a NUL after them) into statements allocated from arena,
+// returning how many there are. Comments are copied into arena; the other fields point into text, which is modified.
+// Unless final is set, a last line without a newline is left alone, and *consumed says where it starts
+static inline int lexSourceBlock(Arena* arena, char* text, size_t length, bool final, SourceStatement** statements, size_t* consumed)
+{
+    LexedBlock block;
+    beginLexedBlock(arena, text, length, final, &block);
+    size_t lineCount = final ? 1 : 0;
+    for (size_t i = 0; i < length / 64 + 1; i++)
+    {
+#if defined(_MSC_VER)
+        lineCount += (size_t)__popcnt64(block.masks.newlines[i]);
+#else
+        lineCount += (size_t)__builtin_popcountll(block.masks.newlines[i]);
+#endif
+    }
+    SourceStatement* lines = arenaAlloc(arena, (lineCount > 0 ? lineCount : 1) * sizeof(SourceStatement));
+
+    int count = 0;
+    while (lexNextLine(arena, &block, &lines[count]))
+    {
+        count++;
+    }
+    *statements = lines;
+    *consumed = block.position;
+    return count;
+}
+
+#endif
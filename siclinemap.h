@@ -0,0 +1,324 @@
+// Address-to-source line maps (--linemap): for every statement that produces code, its address range, the source file and
+// line it came from, and the label it falls under. Sorted by address and meant to be mapped, so a simulator can turn a
+// faulting address into a source line with a binary search and no parsing.
+// Layout, all integers little-endian 32 bit:
+//   0             header: "SICLMAP" and a NUL, entryCount, fileCount, entryOffset, fileOffset, stringOffset, stringSize
+//   entryOffset   entryCount entries {address, length, file, line, label}, in address order
+//   fileOffset    fileCount string offsets, the source file names (file in an entry indexes this table)
+//   stringOffset  NUL-terminated names. label is an offset into them, or LINEMAP_NO_LABEL
+#ifndef SICLINEMAP_H
+#define SICLINEMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#include "sicarena.h"
+#include "sicmapfile.h"
+
+#define LINEMAP_MAGIC "SICLMAP"
+#define LINEMAP_HEADER_SIZE 32
+#define LINEMAP_ENTRY_SIZE 20
+#define LINEMAP_NO_LABEL 0xFFFFFFFFu
+
+//////////////////// Writing ////////////////////
+
+// Where one statement came from, by statement number (pass 1 line number / 5)
+typedef struct LineMapSource
+{
+    int file;
+    int line;
+} LineMapSource;
+
+typedef struct LineMapEntry
+{
+    int address;
+    int length;
+    int statement;
+    const char* label; // Entries under the same label share the pointer, so the name is stored once per run of them
+} LineMapEntry;
+
+// Pass 1 records each statement's source, pass 2 each statement's code, and writeLineMap joins the two
+typedef struct LineMapBuilder
+{
+    Arena* arena;
+    const char** files;
+    int fileCount;
+    int fileCapacity;
+    LineMapSource* sources;
+    int sourceCapacity;
+    LineMapEntry* entries;
+    int entryCount;
+    int entryCapacity;
+} LineMapBuilder;
+
+static inline void resetLineMap(LineMapBuilder* builder, Arena* arena)
+{
+    memset(builder, 0, sizeof(*builder));
+    builder->arena = arena;
+}
+
+// Makes room for index in an arena array, doubling it so growth stays linear overall
+static inline void* growLineMapArray(Arena* arena, void* items, int count, int* capacity, int index, size_t itemSize)
+{
+    if (index < *capacity)
+    {
+        return items;
+    }
+    int grown = *capacity ? *capacity : 256;
+    while (grown <= index)
+    {
+        grown *= 2;
+    }
+    void* copy = arenaAlloc(arena, grown * itemSize);
+    memset(copy, 0, grown * itemSize);
+    if (count > 0)
+    {
+        memcpy(copy, items, count * itemSize);
+    }
+    *capacity = grown;
+    return copy;
+}
+
+// Records that statement number statement is line line of the file at path. Paths are compared by pointer first,
+// since every statement of a file passes the same one
+static inline void recordLineSource(LineMapBuilder* builder, int statement, const char* path, int line)
+{
+    int file = builder->fileCount - 1;
+    while (file >= 0 && builder->files[file] != path && strcmp(builder->files[file], path) != 0)
+    {
+        file--;
+    }
+    if (file < 0)
+    {
+        builder->files = growLineMapArray(builder->arena, builder->files, builder->fileCount, &builder->fileCapacity, builder->fileCount, sizeof(const char*));
+        file = builder->fileCount++;
+        builder->files[file] = arenaStrdup(builder->arena, path);
+    }
+    builder->sources = growLineMapArray(builder->arena, builder->sources, builder->sourceCapacity, &builder->sourceCapacity, statement, sizeof(LineMapSource));
+    builder->sources[statement].file = file;
+    builder->sources[statement].line = line;
+}
+
+// Records length bytes of code at address, produced by statement number statement under label (NULL if none yet)
+static inline void addLineMapEntry(LineMapBuilder* builder, int address, int length, int statement, const char* label)
+{
+    builder->entries = growLineMapArray(builder->arena, builder->entries, builder->entryCount, &builder->entryCapacity, builder->entryCount, sizeof(LineMapEntry));
+    LineMapEntry* entry = &builder->entries[builder->entryCount++];
+    entry->address = address;
+    entry->length = length;
+    entry->statement = statement;
+    entry->label = label;
+}
+
+static inline int compareLineMapEntries(const void* a, const void* b)
+{
+    const LineMapEntry* x = a, * y = b;
+    return (x->address > y->address) - (x->address < y->address);
+}
+
+// Lays out the string table: the file names, then each label once per run of entries sharing it. Writes it to
+// LineMapFile and fills in labelOffsets, where those aren't NULL, and returns its size
+static inline unsigned int layoutLineMapStrings(LineMapBuilder* builder, unsigned int* labelOffsets, FILE* LineMapFile)
+{
+    unsigned int size = 0;
+    for (int i = 0; i < builder->fileCount; i++)
+    {
+        if (LineMapFile != NULL)
+        {
+            fwrite(builder->files[i], 1, strlen(builder->files[i]) + 1, LineMapFile);
+        }
+        size += (unsigned int)strlen(builder->files[i]) + 1;
+    }
+    const char* previous = NULL;
+    unsigned int previousOffset = LINEMAP_NO_LABEL;
+    for (int i = 0; i < builder->entryCount; i++)
+    {
+        const char* label = builder->entries[i].label;
+        if (label != NULL && label != previous)
+        {
+            if (LineMapFile != NULL)
+            {
+                fwrite(label, 1, strlen(label) + 1, LineMapFile);
+            }
+            previousOffset = size;
+            size += (unsigned int)strlen(label) + 1;
+        }
+        previous = label;
+        if (labelOffsets != NULL)
+        {
+            labelOffsets[i] = label != NULL ? previousOffset : LINEMAP_NO_LABEL;
+        }
+    }
+    return size;
+}
+
+static inline void writeLineMap(LineMapBuilder* builder, const char* path)
+{
+    FILE* LineMapFile = fopen(path, "wb");
+    if (LineMapFile == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    // Pass 2 goes in address order, so this only sorts if something (like program blocks) moved code around
+    for (int i = 1; i < builder->entryCount; i++)
+    {
+        if (builder->entries[i].address < builder->entries[i - 1].address)
+        {
+            qsort(builder->entries, builder->entryCount, sizeof(LineMapEntry), compareLineMapEntries);
+            break;
+        }
+    }
+
+    unsigned int* labelOffsets = arenaAlloc(builder->arena, (builder->entryCount > 0 ? builder->entryCount : 1) * sizeof(unsigned int));
+    unsigned int stringSize = layoutLineMapStrings(builder, labelOffsets, NULL);
+    unsigned int entryOffset = LINEMAP_HEADER_SIZE;
+    unsigned int fileOffset = entryOffset + builder->entryCount * LINEMAP_ENTRY_SIZE;
+    unsigned int stringOffset = fileOffset + builder->fileCount * 4;
+
+    unsigned char header[LINEMAP_HEADER_SIZE] = { 0 };
+    memcpy(header, LINEMAP_MAGIC, sizeof(LINEMAP_MAGIC));
+    putFileWord(header + 8, (unsigned int)builder->entryCount);
+    putFileWord(header + 12, (unsigned int)builder->fileCount);
+    putFileWord(header + 16, entryOffset);
+    putFileWord(header + 20, fileOffset);
+    putFileWord(header + 24, stringOffset);
+    putFileWord(header + 28, stringSize);
+    fwrite(header, 1, sizeof(header), LineMapFile);
+
+    for (int i = 0; i < builder->entryCount; i++)
+    {
+        const LineMapEntry* entry = &builder->entries[i];
+        LineMapSource source = { 0, 0 };
+        if (entry->statement >= 0 && entry->statement < builder->sourceCapacity)
+        {
+            source = builder->sources[entry->statement];
+        }
+        unsigned char bytes[LINEMAP_ENTRY_SIZE];
+        putFileWord(bytes, (unsigned int)entry->address);
+        putFileWord(bytes + 4, (unsigned int)entry->length);
+        putFileWord(bytes + 8, (unsigned int)source.file);
+        putFileWord(bytes + 12, (unsigned int)source.line);
+        putFileWord(bytes + 16, labelOffsets[i]);
+        fwrite(bytes, 1, sizeof(bytes), LineMapFile);
+    }
+    unsigned int nameOffset = 0;
+    for (int i = 0; i < builder->fileCount; i++)
+    {
+        unsigned char bytes[4];
+        putFileWord(bytes, nameOffset);
+        fwrite(bytes, 1, sizeof(bytes), LineMapFile);
+        nameOffset += (unsigned int)strlen(builder->files[i]) + 1;
+    }
+    layoutLineMapStrings(builder, NULL, LineMapFile);
+    fclose(LineMapFile);
+}
+
+//////////////////// Reading ////////////////////
+
+typedef struct LineMap
+{
+    MappedFile file;
+    const unsigned char* entries;
+    int entryCount;
+    const unsigned char* files;
+    int fileCount;
+    const char* strings;
+    unsigned int stringSize;
+} LineMap;
+
+// What an address maps back to
+typedef struct LineMapLocation
+{
+    int address; // Start of the statement containing the address
+    int length;
+    const char* file;
+    int line;
+    const char* label; // NULL if no label comes before it
+} LineMapLocation;
+
+static inline void closeLineMap(LineMap* map)
+{
+    unmapFile(&map->file);
+    memset(map, 0, sizeof(*map));
+}
+
+static inline bool openLineMap(const char* path, LineMap* map)
+{
+    memset(map, 0, sizeof(*map));
+    if (!mapFile(path, &map->file))
+    {
+        return false;
+    }
+    const unsigned char* header = map->file.data;
+    if (map->file.size < LINEMAP_HEADER_SIZE || memcmp(header, LINEMAP_MAGIC, sizeof(LINEMAP_MAGIC)) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a line map\n", path);
+        closeLineMap(map);
+        return false;
+    }
+    map->entryCount = (int)getFileWord(header + 8);
+    map->fileCount = (int)getFileWord(header + 12);
+    size_t entryOffset = getFileWord(header + 16);
+    size_t fileOffset = getFileWord(header + 20);
+    size_t stringOffset = getFileWord(header + 24);
+    map->stringSize = getFileWord(header + 28);
+    if (entryOffset + (size_t)map->entryCount * LINEMAP_ENTRY_SIZE > map->file.size || fileOffset + (size_t)map->fileCount * 4 > map->file.size
+        || stringOffset + map->stringSize > map->file.size || (map->stringSize > 0 && map->file.data[stringOffset + map->stringSize - 1] != '\0'))
+    {
+        fprintf(stderr, "Error: Line map %s is truncated\n", path);
+        closeLineMap(map);
+        return false;
+    }
+    map->entries = map->file.data + entryOffset;
+    map->files = map->file.data + fileOffset;
+    map->strings = (const char*)map->file.data + stringOffset;
+    return true;
+}
+
+static inline const char* getLineMapString(const LineMap* map, unsigned int offset)
+{
+    return offset < map->stringSize ? map->strings + offset : NULL;
+}
+
+// Finds the statement whose code covers address, by binary search. Returns false for addresses no statement produced
+// (reserved space, or outside the program)
+static inline bool lookupLineMap(const LineMap* map, int address, LineMapLocation* location)
+{
+    // The last entry starting at or before address is the only one that can contain it
+    int low = 0, high = map->entryCount - 1, found = -1;
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        if ((int)getFileWord(map->entries + (size_t)middle * LINEMAP_ENTRY_SIZE) <= address)
+        {
+            found = middle;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    if (found < 0)
+    {
+        return false;
+    }
+    const unsigned char* entry = map->entries + (size_t)found * LINEMAP_ENTRY_SIZE;
+    location->address = (int)getFileWord(entry);
+    location->length = (int)getFileWord(entry + 4);
+    if (address >= location->address + location->length)
+    {
+        return false;
+    }
+    unsigned int file = getFileWord(entry + 8);
+    location->file = file < (unsigned int)map->fileCount ? getLineMapString(map, getFileWord(map->files + 4 * file)) : NULL;
+    location->line = (int)getFileWord(entry + 12);
+    location->label = getLineMapString(map, getFileWord(entry + 16));
+    return true;
+}
+
+#endif
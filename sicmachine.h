@@ -0,0 +1,397 @@
+// A SIC/XE machine that runs a loaded program, for tools that need to watch one run (sicprof). It decodes straight from
+// memory each step: the whole instruction set, all addressing modes (SIC's own 15-bit format included), the 48-bit
+// floating point format and the registers' 24-bit arithmetic. RD reads bytes from one input file and WD writes to one
+// output file, whatever the device, and TD always finds the device ready.
+// Every executed instruction counts one at its address, and every memory operand one read or write at its target, in
+// 64-bit counters indexed by address, so the counts stay exact over billions of instructions.
+// A run stops when the program returns to whoever started it (to the L it started with), jumps to itself
+// (the usual HALT J HALT), reaches a privileged instruction or one it can't run, or uses up its instruction limit.
+#ifndef SICMACHINE_H
+#define SICMACHINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#define MACHINE_MEMORY_SIZE (1 << 20) // SIC/XE's 20-bit address space
+#define MACHINE_ADDRESS_MASK (MACHINE_MEMORY_SIZE - 1)
+#define MACHINE_RETURN_ADDRESS (-1)   // The L a program starts with, so its final RSUB can be told apart
+
+// Why a run stopped
+#define MACHINE_RETURNED 0     // Went to MACHINE_RETURN_ADDRESS
+#define MACHINE_HALTED 1       // Jumped to the instruction itself
+#define MACHINE_LIMIT 2        // Ran the number of instructions it was allowed
+#define MACHINE_PRIVILEGED 3   // SIO, HIO, TIO, LPS, SSK, STI or SVC
+#define MACHINE_INVALID 4      // Not an instruction, or outside what the program loaded
+#define MACHINE_DIVIDE 5       // Division by zero
+static const char* MACHINE_STOP_NAMES[] = { "returned", "halted", "instruction limit reached", "privileged instruction",
+    "invalid instruction", "division by zero" };
+
+// Registers in format 2's numbering
+#define REGISTER_A 0
+#define REGISTER_X 1
+#define REGISTER_L 2
+#define REGISTER_B 3
+#define REGISTER_S 4
+#define REGISTER_T 5
+#define REGISTER_F 6
+#define REGISTER_PC 8
+#define REGISTER_SW 9
+
+typedef struct Machine
+{
+    unsigned char* memory;       // MACHINE_MEMORY_SIZE bytes
+    unsigned char* loaded;       // 1 for every byte the program loaded; anything else can't be run
+    int registers[10];           // 24-bit values, sign extended; F is kept in f instead
+    double f;
+    int conditionCode;           // Result of the last comparison: negative, zero or positive (CC <, = and >)
+    FILE* input;                 // RD reads from it (bytes past its end read as 0), NULL to always read 0
+    FILE* output;                // WD writes to it, NULL to discard
+    unsigned long long executed;
+    unsigned long long* executions; // Per address, MACHINE_MEMORY_SIZE of each
+    unsigned long long* reads;
+    unsigned long long* writes;
+    int stopAddress;             // The instruction the run stopped at (for MACHINE_LIMIT, the one it would have run next)
+} Machine;
+
+// Clears the machine and gives it its memory and counters. Returns false if they can't be allocated
+static inline bool initMachine(Machine* machine)
+{
+    memset(machine, 0, sizeof(*machine));
+    machine->memory = calloc(MACHINE_MEMORY_SIZE, 1);
+    machine->loaded = calloc(MACHINE_MEMORY_SIZE, 1);
+    machine->executions = calloc(MACHINE_MEMORY_SIZE, sizeof(unsigned long long));
+    machine->reads = calloc(MACHINE_MEMORY_SIZE, sizeof(unsigned long long));
+    machine->writes = calloc(MACHINE_MEMORY_SIZE, sizeof(unsigned long long));
+    machine->registers[REGISTER_L] = MACHINE_RETURN_ADDRESS;
+    return machine->memory != NULL && machine->loaded != NULL && machine->executions != NULL && machine->reads != NULL
+        && machine->writes != NULL;
+}
+
+static inline void freeMachine(Machine* machine)
+{
+    free(machine->memory);
+    free(machine->loaded);
+    free(machine->executions);
+    free(machine->reads);
+    free(machine->writes);
+    memset(machine, 0, sizeof(*machine));
+}
+
+// Copies length bytes to address, marking them (where loaded isn't NULL, only those loaded[i] marks) as the program
+static inline void loadMachine(Machine* machine, int address, const unsigned char* bytes, const unsigned char* loaded, int length)
+{
+    for (int i = 0; i < length && address + i < MACHINE_MEMORY_SIZE; i++)
+    {
+        machine->memory[address + i] = bytes[i];
+        machine->loaded[address + i] = loaded != NULL ? loaded[i] : 1;
+    }
+}
+
+// Keeps the low 24 bits, sign extended
+static inline int wrapWord(long long value)
+{
+    return (int)(((value & 0xFFFFFF) ^ 0x800000) - 0x800000);
+}
+
+static inline int readMachineWord(const Machine* machine, int address)
+{
+    const unsigned char* memory = machine->memory;
+    return wrapWord((memory[address] << 16) | (memory[(address + 1) & MACHINE_ADDRESS_MASK] << 8) | memory[(address + 2) & MACHINE_ADDRESS_MASK]);
+}
+
+static inline void writeMachineWord(Machine* machine, int address, int value)
+{
+    machine->memory[address] = (unsigned char)(value >> 16);
+    machine->memory[(address + 1) & MACHINE_ADDRESS_MASK] = (unsigned char)(value >> 8);
+    machine->memory[(address + 2) & MACHINE_ADDRESS_MASK] = (unsigned char)value;
+}
+
+// The 48-bit floating point format: a sign bit, an 11-bit exponent biased by 1024 and a 36-bit fraction, where the
+// value is fraction * 2^(exponent - 1024) and a nonzero fraction has its top bit set
+static inline double readMachineFloat(const Machine* machine, int address)
+{
+    unsigned long long bits = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        bits = (bits << 8) | machine->memory[(address + i) & MACHINE_ADDRESS_MASK];
+    }
+    double fraction = (double)(bits & 0xFFFFFFFFFull) / 68719476736.0; // 2^36
+    double value = ldexp(fraction, (int)((bits >> 36) & 0x7FF) - 1024);
+    return (bits >> 47) ? -value : value;
+}
+
+static inline void writeMachineFloat(Machine* machine, int address, double value)
+{
+    unsigned long long bits = 0;
+    if (value != 0)
+    {
+        int exponent;
+        double fraction = frexp(fabs(value), &exponent);
+        unsigned long long digits = (unsigned long long)(fraction * 68719476736.0);
+        bits = (value < 0 ? 1ull << 47 : 0) | ((unsigned long long)((exponent + 1024) & 0x7FF) << 36) | (digits & 0xFFFFFFFFFull);
+    }
+    for (int i = 5; i >= 0; i--, bits >>= 8)
+    {
+        machine->memory[(address + i) & MACHINE_ADDRESS_MASK] = (unsigned char)bits;
+    }
+}
+
+static inline int compareValues(long long left, long long right)
+{
+    return (left > right) - (left < right);
+}
+
+// Runs from address until something stops it, at most limit instructions (0 for no limit). Returns a MACHINE_ stop
+static inline int runMachine(Machine* machine, int address, unsigned long long limit)
+{
+    unsigned char* memory = machine->memory;
+    int* r = machine->registers;
+    int PC = address & MACHINE_ADDRESS_MASK;
+    int at = PC;
+    unsigned long long executed = machine->executed;
+    unsigned long long end = limit > 0 ? executed + limit : ~0ull;
+    int stop = MACHINE_LIMIT;
+
+    while (executed < end)
+    {
+        at = PC;
+        if (!machine->loaded[at])
+        {
+            // Returning to whoever started the program lands on the address L started with, wherever it came from
+            // (RSUB, or a J through the word the program saved L in)
+            stop = at == (MACHINE_RETURN_ADDRESS & MACHINE_ADDRESS_MASK) ? MACHINE_RETURNED : MACHINE_INVALID;
+            break;
+        }
+        machine->executions[at]++;
+        executed++;
+        int first = memory[at];
+        int opcode = first & 0xFC;
+
+        // Formats 1 and 2 have opcodes of their own, none of which a format 3/4 opcode shares
+        if (opcode >= 0x90 && opcode <= 0xB8)
+        {
+            int r1 = memory[(at + 1) & MACHINE_ADDRESS_MASK] >> 4, r2 = memory[(at + 1) & MACHINE_ADDRESS_MASK] & 0xF;
+            PC = (at + 2) & MACHINE_ADDRESS_MASK;
+            if (r1 > REGISTER_SW || r2 > REGISTER_SW)
+            {
+                stop = MACHINE_INVALID;
+                break;
+            }
+            switch (opcode)
+            {
+            case 0x90: r[r2] = wrapWord((long long)r[r2] + r[r1]); break;  // ADDR
+            case 0x94: r[r2] = wrapWord((long long)r[r2] - r[r1]); break;  // SUBR
+            case 0x98: r[r2] = wrapWord((long long)r[r2] * r[r1]); break;  // MULR
+            case 0x9C:                                                      // DIVR
+                if (r[r1] == 0)
+                {
+                    stop = MACHINE_DIVIDE;
+                    goto stopped;
+                }
+                r[r2] = wrapWord(r[r2] / r[r1]);
+                break;
+            case 0xA0: machine->conditionCode = compareValues(r[r1], r[r2]); break; // COMPR
+            case 0xA4:                                                      // SHIFTL, circular
+            {
+                unsigned int value = (unsigned int)r[r1] & 0xFFFFFF;
+                int count = (r2 + 1) % 24;
+                r[r1] = wrapWord(((value << count) | (value >> ((24 - count) % 24))) & 0xFFFFFF);
+                break;
+            }
+            case 0xA8: r[r1] = r[r1] >> (r2 + 1); break;                   // SHIFTR, keeping the sign
+            case 0xAC: r[r2] = r[r1]; break;                                // RMO
+            case 0xB0: stop = MACHINE_PRIVILEGED; goto stopped;             // SVC
+            case 0xB4: r[r1] = 0; break;                                    // CLEAR
+            case 0xB8:                                                      // TIXR
+                r[REGISTER_X] = wrapWord((long long)r[REGISTER_X] + 1);
+                machine->conditionCode = compareValues(r[REGISTER_X], r[r1]);
+                break;
+            default: stop = MACHINE_INVALID; goto stopped;
+            }
+            continue;
+        }
+        if ((opcode >= 0xC0 && opcode <= 0xC8) || opcode >= 0xF0)
+        {
+            PC = (at + 1) & MACHINE_ADDRESS_MASK;
+            switch (opcode)
+            {
+            case 0xC0: machine->f = r[REGISTER_A]; break;                  // FLOAT
+            case 0xC4: r[REGISTER_A] = wrapWord((long long)machine->f); break; // FIX
+            case 0xC8: break;                                               // NORM: values are always normalized here
+            default: stop = MACHINE_PRIVILEGED; goto stopped;               // SIO, HIO, TIO
+            }
+            continue;
+        }
+
+        // Format 3/4: work out the target address
+        int second = memory[(at + 1) & MACHINE_ADDRESS_MASK], third = memory[(at + 2) & MACHINE_ADDRESS_MASK];
+        int ni = first & 3;
+        int target;
+        if (ni == 0) // SIC's format: a 15-bit address
+        {
+            PC = (at + 3) & MACHINE_ADDRESS_MASK;
+            target = ((second & 0x7F) << 8) | third;
+        }
+        else if (second & 0x10) // Format 4: a 20-bit address
+        {
+            PC = (at + 4) & MACHINE_ADDRESS_MASK;
+            target = ((second & 0xF) << 16) | (third << 8) | memory[(at + 3) & MACHINE_ADDRESS_MASK];
+        }
+        else
+        {
+            PC = (at + 3) & MACHINE_ADDRESS_MASK;
+            target = ((second & 0xF) << 8) | third;
+            if (second & 0x20) // PC-relative, a signed 12-bit displacement
+            {
+                target = PC + ((target ^ 0x800) - 0x800);
+            }
+            else if (second & 0x40)
+            {
+                target += r[REGISTER_B];
+            }
+        }
+        if (second & 0x80)
+        {
+            target += r[REGISTER_X];
+        }
+        target &= MACHINE_ADDRESS_MASK;
+        if (ni == 2) // Indirect: the target holds the address
+        {
+            machine->reads[target]++;
+            target = readMachineWord(machine, target) & MACHINE_ADDRESS_MASK;
+        }
+
+        // The operand's value, for the instructions that use one: the target itself when immediate
+        int value = 0;
+        bool immediate = ni == 1;
+        switch (opcode)
+        {
+        case 0x0C: case 0x78: case 0x54: case 0x80: case 0xD4: case 0x14: case 0x7C: case 0xE8: case 0x84: case 0x10:
+        case 0x3C: case 0x30: case 0x34: case 0x38: case 0x48: case 0x4C: case 0xD0: case 0xEC:
+            break; // Stores, jumps and the system instructions use the address
+        case 0x50: case 0xD8: case 0xDC: case 0xE0: // LDCH, and the I/O instructions' device numbers, are a byte
+            if (!immediate)
+            {
+                machine->reads[target]++;
+            }
+            value = immediate ? target & 0xFF : memory[target];
+            break;
+        case 0x58: case 0x5C: case 0x60: case 0x64: case 0x70: case 0x88: // Floating point operands are 6 bytes
+            break;
+        default:
+            if (!immediate)
+            {
+                machine->reads[target]++;
+            }
+            value = immediate ? target : readMachineWord(machine, target);
+            break;
+        }
+
+        switch (opcode)
+        {
+        case 0x00: r[REGISTER_A] = value; break;                            // LDA
+        case 0x04: r[REGISTER_X] = value; break;                            // LDX
+        case 0x08: r[REGISTER_L] = value; break;                            // LDL
+        case 0x68: r[REGISTER_B] = value; break;                            // LDB
+        case 0x6C: r[REGISTER_S] = value; break;                            // LDS
+        case 0x74: r[REGISTER_T] = value; break;                            // LDT
+        case 0x50: r[REGISTER_A] = wrapWord((r[REGISTER_A] & ~0xFF) | value); break; // LDCH
+        case 0x18: r[REGISTER_A] = wrapWord((long long)r[REGISTER_A] + value); break; // ADD
+        case 0x1C: r[REGISTER_A] = wrapWord((long long)r[REGISTER_A] - value); break; // SUB
+        case 0x20: r[REGISTER_A] = wrapWord((long long)r[REGISTER_A] * value); break; // MUL
+        case 0x24:                                                          // DIV
+            if (value == 0)
+            {
+                stop = MACHINE_DIVIDE;
+                goto stopped;
+            }
+            r[REGISTER_A] = wrapWord(r[REGISTER_A] / value);
+            break;
+        case 0x40: r[REGISTER_A] &= value; break;                           // AND
+        case 0x44: r[REGISTER_A] = wrapWord(r[REGISTER_A] | value); break;  // OR
+        case 0x28: machine->conditionCode = compareValues(r[REGISTER_A], value); break; // COMP
+        case 0x2C:                                                          // TIX
+            r[REGISTER_X] = wrapWord((long long)r[REGISTER_X] + 1);
+            machine->conditionCode = compareValues(r[REGISTER_X], value);
+            break;
+
+        case 0x0C: machine->writes[target]++; writeMachineWord(machine, target, r[REGISTER_A]); break; // STA
+        case 0x10: machine->writes[target]++; writeMachineWord(machine, target, r[REGISTER_X]); break; // STX
+        case 0x14: machine->writes[target]++; writeMachineWord(machine, target, r[REGISTER_L]); break; // STL
+        case 0x78: machine->writes[target]++; writeMachineWord(machine, target, r[REGISTER_B]); break; // STB
+        case 0x7C: machine->writes[target]++; writeMachineWord(machine, target, r[REGISTER_S]); break; // STS
+        case 0x84: machine->writes[target]++; writeMachineWord(machine, target, r[REGISTER_T]); break; // STT
+        case 0xE8: machine->writes[target]++; writeMachineWord(machine, target, machine->conditionCode); break; // STSW
+        case 0x54: machine->writes[target]++; memory[target] = (unsigned char)r[REGISTER_A]; break; // STCH
+
+        case 0x3C:                                                          // J
+            if (target == at)
+            {
+                stop = MACHINE_HALTED;
+                goto stopped;
+            }
+            PC = target;
+            break;
+        case 0x30: PC = machine->conditionCode == 0 ? target : PC; break;   // JEQ
+        case 0x34: PC = machine->conditionCode > 0 ? target : PC; break;    // JGT
+        case 0x38: PC = machine->conditionCode < 0 ? target : PC; break;    // JLT
+        case 0x48: r[REGISTER_L] = PC; PC = target; break;                  // JSUB
+        case 0x4C: PC = r[REGISTER_L] & MACHINE_ADDRESS_MASK; break;       // RSUB
+
+        case 0xE0: machine->conditionCode = -1; break;                      // TD: always ready
+        case 0xD8:                                                          // RD
+        {
+            int c = machine->input != NULL ? fgetc(machine->input) : EOF;
+            r[REGISTER_A] = wrapWord((r[REGISTER_A] & ~0xFF) | (c != EOF ? c : 0));
+            break;
+        }
+        case 0xDC:                                                          // WD
+            if (machine->output != NULL)
+            {
+                fputc(r[REGISTER_A] & 0xFF, machine->output);
+            }
+            break;
+
+        case 0x70: machine->reads[target]++; machine->f = readMachineFloat(machine, target); break; // LDF
+        case 0x80: machine->writes[target]++; writeMachineFloat(machine, target, machine->f); break; // STF
+        case 0x58: machine->reads[target]++; machine->f += readMachineFloat(machine, target); break; // ADDF
+        case 0x5C: machine->reads[target]++; machine->f -= readMachineFloat(machine, target); break; // SUBF
+        case 0x60: machine->reads[target]++; machine->f *= readMachineFloat(machine, target); break; // MULF
+        case 0x64:                                                          // DIVF
+        {
+            machine->reads[target]++;
+            double divisor = readMachineFloat(machine, target);
+            if (divisor == 0)
+            {
+                stop = MACHINE_DIVIDE;
+                goto stopped;
+            }
+            machine->f /= divisor;
+            break;
+        }
+        case 0x88:                                                          // COMPF
+        {
+            machine->reads[target]++;
+            double operand = readMachineFloat(machine, target);
+            machine->conditionCode = (machine->f > operand) - (machine->f < operand);
+            break;
+        }
+
+        case 0xD0: case 0xD4: case 0xEC: stop = MACHINE_PRIVILEGED; goto stopped; // LPS, STI, SSK
+        default: stop = MACHINE_INVALID; goto stopped;
+        }
+    }
+    machine->executed = executed;
+    machine->stopAddress = PC; // The instruction the limit kept from running, or the one that wasn't loaded
+    return stop;
+
+stopped:
+    machine->executed = executed;
+    machine->stopAddress = at;
+    return stop;
+}
+
+#endif
@@ -0,0 +1,101 @@
+// Read-only file mappings for the binary outputs (memory images, line maps) that tools read back without parsing
+#ifndef SICMAPFILE_H
+#define SICMAPFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+typedef struct MappedFile
+{
+    unsigned char* data; // The whole file, mapped (or read, where mmap isn't available)
+    size_t size;
+} MappedFile;
+
+// The binary files store their integers little-endian, 32 bits wide
+static inline void putFileWord(unsigned char* bytes, unsigned int value)
+{
+    bytes[0] = (unsigned char)value;
+    bytes[1] = (unsigned char)(value >> 8);
+    bytes[2] = (unsigned char)(value >> 16);
+    bytes[3] = (unsigned char)(value >> 24);
+}
+
+static inline unsigned int getFileWord(const unsigned char* bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+static inline void unmapFile(MappedFile* file)
+{
+#ifdef _WIN32
+    free(file->data);
+#else
+    if (file->data != NULL)
+    {
+        munmap(file->data, file->size);
+    }
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Maps the file at path. Pages are only read when touched, so a lookup in a large file reads a few pages of it
+static inline bool mapFile(const char* path, MappedFile* file)
+{
+    file->data = NULL;
+    file->size = 0;
+#ifdef _WIN32
+    FILE* MappedInput = fopen(path, "rb");
+    if (MappedInput == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    fseek(MappedInput, 0, SEEK_END);
+    file->size = (size_t)ftell(MappedInput);
+    fseek(MappedInput, 0, SEEK_SET);
+    file->data = malloc(file->size > 0 ? file->size : 1);
+    if (file->data == NULL || fread(file->data, 1, file->size, MappedInput) != file->size)
+    {
+        fclose(MappedInput);
+        unmapFile(file);
+        fprintf(stderr, "Error: Could not read %s\n", path);
+        return false;
+    }
+    fclose(MappedInput);
+#else
+    int descriptor = open(path, O_RDONLY);
+    struct stat info;
+    if (descriptor < 0 || fstat(descriptor, &info) != 0)
+    {
+        perror(path);
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+        }
+        return false;
+    }
+    file->size = (size_t)info.st_size;
+    void* mapping = file->size > 0 ? mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    close(descriptor);
+    if (mapping == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Could not map %s\n", path);
+        file->size = 0;
+        return false;
+    }
+    file->data = mapping;
+#endif
+    return true;
+}
+
+#endif
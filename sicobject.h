@@ -0,0 +1,302 @@
+// Reads an object file (H, T and E records as written by the assemblers) back into a memory image
+#ifndef SICOBJECT_H
+#define SICOBJECT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// An M record: the field at offset (from the start of the program) holds an address, halfBytes long, ending on a byte boundary
+typedef struct ObjectModification
+{
+    int offset;
+    int halfBytes;
+} ObjectModification;
+
+// A loaded program: memory[0] holds the byte at startAddress, and loaded[i] is 1 for every byte a T record supplied
+typedef struct ObjectImage
+{
+    char name[7];
+    int startAddress;
+    int length;
+    int entryAddress;
+    unsigned char* memory;
+    unsigned char* loaded;
+    int capacity;
+    ObjectModification* modifications;
+    int modificationCount;
+    int modificationCapacity;
+} ObjectImage;
+
+// Maps an ASCII character to its hex digit value, or -1 if it isn't one
+static signed char hexDigitValue[256];
+
+static inline void initHexDigitValues(void)
+{
+    static bool initialized = false;
+    if (initialized)
+    {
+        return;
+    }
+    memset(hexDigitValue, -1, sizeof(hexDigitValue));
+    for (int i = 0; i < 10; i++)
+    {
+        hexDigitValue['0' + i] = (signed char)i;
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        hexDigitValue['A' + i] = (signed char)(10 + i);
+        hexDigitValue['a' + i] = (signed char)(10 + i);
+    }
+    initialized = true;
+}
+
+// Parses count hex digits starting at text, returning -1 if any of them isn't a hex digit
+static inline int parseHexField(const char* text, int count)
+{
+    int value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int digit = hexDigitValue[(unsigned char)text[i]];
+        if (digit < 0)
+        {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+// Makes sure the image can hold the byte at offset, growing it if a T record runs past the H record length
+static inline bool reserveObjectImage(ObjectImage* image, int end)
+{
+    if (end <= image->capacity)
+    {
+        return true;
+    }
+    int capacity = image->capacity ? image->capacity : 4096;
+    while (capacity < end)
+    {
+        capacity *= 2;
+    }
+    unsigned char* memory = realloc(image->memory, capacity);
+    unsigned char* loaded = realloc(image->loaded, capacity);
+    if (memory == NULL || loaded == NULL)
+    {
+        image->memory = memory ? memory : image->memory;
+        image->loaded = loaded ? loaded : image->loaded;
+        return false;
+    }
+    memset(memory + image->capacity, 0, capacity - image->capacity);
+    memset(loaded + image->capacity, 0, capacity - image->capacity);
+    image->memory = memory;
+    image->loaded = loaded;
+    image->capacity = capacity;
+    return true;
+}
+
+static inline void freeObjectImage(ObjectImage* image)
+{
+    free(image->memory);
+    free(image->loaded);
+    free(image->modifications);
+    memset(image, 0, sizeof(*image));
+}
+
+// Parses the text of an object file. Lines may end in \n or \r\n, and the H record's name may be padded or tab terminated
+static inline bool parseObjectText(const char* text, size_t size, ObjectImage* image)
+{
+    initHexDigitValues();
+    memset(image, 0, sizeof(*image));
+    const char* end = text + size;
+    int lineNumber = 0;
+    bool sawHeader = false;
+
+    for (const char* line = text; line < end;)
+    {
+        const char* newline = memchr(line, '\n', end - line);
+        const char* lineEnd = newline ? newline : end;
+        const char* next = newline ? newline + 1 : end;
+        while (lineEnd > line && (lineEnd[-1] == '\r' || lineEnd[-1] == ' ' || lineEnd[-1] == '\t'))
+        {
+            lineEnd--;
+        }
+        size_t length = lineEnd - line;
+        lineNumber++;
+
+        if (length == 0)
+        {
+            line = next;
+            continue;
+        }
+        if (line[0] == 'H')
+        {
+            // The last 12 characters are the starting address and the program length, everything before them is the name
+            if (length < 13)
+            {
+                printf("Error: Object line %d: Header record too short\n", lineNumber);
+                return false;
+            }
+            size_t nameLength = length - 13;
+            const char* name = line + 1;
+            while (nameLength > 0 && (name[nameLength - 1] == ' ' || name[nameLength - 1] == '\t'))
+            {
+                nameLength--;
+            }
+            if (nameLength > 6)
+            {
+                nameLength = 6;
+            }
+            memcpy(image->name, name, nameLength);
+            image->name[nameLength] = '\0';
+            image->startAddress = parseHexField(lineEnd - 12, 6);
+            image->length = parseHexField(lineEnd - 6, 6);
+            if (image->startAddress < 0 || image->length < 0 || !reserveObjectImage(image, image->length))
+            {
+                printf("Error: Object line %d: Invalid header record\n", lineNumber);
+                return false;
+            }
+            sawHeader = true;
+        }
+        else if (line[0] == 'T')
+        {
+            int address = length >= 9 ? parseHexField(line + 1, 6) : -1;
+            int count = length >= 9 ? parseHexField(line + 7, 2) : -1;
+            if (!sawHeader || address < image->startAddress || count < 0 || length < 9 + (size_t)count * 2)
+            {
+                printf("Error: Object line %d: Invalid text record\n", lineNumber);
+                return false;
+            }
+            int offset = address - image->startAddress;
+            if (!reserveObjectImage(image, offset + count))
+            {
+                printf("Error: Object line %d: Out of memory\n", lineNumber);
+                return false;
+            }
+            const unsigned char* hex = (const unsigned char*)line + 9;
+            unsigned char* destination = image->memory + offset;
+            for (int i = 0; i < count; i++)
+            {
+                int high = hexDigitValue[hex[2 * i]], low = hexDigitValue[hex[2 * i + 1]];
+                if ((high | low) < 0)
+                {
+                    printf("Error: Object line %d: Invalid hex digit in text record\n", lineNumber);
+                    return false;
+                }
+                destination[i] = (unsigned char)((high << 4) | low);
+            }
+            memset(image->loaded + offset, 1, count);
+            if (offset + count > image->length)
+            {
+                image->length = offset + count;
+            }
+        }
+        else if (line[0] == 'M')
+        {
+            // M, the field's offset (6 hex digits) and its length in half-bytes (2). Anything after that (+NAME) is ignored
+            int offset = length >= 9 ? parseHexField(line + 1, 6) : -1;
+            int halfBytes = length >= 9 ? parseHexField(line + 7, 2) : -1;
+            if (!sawHeader || offset < 0 || halfBytes < 1 || halfBytes > 8)
+            {
+                printf("Error: Object line %d: Invalid modification record\n", lineNumber);
+                return false;
+            }
+            if (image->modificationCount == image->modificationCapacity)
+            {
+                int capacity = image->modificationCapacity ? image->modificationCapacity * 2 : 64;
+                ObjectModification* grown = realloc(image->modifications, capacity * sizeof(ObjectModification));
+                if (grown == NULL)
+                {
+                    printf("Error: Object line %d: Out of memory\n", lineNumber);
+                    return false;
+                }
+                image->modifications = grown;
+                image->modificationCapacity = capacity;
+            }
+            image->modifications[image->modificationCount].offset = offset;
+            image->modifications[image->modificationCount].halfBytes = halfBytes;
+            image->modificationCount++;
+        }
+        else if (line[0] == 'E')
+        {
+            image->entryAddress = length >= 7 ? parseHexField(line + 1, 6) : image->startAddress;
+        }
+        line = next;
+    }
+
+    if (!sawHeader)
+    {
+        printf("Error: Object file has no header record\n");
+        return false;
+    }
+    return true;
+}
+
+// Moves a loaded image to loadAddress by adding the difference to every field an M record names, in one pass over them.
+// Only the field's own bits change, so the flag half-byte in front of a format 4 address is left alone
+static inline bool relocateObjectImage(ObjectImage* image, int loadAddress)
+{
+    unsigned int delta = (unsigned int)(loadAddress - image->startAddress);
+    for (int i = 0; i < image->modificationCount; i++)
+    {
+        int offset = image->modifications[i].offset;
+        int halfBytes = image->modifications[i].halfBytes;
+        int byteCount = (halfBytes + 1) / 2;
+        if (offset + byteCount > image->length)
+        {
+            printf("Error: Modification record %d is outside the program\n", i + 1);
+            return false;
+        }
+        unsigned char* field = image->memory + offset;
+        unsigned long long value = 0;
+        for (int b = 0; b < byteCount; b++)
+        {
+            value = (value << 8) | field[b];
+        }
+        unsigned long long mask = (1ull << (4 * halfBytes)) - 1;
+        value = (value & ~mask) | ((value + delta) & mask);
+        for (int b = byteCount - 1; b >= 0; b--)
+        {
+            field[b] = (unsigned char)value;
+            value >>= 8;
+        }
+    }
+    image->entryAddress += loadAddress - image->startAddress;
+    image->startAddress = loadAddress;
+    return true;
+}
+
+// Reads a whole object file in one go and parses it into image
+static inline bool readObjectFile(const char* path, ObjectImage* image)
+{
+    FILE* ObjectFile = fopen(path, "rb");
+    if (ObjectFile == NULL)
+    {
+        perror("Error opening object file");
+        return false;
+    }
+    fseek(ObjectFile, 0, SEEK_END);
+    long size = ftell(ObjectFile);
+    fseek(ObjectFile, 0, SEEK_SET);
+    char* text = malloc(size > 0 ? size : 1);
+    if (text == NULL || fread(text, 1, size, ObjectFile) != (size_t)size)
+    {
+        printf("Error: Could not read object file %s\n", path);
+        free(text);
+        fclose(ObjectFile);
+        return false;
+    }
+    fclose(ObjectFile);
+    bool ok = parseObjectText(text, size, image);
+    free(text);
+    return ok;
+}
+
+// Reads an object file and places it at loadAddress, wherever it was assembled to start
+static inline bool loadObjectFileAt(const char* path, int loadAddress, ObjectImage* image)
+{
+    return readObjectFile(path, image) && relocateObjectImage(image, loadAddress);
+}
+
+#endif
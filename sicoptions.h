@@ -0,0 +1,483 @@
+// Command line options and output streams shared by both assemblers
+#ifndef SICOPTIONS_H
+#define SICOPTIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+
+#define MAX_INCLUDE_DIRS 32
+#define MAX_DEFINES 64
+
+// The peephole rewrites (SIC/XE), each one bit of AssemblerOptions.peephole, named as on the command line
+#define PEEPHOLE_THREAD 0   // A jump to a J goes straight to where that J goes
+#define PEEPHOLE_JUMP_NEXT 1 // A jump to the statement right after it is dropped
+#define PEEPHOLE_LOAD 2     // A load of what the register already holds is dropped
+#define PEEPHOLE_STORE 3    // A store of what the memory already holds is dropped
+#define PEEPHOLE_TIXR 4     // TIX m becomes TIXR r when a register holds m
+#define PEEPHOLE_COMPR 5    // COMP m becomes COMPR A,r when a register holds m
+#define PEEPHOLE_RULES 6
+#define PEEPHOLE_ALL ((1u << PEEPHOLE_RULES) - 1)
+static const char* PEEPHOLE_NAMES[PEEPHOLE_RULES] = { "thread", "jumpnext", "load", "store", "tixr", "compr" };
+
+// Where each output goes. NULL means the output is not produced, "-" means standard output
+typedef struct AssemblerOptions
+{
+    const char* inputPath;        // "-" reads the source from standard input
+    const char* objectPath;
+    const char* listingPath;
+    const char* intermediatePath; // NULL keeps the intermediate file in memory
+    bool stream;                  // Object records to standard output, nothing else unless asked for
+    bool pipeline;                // Read, assemble and write on separate threads
+    bool external;                // Spill pass 1's statements to temporary files, so memory doesn't grow with the source
+    bool crossReference;          // Append a cross-reference section to the listing
+    const char* crossReferencePath; // Also write the cross-reference, with an index, to this file (NULL if not wanted)
+    const char* imagePath;        // Flat binary memory image (NULL if not wanted)
+    const char* lineMapPath;      // Binary address-to-source line map (NULL if not wanted)
+    const char* symbolsPath;      // Binary symbol index, by name and by address (NULL if not wanted)
+    const char* statsPath;        // Encoding report as text, and as JSON (SIC/XE only, NULL if not wanted)
+    const char* statsJsonPath;
+    unsigned int peephole;        // Bits (1 << PEEPHOLE_...) of the rewrites to run between the passes, 0 for none
+    bool noCache;                 // Always assemble, without looking in or adding to the result cache
+    bool cacheStats;              // Print the result cache's statistics
+
+    // Every source file named on the command line. Each is made current in turn by selectInput
+    char** inputPaths;
+    int inputCount;
+    const char* includeDirs[MAX_INCLUDE_DIRS]; // -I directories searched for INCLUDE files
+    int includeDirCount;
+    const char* defines[MAX_DEFINES]; // -D NAME or NAME=value, for IF and IFDEF
+    int defineCount;
+
+    // The output paths as given on the command line, NULL where the default is used
+    const char* objectOption;
+    const char* listingOption;
+    const char* intermediateOption;
+} AssemblerOptions;
+
+static inline void printUsage(const char* program)
+{
+    printf("\nUsage: %s <file_name | -> [more files...] [-o <object_file>] [--listing <file>] [--intermediate <file>] [--stream] [--pipeline] [--external] [-I <dir>] [-D <name>[=value]] [--xref] [--xref-file <file>] [--image <file>] [--linemap <file>] [--symbols <file>] [--stats <file>] [--stats-json <file>] [-O] [--peephole <rules>] [--no-cache] [--cache-stats]\n", program);
+    printf("  -             read the source from standard input\n");
+    printf("  -o, --listing, --intermediate\n");
+    printf("                write that output to the given path ('-' for standard output, /dev/null to skip it)\n");
+    printf("  --stream      write the object records to standard output and keep the intermediate file in memory;\n");
+    printf("                the listing and intermediate file are only written if a path is given\n");
+    printf("  --pipeline    read the source, assemble and write the outputs on separate threads, so I/O overlaps assembly\n");
+    printf("  --external    keep memory use bounded for sources of any size: pass 1 writes fixed-width statement records\n");
+    printf("                to temporary files instead of the intermediate file, and only the symbol table stays in memory\n");
+    printf("  -I <dir>      search dir for INCLUDE files (after the including file's own directory)\n");
+    printf("  -D <name>[=value]\n");
+    printf("                define name as a number (1 if not given) for IF, IFDEF and IFNDEF, as if by EQU\n");
+    printf("  --xref        end the listing with a cross-reference: each symbol's defining line and every line using it\n");
+    printf("  --xref-file   write the cross-reference to its own file, with an index of symbol offsets at the top\n");
+    printf("  --image       write a binary memory image (header + the program at its addresses) for loaders to mmap;\n");
+    printf("                RESB/RESW areas are left as holes in the file\n");
+    printf("  --linemap     write a binary address -> (file, line, label) map, sorted for lookup by sicaddr2line\n");
+    printf("  --symbols     write the symbol table as a binary index for tools to mmap: hashed by name, sorted by address\n");
+    printf("  --stats, --stats-json\n");
+    printf("                SIC/XE: report instruction formats, addressing modes and format 4 targets, as text or JSON\n");
+    printf("  -O            SIC/XE: run every peephole rewrite between the passes, and report what each one did\n");
+    printf("  --peephole    SIC/XE: choose the rewrites, comma separated: thread, jumpnext, load, store, tixr, compr,\n");
+    printf("                all, none, or no-<rule> to turn one off (-O --peephole no-thread)\n");
+    printf("  --no-cache    assemble even if the result cache has this input's outputs, and don't add them to it\n");
+    printf("  --cache-stats print the result cache's hits, misses and size ($SICASM_CACHE_DIR, default ~/.cache/sicasm)\n");
+    printf("  Several files are assembled one after another, each writing <name>_object.txt etc.,\n");
+    printf("  and INCLUDE files they share are only read and tokenized once\n");
+}
+
+// "/dev/null" (or NUL on Windows) means the output isn't wanted at all, so it is never formatted
+static inline const char* normalizeOutputPath(const char* path)
+{
+    if (path != NULL && (strcmp(path, "/dev/null") == 0 || strcmp(path, "NUL") == 0))
+    {
+        return NULL;
+    }
+    return path;
+}
+
+// A batch can only send an output to a single path if that path can take all of them
+static inline bool isSharedOutputPath(const char* path)
+{
+    return path == NULL || normalizeOutputPath(path) == NULL || strcmp(path, "-") == 0;
+}
+
+// Turns the rewrites a --peephole list names on or off in rules. Returns false if one isn't known
+static inline bool parsePeepholeRules(const char* list, unsigned int* rules)
+{
+    while (*list != '\0')
+    {
+        size_t length = strcspn(list, ",");
+        bool on = true;
+        const char* name = list;
+        if (length > 3 && strncmp(name, "no-", 3) == 0)
+        {
+            on = false;
+            name += 3;
+        }
+        size_t nameLength = length - (name - list);
+        unsigned int bits = 0;
+        if (nameLength == 3 && strncmp(name, "all", 3) == 0)
+        {
+            bits = PEEPHOLE_ALL;
+        }
+        else if (nameLength == 4 && strncmp(name, "none", 4) == 0)
+        {
+            bits = PEEPHOLE_ALL;
+            on = !on;
+        }
+        for (int i = 0; i < PEEPHOLE_RULES && bits == 0; i++)
+        {
+            if (strlen(PEEPHOLE_NAMES[i]) == nameLength && strncmp(name, PEEPHOLE_NAMES[i], nameLength) == 0)
+            {
+                bits = 1u << i;
+            }
+        }
+        if (bits == 0)
+        {
+            fprintf(stderr, "Error: Unknown peephole rule '%.*s'\n", (int)length, list);
+            return false;
+        }
+        *rules = on ? *rules | bits : *rules & ~bits;
+        list += length;
+        if (*list == ',')
+        {
+            list++;
+        }
+    }
+    return true;
+}
+
+// Parses argv into options. The paths for each input are filled in later by selectInput
+static inline bool parseArguments(int argc, char* argv[], AssemblerOptions* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->inputPaths = malloc(argc * sizeof(char*));
+    if (options->inputPaths == NULL)
+    {
+        return false;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "-o") == 0 && hasValue)
+        {
+            options->objectOption = argv[++i];
+        }
+        else if (strcmp(arg, "--listing") == 0 && hasValue)
+        {
+            options->listingOption = argv[++i];
+        }
+        else if (strcmp(arg, "--intermediate") == 0 && hasValue)
+        {
+            options->intermediateOption = argv[++i];
+        }
+        else if (strcmp(arg, "--stream") == 0)
+        {
+            options->stream = true;
+        }
+        else if (strcmp(arg, "--pipeline") == 0)
+        {
+            options->pipeline = true;
+        }
+        else if (strcmp(arg, "--external") == 0)
+        {
+            options->external = true;
+        }
+        else if (strcmp(arg, "--xref") == 0)
+        {
+            options->crossReference = true;
+        }
+        else if (strcmp(arg, "--xref-file") == 0 && hasValue)
+        {
+            options->crossReferencePath = normalizeOutputPath(argv[++i]);
+        }
+        else if (strcmp(arg, "--image") == 0 && hasValue)
+        {
+            options->imagePath = normalizeOutputPath(argv[++i]);
+        }
+        else if (strcmp(arg, "--linemap") == 0 && hasValue)
+        {
+            options->lineMapPath = normalizeOutputPath(argv[++i]);
+        }
+        else if (strcmp(arg, "--symbols") == 0 && hasValue)
+        {
+            options->symbolsPath = normalizeOutputPath(argv[++i]);
+        }
+        else if (strcmp(arg, "--stats") == 0 && hasValue)
+        {
+            options->statsPath = normalizeOutputPath(argv[++i]);
+        }
+        else if (strcmp(arg, "--stats-json") == 0 && hasValue)
+        {
+            options->statsJsonPath = normalizeOutputPath(argv[++i]);
+        }
+        else if (strcmp(arg, "-O") == 0)
+        {
+            options->peephole = PEEPHOLE_ALL;
+        }
+        else if (strcmp(arg, "--peephole") == 0 && hasValue)
+        {
+            if (!parsePeepholeRules(argv[++i], &options->peephole))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--no-cache") == 0)
+        {
+            options->noCache = true;
+        }
+        else if (strcmp(arg, "--cache-stats") == 0)
+        {
+            options->cacheStats = true;
+        }
+        else if (strncmp(arg, "-I", 2) == 0 && (arg[2] != '\0' || hasValue) && options->includeDirCount < MAX_INCLUDE_DIRS)
+        {
+            options->includeDirs[options->includeDirCount++] = arg[2] != '\0' ? arg + 2 : argv[++i];
+        }
+        else if (strncmp(arg, "-D", 2) == 0 && (arg[2] != '\0' || hasValue))
+        {
+            const char* define = arg[2] != '\0' ? arg + 2 : argv[++i];
+            size_t nameLength = strcspn(define, "=");
+            char* end = NULL;
+            if (define[nameLength] == '=')
+            {
+                strtol(define + nameLength + 1, &end, 10);
+            }
+            if (nameLength == 0 || (end != NULL && (end == define + nameLength + 1 || *end != '\0')) || options->defineCount == MAX_DEFINES)
+            {
+                fprintf(stderr, "Error: Invalid define -D %s (a name, optionally =number; at most %d of them)\n", define, MAX_DEFINES);
+                return false;
+            }
+            options->defines[options->defineCount++] = define;
+        }
+        else if (arg[0] != '-' || strcmp(arg, "-") == 0)
+        {
+            options->inputPaths[options->inputCount++] = argv[i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (options->inputCount == 0 && !options->cacheStats)
+    {
+        printUsage(argv[0]);
+        return false;
+    }
+
+    if (options->intermediateOption != NULL && strcmp(options->intermediateOption, "-") == 0)
+    {
+        fprintf(stderr, "Error: The intermediate file is read back by pass 2, so it can't go to standard output\n");
+        return false;
+    }
+    if (options->external && normalizeOutputPath(options->intermediateOption) != NULL)
+    {
+        fprintf(stderr, "Error: --external writes statement records instead of the intermediate file, so --intermediate can't be given\n");
+        return false;
+    }
+    if (options->external && (options->crossReference || options->crossReferencePath != NULL || options->lineMapPath != NULL || options->peephole != 0))
+    {
+        fprintf(stderr, "Error: --xref, --xref-file, --linemap and -O keep something for every statement, so they can't be used with --external\n");
+        return false;
+    }
+    if (options->crossReferencePath != NULL && (strcmp(options->crossReferencePath, "-") == 0 || options->inputCount > 1))
+    {
+        fprintf(stderr, "Error: The cross-reference file is written with an index, so it needs a single input and a real file\n");
+        return false;
+    }
+    if (options->imagePath != NULL && (strcmp(options->imagePath, "-") == 0 || options->inputCount > 1))
+    {
+        fprintf(stderr, "Error: The memory image is written out of order, so it needs a single input and a real file\n");
+        return false;
+    }
+    if (options->lineMapPath != NULL && (strcmp(options->lineMapPath, "-") == 0 || options->inputCount > 1))
+    {
+        fprintf(stderr, "Error: The line map is a binary file for mapping, so it needs a single input and a real file\n");
+        return false;
+    }
+    if (options->symbolsPath != NULL && (strcmp(options->symbolsPath, "-") == 0 || options->inputCount > 1))
+    {
+        fprintf(stderr, "Error: The symbol index is a binary file for mapping, so it needs a single input and a real file\n");
+        return false;
+    }
+    if (options->inputCount > 1 && (!isSharedOutputPath(options->statsPath) || !isSharedOutputPath(options->statsJsonPath)))
+    {
+        fprintf(stderr, "Error: With several input files, reports can only go to standard output ('-')\n");
+        return false;
+    }
+    if (options->inputCount > 1 && (!isSharedOutputPath(options->objectOption) || !isSharedOutputPath(options->listingOption) || !isSharedOutputPath(options->intermediateOption)))
+    {
+        fprintf(stderr, "Error: With several input files, outputs are named after each input (only '-' or /dev/null can be given)\n");
+        return false;
+    }
+    return true;
+}
+
+// Makes input number index the current one and fills in its output paths. A single input writes prefix_object.txt etc.
+// as before; in a batch each input writes <name>_object.txt etc., named after the input file without its extension
+static inline void selectInput(AssemblerOptions* options, int index, const char* prefix)
+{
+    // Room for the longest stem plus the longest suffix, so no name is ever cut short
+    static char defaultObject[PATH_MAX + 32], defaultListing[PATH_MAX + 32], defaultIntermediate[PATH_MAX + 32];
+    char stem[PATH_MAX];
+    options->inputPath = options->inputPaths[index];
+
+    if (options->inputCount > 1 && strcmp(options->inputPath, "-") != 0)
+    {
+        const char* name = options->inputPath;
+        for (const char* c = name; *c; c++)
+        {
+            if (*c == '/' || *c == '\\')
+            {
+                name = c + 1;
+            }
+        }
+        const char* dot = strrchr(name, '.');
+        snprintf(stem, sizeof(stem), "%.*s", (int)(dot != NULL && dot != name ? dot - name : (int)strlen(name)), name);
+    }
+    else
+    {
+        strcpy_s(stem, sizeof(stem), prefix);
+    }
+    snprintf(defaultObject, sizeof(defaultObject), "%s_object.txt", stem);
+    snprintf(defaultListing, sizeof(defaultListing), "%s_listing.txt", stem);
+    snprintf(defaultIntermediate, sizeof(defaultIntermediate), "%s_intermediate.txt", stem);
+
+    options->objectPath = options->objectOption;
+    options->listingPath = options->listingOption;
+    options->intermediatePath = options->intermediateOption;
+    if (options->objectPath == NULL)
+    {
+        options->objectPath = options->stream ? "-" : defaultObject;
+    }
+    if (options->listingPath == NULL && !options->stream)
+    {
+        options->listingPath = defaultListing;
+    }
+    if (options->intermediatePath == NULL && !options->stream && !options->external)
+    {
+        options->intermediatePath = defaultIntermediate;
+    }
+    options->objectPath = normalizeOutputPath(options->objectPath);
+    options->listingPath = normalizeOutputPath(options->listingPath);
+    options->intermediatePath = normalizeOutputPath(options->intermediatePath);
+}
+
+// Status messages go to standard error whenever standard output is carrying an output file
+static inline FILE* messageStream(const AssemblerOptions* options)
+{
+    bool objectToStdout = options->objectPath != NULL && strcmp(options->objectPath, "-") == 0;
+    bool listingToStdout = options->listingPath != NULL && strcmp(options->listingPath, "-") == 0;
+    return (objectToStdout || listingToStdout) ? stderr : stdout;
+}
+
+static inline FILE* openInput(const char* path)
+{
+    return strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+}
+
+// Opens an output for writing, or returns NULL without error if it isn't being produced
+static inline FILE* openOutput(const char* path)
+{
+    if (path == NULL)
+    {
+        return NULL;
+    }
+    if (strcmp(path, "-") == 0)
+    {
+        return stdout;
+    }
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return file;
+}
+
+static inline void closeStream(FILE* file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    if (file == stdout)
+    {
+        fflush(stdout);
+    }
+    else if (file != stdin)
+    {
+        fclose(file);
+    }
+}
+
+// An intermediate file that isn't kept lives in memory, so streaming mode never touches the disk
+#if defined(_MSC_VER) || defined(__MINGW32__)
+// No memory streams here, so fall back to an anonymous temporary file
+static inline FILE* openScratchStream(void)
+{
+    return tmpfile();
+}
+
+static inline FILE* reopenScratchForReading(FILE* file)
+{
+    rewind(file);
+    return file;
+}
+#else
+static char* scratchBuffer = NULL;
+static size_t scratchSize = 0;
+
+static inline FILE* openScratchStream(void)
+{
+    free(scratchBuffer);
+    scratchBuffer = NULL;
+    scratchSize = 0;
+    return open_memstream(&scratchBuffer, &scratchSize);
+}
+
+// Finishes writing the memory stream and opens what was written for reading
+static inline FILE* reopenScratchForReading(FILE* file)
+{
+    fclose(file);
+    return fmemopen(scratchBuffer, scratchSize > 0 ? scratchSize : 1, "r");
+}
+#endif
+
+// Opens the intermediate file for pass 1 to write: the named file if it is being kept, otherwise a scratch stream
+static inline FILE* openIntermediate(const AssemblerOptions* options)
+{
+    FILE* file = options->intermediatePath != NULL ? fopen(options->intermediatePath, "w") : openScratchStream();
+    if (file == NULL)
+    {
+        perror("Error opening intermediate file");
+        exit(EXIT_FAILURE);
+    }
+    return file;
+}
+
+// Closes the intermediate file after pass 1 and opens it again for pass 2 to read
+static inline FILE* reopenIntermediate(const AssemblerOptions* options, FILE* file)
+{
+    if (options->intermediatePath == NULL)
+    {
+        return reopenScratchForReading(file);
+    }
+    fclose(file);
+    FILE* reopened = NULL;
+    if (fopen_s(&reopened, options->intermediatePath, "r") != 0)
+    {
+        perror("Error opening intermediate file");
+        exit(EXIT_FAILURE);
+    }
+    return reopened;
+}
+
+#endif
@@ -0,0 +1,742 @@
+// SIC/XE peephole optimizer (-O, --peephole): rewrites the statements pass 1 wrote to the intermediate file before pass 2
+// encodes them, lays the shrunken code out again and moves the symbols with it. Included by sicxeasm.c after its encoders.
+// The rewrites, each switched by its bit in options->peephole (PEEPHOLE_... in sicoptions.h):
+//   thread    JEQ L1, where L1 is J L2, becomes JEQ L2 (also J, JGT, JLT and JSUB), if L2 stays in PC-relative reach
+//   jumpnext  J, JEQ, JGT or JLT to the statement right after it is dropped
+//   load      LDr m is dropped when r already holds m, as after STA m or a second LDA m
+//   store     STr m is dropped when m already holds r
+//   tixr      TIX m becomes TIXR r when register r holds m
+//   compr     COMP m becomes COMPR A,r when register r holds m
+// What the registers hold comes from a forward dataflow pass along the jumps: each of A, X, L, B, S and T is known to
+// equal a word of memory or an immediate value, or is unknown. A label referenced by anything but a jump (JSUB, an
+// indexed or indirect operand, WORD, END) can be reached from code the jumps don't show, so everything is unknown there,
+// as it is after a subroutine call, a system instruction or data. Labelled statements are never dropped, and every
+// rewritten statement gets a comment line saying what it was, which the listing shows. EQU aliases of labels are
+// evaluated again once the labels have moved, but a program using ORG, USE, * or arithmetic on labels is left as it is,
+// since the optimizer can't tell what those addresses point at.
+#ifndef SICPEEPHOLE_H
+#define SICPEEPHOLE_H
+
+#define PEEPHOLE_REGISTERS 6 // A, X, L, B, S and T, numbered as in format 2
+#define PEEPHOLE_MAX_HOPS 16 // Longest chain of jumps threaded through; a longer one is taken to be a loop
+
+// What an instruction does to the registers and memory the optimizer follows
+#define EFFECT_NONE 0       // Nothing followed (COMP, WD, the floating point instructions, BASE)
+#define EFFECT_LOAD 1       // Register = operand
+#define EFFECT_STORE 2      // Operand = register
+#define EFFECT_WRITE 3      // Size bytes of memory at the operand change (STCH, STF, STSW)
+#define EFFECT_SET 4        // Register = something unknown (ADD, LDCH, TIX)
+#define EFFECT_SET_FIRST 5  // The first register operand = something unknown (SHIFTL r1,n)
+#define EFFECT_SET_SECOND 6 // The second register operand = something unknown (ADDR r1,r2)
+#define EFFECT_COPY 7       // RMO r1,r2
+#define EFFECT_CLEAR 8      // CLEAR r1
+#define EFFECT_JUMP 9       // J: never falls through
+#define EFFECT_BRANCH 10    // JEQ, JGT, JLT
+#define EFFECT_CALL 11      // JSUB: the subroutine may change anything
+#define EFFECT_RETURN 12    // RSUB
+#define EFFECT_FORGET 13    // Anything at all (SVC, SIO, LPS, data, and whatever isn't in the table)
+
+typedef struct PeepholeEffect
+{
+    char Mnemonic[7];
+    char Effect;
+    signed char Register; // The register loaded, stored or set, -1 if the operand names it
+    char Size;            // Bytes of memory a store writes
+} PeepholeEffect;
+
+static const PeepholeEffect PEEPHOLE_EFFECTS[] =
+{
+    {    "LDA", EFFECT_LOAD,   0, 0 }, {    "LDX", EFFECT_LOAD,   1, 0 }, {    "LDL", EFFECT_LOAD,   2, 0 },
+    {    "LDB", EFFECT_LOAD,   3, 0 }, {    "LDS", EFFECT_LOAD,   4, 0 }, {    "LDT", EFFECT_LOAD,   5, 0 },
+    {    "STA", EFFECT_STORE,  0, 3 }, {    "STX", EFFECT_STORE,  1, 3 }, {    "STL", EFFECT_STORE,  2, 3 },
+    {    "STB", EFFECT_STORE,  3, 3 }, {    "STS", EFFECT_STORE,  4, 3 }, {    "STT", EFFECT_STORE,  5, 3 },
+    {   "STCH", EFFECT_WRITE, -1, 1 }, {    "STF", EFFECT_WRITE, -1, 6 }, {   "STSW", EFFECT_WRITE, -1, 3 },
+    {    "ADD", EFFECT_SET,    0, 0 }, {    "SUB", EFFECT_SET,    0, 0 }, {    "MUL", EFFECT_SET,    0, 0 },
+    {    "DIV", EFFECT_SET,    0, 0 }, {    "AND", EFFECT_SET,    0, 0 }, {     "OR", EFFECT_SET,    0, 0 },
+    {   "LDCH", EFFECT_SET,    0, 0 }, {     "RD", EFFECT_SET,    0, 0 }, {    "FIX", EFFECT_SET,    0, 0 },
+    {    "TIX", EFFECT_SET,    1, 0 }, {   "TIXR", EFFECT_SET,    1, 0 },
+    { "SHIFTL", EFFECT_SET_FIRST, -1, 0 }, { "SHIFTR", EFFECT_SET_FIRST, -1, 0 },
+    {   "ADDR", EFFECT_SET_SECOND, -1, 0 }, {   "SUBR", EFFECT_SET_SECOND, -1, 0 },
+    {   "MULR", EFFECT_SET_SECOND, -1, 0 }, {   "DIVR", EFFECT_SET_SECOND, -1, 0 },
+    {    "RMO", EFFECT_COPY,  -1, 0 }, {  "CLEAR", EFFECT_CLEAR, -1, 0 },
+    {      "J", EFFECT_JUMP,  -1, 0 }, {    "JEQ", EFFECT_BRANCH, -1, 0 }, {    "JGT", EFFECT_BRANCH, -1, 0 },
+    {    "JLT", EFFECT_BRANCH, -1, 0 }, {   "JSUB", EFFECT_CALL, -1, 0 }, {   "RSUB", EFFECT_RETURN, -1, 0 },
+    {   "COMP", EFFECT_NONE,  -1, 0 }, {  "COMPF", EFFECT_NONE,  -1, 0 }, {  "COMPR", EFFECT_NONE,  -1, 0 },
+    {   "ADDF", EFFECT_NONE,  -1, 0 }, {   "SUBF", EFFECT_NONE,  -1, 0 }, {   "MULF", EFFECT_NONE,  -1, 0 },
+    {   "DIVF", EFFECT_NONE,  -1, 0 }, {    "LDF", EFFECT_NONE,  -1, 0 }, {  "FLOAT", EFFECT_NONE,  -1, 0 },
+    {   "NORM", EFFECT_NONE,  -1, 0 }, {     "TD", EFFECT_NONE,  -1, 0 }, {     "WD", EFFECT_NONE,  -1, 0 },
+    {    "STI", EFFECT_NONE,  -1, 0 }, {  "START", EFFECT_NONE,  -1, 0 }, {   "BASE", EFFECT_NONE,  -1, 0 },
+    { "NOBASE", EFFECT_NONE,  -1, 0 }, {"INCLUDE", EFFECT_NONE,  -1, 0 },
+};
+
+#define PEEPHOLE_EFFECTS_SIZE (sizeof(PEEPHOLE_EFFECTS) / sizeof(PEEPHOLE_EFFECTS[0]))
+
+static const PeepholeEffect PEEPHOLE_FORGET = { "", EFFECT_FORGET, -1, 0 };
+
+// Registers tried, in order, as the other operand of TIXR and COMPR A,r
+static const int TIXR_REGISTERS[] = { 5, 4, 3, 0, 2 }; // T, S, B, A, L
+static const int COMPR_REGISTERS[] = { 5, 4, 1, 3, 2 }; // T, S, X, B, L
+
+// What a register is known to hold: a kind in the high half and its value in the low one
+#define FACT_UNKNOWN 0LL
+#define FACT_MEMORY 1LL  // The word at an address
+#define FACT_NUMBER 2LL  // An immediate number (#5)
+#define FACT_ADDRESS 3LL // A symbol's address as an immediate (#BUFFER), by symbol index so it survives the new layout
+#define MAKE_FACT(kind, value) ((kind) << 32 | (unsigned int)(value))
+#define FACT_KIND(fact) ((fact) >> 32)
+
+// One line of the intermediate file. Comments (and the heading) have no OPCODE and are copied through as they are
+typedef struct PeepholeStatement
+{
+    char* text;                   // The line as pass 1 wrote it
+    char* LINE;
+    char* LABEL;                  // NULL if none
+    char* OPCODE;
+    char* OPERAND;                // NULL if none
+    char* originalOpcode;         // What a rewrite replaced, for the comment in the listing
+    char* originalOperand;
+    const PeepholeEffect* effect;
+    int address;
+    int size;                     // Bytes, as pass 1 laid it out
+    int target;                   // The statement a direct jump or JSUB goes to, -1 if none
+    int nextPredecessor;          // The next jump with the same target, -1 at the end
+    int rule;                     // The PEEPHOLE_ rule that rewrote it, -1 if none
+    bool removed;
+    bool external;                // Reached from code the jumps don't show, so nothing is known on entry
+} PeepholeStatement;
+
+static inline const PeepholeEffect* findPeepholeEffect(const char* OPCODE)
+{
+    if (OPCODE[0] == '+')
+    {
+        OPCODE++;
+    }
+    for (int i = 0; i < (int)PEEPHOLE_EFFECTS_SIZE; i++)
+    {
+        if (strcmp(OPCODE, PEEPHOLE_EFFECTS[i].Mnemonic) == 0)
+        {
+            return &PEEPHOLE_EFFECTS[i];
+        }
+    }
+    return &PEEPHOLE_FORGET;
+}
+
+// Splits an intermediate line into its columns (LINE, address, label, opcode, operand). Comments keep OPCODE NULL
+static inline void parsePeepholeStatement(PeepholeStatement* statement, char* text)
+{
+    memset(statement, 0, sizeof(*statement));
+    statement->text = text;
+    statement->target = -1;
+    statement->nextPredecessor = -1;
+    statement->rule = -1;
+
+    char* fields[5] = { NULL };
+    char* field = arenaStrdup(&assemblyArena, text);
+    field[strcspn(field, "\r\n")] = '\0';
+    for (int i = 0; i < 5 && field != NULL; i++)
+    {
+        fields[i] = field;
+        char* tab = i < 4 ? strchr(field, '\t') : NULL;
+        field = tab != NULL ? tab + 1 : NULL;
+        if (tab != NULL)
+        {
+            *tab = '\0';
+        }
+    }
+    if (fields[4] == NULL || !isxdigit((unsigned char)fields[1][0]))
+    {
+        return;
+    }
+    statement->LINE = fields[0];
+    statement->address = (int)strtol(fields[1], NULL, 16);
+    statement->LABEL = fields[2][0] != '\0' ? fields[2] : NULL;
+    statement->OPCODE = fields[3];
+    statement->OPERAND = fields[4][0] != '\0' ? fields[4] : NULL;
+    statement->effect = findPeepholeEffect(statement->OPCODE);
+}
+
+// The fact an operand stands for: the word at a symbol, an immediate number or address, or FACT_UNKNOWN for what the
+// optimizer doesn't follow (indexed and indirect operands). symbol is set to a plain symbol operand's index, else -1
+static inline long long operandFact(const char* OPERAND, int* symbol)
+{
+    *symbol = -1;
+    size_t length = 0;
+    int mode = 0;
+    if (OPERAND == NULL || OPERAND[0] == '@' || strchr(OPERAND, ',') != NULL || isExpression(operandBody(OPERAND, &length, &mode), length))
+    {
+        return FACT_UNKNOWN;
+    }
+    if (OPERAND[0] == '#')
+    {
+        if (isdigit((unsigned char)OPERAND[1]))
+        {
+            return MAKE_FACT(FACT_NUMBER, atoi(OPERAND + 1));
+        }
+        int index = findSymbol(OPERAND + 1, strlen(OPERAND + 1));
+        return index >= 0 ? MAKE_FACT(FACT_ADDRESS, index) : FACT_UNKNOWN;
+    }
+    int index = isalpha((unsigned char)OPERAND[0]) ? findSymbol(OPERAND, strlen(OPERAND)) : -1;
+    if (index < 0)
+    {
+        return FACT_UNKNOWN;
+    }
+    *symbol = index;
+    return MAKE_FACT(FACT_MEMORY, symbolTable[index].address);
+}
+
+// The register numbers of a format 2 operand (r1 or r1,r2), -1 where there is none
+static inline void operandRegisters(const char* OPERAND, int* first, int* second)
+{
+    char name[8];
+    *first = *second = -1;
+    if (OPERAND == NULL)
+    {
+        return;
+    }
+    const char* comma = strchr(OPERAND, ',');
+    snprintf(name, sizeof(name), "%.*s", comma != NULL ? (int)(comma - OPERAND) : (int)strlen(OPERAND), OPERAND);
+    *first = getRegisterNumber(name);
+    if (comma != NULL)
+    {
+        *second = getRegisterNumber(comma + 1);
+    }
+}
+
+// Marks the statements every symbol in an operand labels as reachable from outside. Any word that names a label counts,
+// so nothing the optimizer can't parse slips through
+static inline void markExternalLabels(PeepholeStatement* statements, const int* labelled, const char* OPERAND)
+{
+    for (const char* c = OPERAND; c != NULL && *c != '\0'; )
+    {
+        if (!isalpha((unsigned char)*c))
+        {
+            c++;
+            continue;
+        }
+        const char* start = c;
+        while (isalnum((unsigned char)*c) || *c == '_')
+        {
+            c++;
+        }
+        int index = findSymbol(start, (size_t)(c - start));
+        if (index >= 0 && labelled[index] >= 0)
+        {
+            statements[labelled[index]].external = true;
+        }
+    }
+}
+
+// Whether an operand computes an address, from * or a label with arithmetic on it
+static inline bool computesAddress(const char* OPERAND)
+{
+    size_t length = 0;
+    int mode = 0;
+    const char* body = OPERAND != NULL ? operandBody(OPERAND, &length, &mode) : NULL;
+    if (body == NULL || !isExpression(body, length))
+    {
+        return false;
+    }
+    char previous = '(';
+    for (size_t i = 0; i < length; i++)
+    {
+        if (body[i] == '*' && strchr("(+-*/", previous) != NULL) // * where a term goes, not a multiplication
+        {
+            return true;
+        }
+        if (isalpha((unsigned char)body[i]))
+        {
+            size_t start = i;
+            while (i + 1 < length && (isalnum((unsigned char)body[i + 1]) || body[i + 1] == '_'))
+            {
+                i++;
+            }
+            int index = findSymbol(body + start, i + 1 - start);
+            if (index < 0 || !symbolTable[index].absolute)
+            {
+                return true;
+            }
+        }
+        previous = body[i];
+    }
+    return false;
+}
+
+// Forgets what registers know about memory in [address, address + size). A negative size forgets all of memory
+static inline void forgetMemory(long long* facts, int address, int size)
+{
+    for (int r = 0; r < PEEPHOLE_REGISTERS; r++)
+    {
+        int word = (int)(facts[r] & 0xFFFFFFFF);
+        if (FACT_KIND(facts[r]) == FACT_MEMORY && (size < 0 || (word < address + size && address < word + 3)))
+        {
+            facts[r] = FACT_UNKNOWN;
+        }
+    }
+}
+
+// Updates facts (what each register holds before the statement) to what they hold after it
+static inline void applyPeepholeEffect(const PeepholeStatement* statement, long long* facts)
+{
+    const PeepholeEffect* effect = statement->effect;
+    int symbol = -1, first = -1, second = -1;
+    long long value = operandFact(statement->OPERAND, &symbol);
+    switch (effect->Effect)
+    {
+    case EFFECT_LOAD:
+        facts[effect->Register] = value;
+        break;
+    case EFFECT_STORE:
+    case EFFECT_WRITE:
+        // Through an index or a pointer the store could land anywhere
+        forgetMemory(facts, symbol >= 0 ? symbolTable[symbol].address : 0, symbol >= 0 ? effect->Size : -1);
+        if (effect->Effect == EFFECT_STORE && symbol >= 0)
+        {
+            facts[effect->Register] = value;
+        }
+        break;
+    case EFFECT_SET:
+        facts[effect->Register] = FACT_UNKNOWN;
+        break;
+    case EFFECT_SET_FIRST:
+    case EFFECT_SET_SECOND:
+    case EFFECT_COPY:
+    case EFFECT_CLEAR:
+        operandRegisters(statement->OPERAND, &first, &second);
+        if (effect->Effect == EFFECT_SET_FIRST || effect->Effect == EFFECT_CLEAR)
+        {
+            second = first;
+        }
+        if (second >= 0 && second < PEEPHOLE_REGISTERS)
+        {
+            facts[second] = effect->Effect == EFFECT_CLEAR ? MAKE_FACT(FACT_NUMBER, 0)
+                : effect->Effect == EFFECT_COPY && first >= 0 && first < PEEPHOLE_REGISTERS ? facts[first] : FACT_UNKNOWN;
+        }
+        break;
+    case EFFECT_CALL:
+    case EFFECT_FORGET:
+        for (int r = 0; r < PEEPHOLE_REGISTERS; r++)
+        {
+            facts[r] = FACT_UNKNOWN;
+        }
+        break;
+    default: // Jumps and instructions that leave everything followed alone
+        break;
+    }
+}
+
+static inline bool fallsThrough(const PeepholeStatement* statement)
+{
+    return statement->effect->Effect != EFFECT_JUMP && statement->effect->Effect != EFFECT_RETURN && strcmp(statement->OPCODE, "END") != 0;
+}
+
+// Combines what one predecessor knows into facts: a register keeps its fact only if every predecessor agrees on it
+static inline void meetFacts(long long* facts, const long long* from, bool* seen)
+{
+    for (int r = 0; r < PEEPHOLE_REGISTERS; r++)
+    {
+        facts[r] = !*seen ? from[r] : facts[r] == from[r] ? facts[r] : FACT_UNKNOWN;
+    }
+    *seen = true;
+}
+
+// Follows J after J from a jump's target. Returns the statement the chain ends at, or -1 if it doesn't go anywhere new
+static inline int threadJump(const PeepholeStatement* statements, int target)
+{
+    int destination = target;
+    for (int hops = 0; hops < PEEPHOLE_MAX_HOPS; hops++)
+    {
+        const PeepholeStatement* next = &statements[destination];
+        if (next->removed || next->effect->Effect != EFFECT_JUMP || next->target < 0)
+        {
+            return destination != target ? destination : -1;
+        }
+        destination = next->target;
+    }
+    return -1; // A loop of jumps, which is left alone
+}
+
+// Replaces a statement's opcode and operand, keeping the old ones for the listing
+static inline void rewriteStatement(PeepholeStatement* statement, int rule, const char* OPCODE, const char* OPERAND)
+{
+    statement->originalOpcode = statement->OPCODE;
+    statement->originalOperand = statement->OPERAND;
+    statement->OPCODE = arenaStrdup(&assemblyArena, OPCODE);
+    statement->OPERAND = arenaStrdup(&assemblyArena, OPERAND);
+    statement->rule = rule;
+}
+
+static inline void removeStatement(PeepholeStatement* statement, int rule)
+{
+    statement->removed = true;
+    statement->rule = rule;
+}
+
+// Works out what each register holds at each statement (facts, PEEPHOLE_REGISTERS per statement, valid where reached)
+static inline void findRegisterFacts(PeepholeStatement* statements, int count, long long* facts, bool* reached)
+{
+    long long* after = arenaAlloc(&assemblyArena, (size_t)count * PEEPHOLE_REGISTERS * sizeof(long long));
+    int* firstPredecessor = arenaAlloc(&assemblyArena, (size_t)count * sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        firstPredecessor[i] = -1;
+        reached[i] = false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        int kind = statement->OPCODE != NULL ? statement->effect->Effect : EFFECT_NONE;
+        if (!statement->removed && statement->target >= 0 && (kind == EFFECT_JUMP || kind == EFFECT_BRANCH))
+        {
+            statement->nextPredecessor = firstPredecessor[statement->target];
+            firstPredecessor[statement->target] = i;
+        }
+    }
+
+    // Sweeps in statement order until nothing changes. Facts only ever become unknown, so this ends after a few sweeps
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        int previous = -1; // The statement falling into this one, -1 if none does
+        for (int i = 0; i < count; i++)
+        {
+            PeepholeStatement* statement = &statements[i];
+            if (statement->OPCODE == NULL || statement->removed)
+            {
+                continue;
+            }
+            long long* before = &facts[(size_t)i * PEEPHOLE_REGISTERS];
+            bool seen = false;
+            if (statement->external)
+            {
+                static const long long unknown[PEEPHOLE_REGISTERS] = { FACT_UNKNOWN };
+                meetFacts(before, unknown, &seen);
+            }
+            else
+            {
+                if (previous >= 0 && reached[previous])
+                {
+                    meetFacts(before, &after[(size_t)previous * PEEPHOLE_REGISTERS], &seen);
+                }
+                for (int p = firstPredecessor[i]; p >= 0; p = statements[p].nextPredecessor)
+                {
+                    if (reached[p])
+                    {
+                        meetFacts(before, &after[(size_t)p * PEEPHOLE_REGISTERS], &seen);
+                    }
+                }
+            }
+            if (seen)
+            {
+                long long result[PEEPHOLE_REGISTERS];
+                memcpy(result, before, sizeof(result));
+                applyPeepholeEffect(statement, result);
+                long long* stored = &after[(size_t)i * PEEPHOLE_REGISTERS];
+                if (!reached[i] || memcmp(stored, result, sizeof(result)) != 0)
+                {
+                    memcpy(stored, result, sizeof(result));
+                    reached[i] = true;
+                    changed = true;
+                }
+            }
+            previous = fallsThrough(statement) ? i : -1;
+        }
+    }
+}
+
+// The register (other than those in avoid) that holds fact, from candidates in order, or -1
+static inline int findHoldingRegister(const long long* facts, long long fact, const int* candidates, int candidateCount)
+{
+    for (int i = 0; fact != FACT_UNKNOWN && i < candidateCount; i++)
+    {
+        if (facts[candidates[i]] == fact)
+        {
+            return candidates[i];
+        }
+    }
+    return -1;
+}
+
+// Applies the rewrites that depend on what the registers hold
+static inline void rewriteWithFacts(PeepholeStatement* statements, int count, unsigned int rules)
+{
+    long long* facts = arenaAlloc(&assemblyArena, (size_t)count * PEEPHOLE_REGISTERS * sizeof(long long));
+    bool* reached = arenaAlloc(&assemblyArena, (size_t)count * sizeof(bool));
+    findRegisterFacts(statements, count, facts, reached);
+
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        if (statement->OPCODE == NULL || statement->removed || !reached[i])
+        {
+            continue;
+        }
+        const long long* before = &facts[(size_t)i * PEEPHOLE_REGISTERS];
+        const char* mnemonic = statement->OPCODE[0] == '+' ? statement->OPCODE + 1 : statement->OPCODE;
+        int symbol = -1;
+        long long value = operandFact(statement->OPERAND, &symbol);
+        int kind = statement->effect->Effect;
+        if (kind == EFFECT_LOAD && (rules & 1u << PEEPHOLE_LOAD) && statement->LABEL == NULL
+            && value != FACT_UNKNOWN && before[statement->effect->Register] == value)
+        {
+            removeStatement(statement, PEEPHOLE_LOAD);
+        }
+        else if (kind == EFFECT_STORE && (rules & 1u << PEEPHOLE_STORE) && statement->LABEL == NULL
+            && symbol >= 0 && before[statement->effect->Register] == value)
+        {
+            removeStatement(statement, PEEPHOLE_STORE);
+        }
+        else if (strcmp(mnemonic, "TIX") == 0 && (rules & 1u << PEEPHOLE_TIXR))
+        {
+            int r = findHoldingRegister(before, value, TIXR_REGISTERS, sizeof(TIXR_REGISTERS) / sizeof(TIXR_REGISTERS[0]));
+            if (r >= 0)
+            {
+                rewriteStatement(statement, PEEPHOLE_TIXR, "TIXR", RegisterNames[r]);
+            }
+        }
+        else if (strcmp(mnemonic, "COMP") == 0 && (rules & 1u << PEEPHOLE_COMPR))
+        {
+            int r = findHoldingRegister(before, value, COMPR_REGISTERS, sizeof(COMPR_REGISTERS) / sizeof(COMPR_REGISTERS[0]));
+            if (r >= 0)
+            {
+                char operand[8];
+                snprintf(operand, sizeof(operand), "A,%s", RegisterNames[r]);
+                rewriteStatement(statement, PEEPHOLE_COMPR, "COMPR", operand);
+            }
+        }
+    }
+}
+
+static inline FILE* optimizeIntermediate(const AssemblerOptions* options, FILE* IntermediateFile, int* LOCCTR, FILE* MessageFile)
+{
+    unsigned int rules = options->peephole;
+
+    // The whole of pass 1's output, one record per line
+    PeepholeStatement* statements = NULL;
+    int count = 0, capacity = 0;
+    char* text = NULL;
+    while ((text = arenaReadLine(&assemblyArena, IntermediateFile)) != NULL)
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            PeepholeStatement* grown = arenaAlloc(&assemblyArena, (size_t)capacity * sizeof(PeepholeStatement));
+            if (count > 0)
+            {
+                memcpy(grown, statements, (size_t)count * sizeof(PeepholeStatement));
+            }
+            statements = grown;
+        }
+        parsePeepholeStatement(&statements[count++], text);
+    }
+    fclose(IntermediateFile);
+
+    // Addresses the optimizer can't follow pin everything in place, so the program goes to pass 2 as it is
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        bool switchesBlock = statement->OPCODE != NULL && strcmp(statement->OPCODE, "USE") == 0;
+        if (statement->OPCODE != NULL && (strcmp(statement->OPCODE, "ORG") == 0 || switchesBlock
+            || (strcmp(statement->OPCODE, "BYTE") != 0 && computesAddress(statement->OPERAND))))
+        {
+            fprintf(MessageFile, "Peephole: skipped, line %s %s (%s %s)\n", statement->LINE,
+                switchesBlock ? "uses program blocks" : "computes an address", statement->OPCODE,
+                statement->OPERAND != NULL ? statement->OPERAND : "");
+            IntermediateFile = openIntermediate(options);
+            for (int j = 0; j < count; j++)
+            {
+                fputs(statements[j].text, IntermediateFile);
+            }
+            return IntermediateFile;
+        }
+    }
+
+    // Each statement runs up to the next one's address (the last up to LOCCTR), and labels map back to their statements
+    int* labelled = arenaAlloc(&assemblyArena, (symbolCount > 0 ? symbolCount : 1) * sizeof(int));
+    for (int i = 0; i < symbolCount; i++)
+    {
+        labelled[i] = -1;
+    }
+    int first = -1, previous = -1;
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        if (statement->OPCODE == NULL)
+        {
+            continue;
+        }
+        if (previous >= 0)
+        {
+            statements[previous].size = statement->address - statements[previous].address;
+        }
+        first = first < 0 ? i : first;
+        previous = i;
+        int index = statement->LABEL != NULL ? findSymbol(statement->LABEL, strlen(statement->LABEL)) : -1;
+        if (index >= 0 && strcmp(statement->OPCODE, "EQU") != 0) // An EQU label names its operand, not the statement
+        {
+            labelled[index] = i;
+        }
+    }
+    if (previous < 0)
+    {
+        return openIntermediate(options); // Nothing to optimize; pass 2 reports the empty program as usual
+    }
+    statements[previous].size = *LOCCTR - statements[previous].address;
+    statements[first].external = true;
+
+    // Direct jumps (and calls) to labels are followed; every other use of a label lets code the jumps don't show reach it
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        if (statement->OPCODE == NULL)
+        {
+            continue;
+        }
+        int symbol = -1;
+        int kind = statement->effect->Effect;
+        operandFact(statement->OPERAND, &symbol);
+        if ((kind == EFFECT_JUMP || kind == EFFECT_BRANCH || kind == EFFECT_CALL) && symbol >= 0 && labelled[symbol] >= 0)
+        {
+            statement->target = labelled[symbol];
+        }
+        if (statement->target < 0 || kind == EFFECT_CALL)
+        {
+            markExternalLabels(statements, labelled, statement->OPERAND);
+        }
+    }
+
+    // Jumps to jumps go straight to the end of the chain
+    for (int i = 0; (rules & 1u << PEEPHOLE_THREAD) && i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        int destination = statement->target >= 0 ? threadJump(statements, statement->target) : -1;
+        if (destination >= 0 && statements[destination].LABEL != NULL)
+        {
+            rewriteStatement(statement, PEEPHOLE_THREAD, statement->OPCODE, statements[destination].LABEL);
+            statement->target = destination;
+            if (statement->effect->Effect == EFFECT_CALL) // The subroutine now starts there
+            {
+                statements[destination].external = true;
+            }
+        }
+    }
+
+    // Jumps to the next statement (past any that take no space) do nothing
+    for (int i = 0; (rules & 1u << PEEPHOLE_JUMP_NEXT) && i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        int kind = statement->OPCODE != NULL ? statement->effect->Effect : EFFECT_NONE;
+        if (statement->target < 0 || statement->LABEL != NULL || (kind != EFFECT_JUMP && kind != EFFECT_BRANCH))
+        {
+            continue;
+        }
+        int next = i + 1;
+        while (next < count && next != statement->target
+            && (statements[next].OPCODE == NULL || statements[next].removed || statements[next].size == 0))
+        {
+            next++;
+        }
+        if (next == statement->target)
+        {
+            removeStatement(statement, PEEPHOLE_JUMP_NEXT);
+        }
+    }
+
+    if (rules & (1u << PEEPHOLE_LOAD | 1u << PEEPHOLE_STORE | 1u << PEEPHOLE_TIXR | 1u << PEEPHOLE_COMPR))
+    {
+        rewriteWithFacts(statements, count, rules);
+    }
+
+    // Lay the program out again and move the labels with their statements
+    int address = statements[first].address;
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        if (statement->OPCODE == NULL)
+        {
+            continue;
+        }
+        statement->address = address;
+        int index = statement->LABEL != NULL ? findSymbol(statement->LABEL, strlen(statement->LABEL)) : -1;
+        if (index >= 0 && strcmp(statement->OPCODE, "EQU") != 0)
+        {
+            symbolTable[index].address = address;
+        }
+        if (statement->removed)
+        {
+            statement->size = 0;
+        }
+        else if (statement->rule == PEEPHOLE_TIXR || statement->rule == PEEPHOLE_COMPR)
+        {
+            statement->size = instructionLength(statement->OPCODE);
+        }
+        address += statement->size;
+    }
+    int saved = *LOCCTR - address;
+    *LOCCTR = address;
+    reevaluateEquates(); // Aliases follow the labels they name
+
+    // Shrinking only brings addresses closer, but a threaded jump goes somewhere new, which may now be out of reach
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        if (statement->rule == PEEPHOLE_THREAD && !statement->removed && statement->OPCODE[0] != '+')
+        {
+            int displacement = statements[statement->target].address - (statement->address + 3);
+            if (displacement < -2048 || displacement > 2047)
+            {
+                statement->OPERAND = statement->originalOperand;
+                statement->rule = -1;
+            }
+        }
+    }
+
+    // Write the statements back for pass 2, each rewrite preceded by a comment recording it
+    int counts[PEEPHOLE_RULES] = { 0 };
+    IntermediateFile = openIntermediate(options);
+    for (int i = 0; i < count; i++)
+    {
+        PeepholeStatement* statement = &statements[i];
+        if (statement->rule >= 0)
+        {
+            counts[statement->rule]++;
+        }
+        if (statement->OPCODE == NULL)
+        {
+            fputs(statement->text, IntermediateFile);
+        }
+        else if (statement->removed)
+        {
+            fprintf(IntermediateFile, "%s\t. peephole %s: %s %s removed\n", statement->LINE, PEEPHOLE_NAMES[statement->rule],
+                statement->OPCODE, statement->OPERAND != NULL ? statement->OPERAND : "");
+        }
+        else
+        {
+            if (statement->rule >= 0)
+            {
+                fprintf(IntermediateFile, "%s\t. peephole %s: %s %s -> %s %s\n", statement->LINE, PEEPHOLE_NAMES[statement->rule],
+                    statement->originalOpcode, statement->originalOperand != NULL ? statement->originalOperand : "",
+                    statement->OPCODE, statement->OPERAND);
+            }
+            fprintf(IntermediateFile, "%s\t%04X\t%s\t%s\t%s\n", statement->LINE, statement->address,
+                statement->LABEL != NULL ? statement->LABEL : "", statement->OPCODE, statement->OPERAND != NULL ? statement->OPERAND : "");
+        }
+    }
+
+    int total = 0;
+    for (int i = 0; i < PEEPHOLE_RULES; i++)
+    {
+        total += counts[i];
+    }
+    fprintf(MessageFile, "Peephole: %d statements rewritten, %d bytes saved\n", total, saved);
+    for (int i = 0; i < PEEPHOLE_RULES; i++)
+    {
+        if (rules & 1u << i)
+        {
+            fprintf(MessageFile, "  %-9s %d\n", PEEPHOLE_NAMES[i], counts[i]);
+        }
+    }
+    return IntermediateFile;
+}
+
+#endif
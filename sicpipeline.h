@@ -0,0 +1,305 @@
+// Pipelined assembly (--pipeline): reading, assembling and writing run on separate threads, connected by bounded
+// single-producer/single-consumer ring buffers. Lines and output records travel in blocks of many at a time, so the
+// threads synchronize once per block rather than once per line, and a slow stage only ever waits on a full or empty ring
+#ifndef SICPIPELINE_H
+#define SICPIPELINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#include "sicarena.h"
+
+// MSVC has neither pthreads nor (without extra switches) C11 atomics, so there --pipeline falls back to assembling serially
+#if defined(_MSC_VER)
+#define PIPELINE_AVAILABLE 0
+#else
+#define PIPELINE_AVAILABLE 1
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
+#define RING_CAPACITY 16           // Blocks in flight between two stages, a power of two
+#define PIPELINE_BLOCK_SIZE (64 * 1024)
+#define CACHE_LINE_SIZE 64
+
+#if PIPELINE_AVAILABLE
+
+// A block of lines or output records. Each entry ends in a NUL, so entries can be handed out in place
+typedef struct PipelineBlock
+{
+    size_t length;   // Bytes of text in use
+    size_t capacity;
+    char text[];
+} PipelineBlock;
+
+// Lock-free ring of blocks with one producer and one consumer. head and tail sit on their own cache lines,
+// so the two threads only share a line when one of them actually has to look at the other's progress
+typedef struct RingBuffer
+{
+    PipelineBlock* slots[RING_CAPACITY];
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head; // Next slot the consumer takes
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail; // Next slot the producer fills
+    atomic_bool closed;                           // The producer has pushed its last block
+} RingBuffer;
+
+static inline void initRingBuffer(RingBuffer* ring)
+{
+    memset(ring->slots, 0, sizeof(ring->slots));
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, false);
+}
+
+// Spins briefly, then gives the processor away, so a stalled stage doesn't burn a core waiting
+static inline void pipelineWait(int* spins)
+{
+    if (++*spins > 64)
+    {
+        sched_yield();
+    }
+}
+
+static inline void pushBlock(RingBuffer* ring, PipelineBlock* block)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    int spins = 0;
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == RING_CAPACITY)
+    {
+        pipelineWait(&spins);
+    }
+    ring->slots[tail & (RING_CAPACITY - 1)] = block;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static inline void closeRingBuffer(RingBuffer* ring)
+{
+    atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+// Returns the next block without taking it, waiting for one if needed. NULL once the producer has finished
+static inline PipelineBlock* peekBlock(RingBuffer* ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    int spins = 0;
+    while (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+    {
+        // Closing happens after the last push, so an empty ring seen after the flag really is finished
+        if (atomic_load_explicit(&ring->closed, memory_order_acquire) && head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+        {
+            return NULL;
+        }
+        pipelineWait(&spins);
+    }
+    return ring->slots[head & (RING_CAPACITY - 1)];
+}
+
+static inline PipelineBlock* popBlock(RingBuffer* ring)
+{
+    PipelineBlock* block = peekBlock(ring);
+    if (block != NULL)
+    {
+        atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->head, memory_order_relaxed) + 1, memory_order_release);
+    }
+    return block;
+}
+
+static inline PipelineBlock* newPipelineBlock(size_t capacity)
+{
+    PipelineBlock* block = malloc(sizeof(PipelineBlock) + capacity);
+    if (block == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    block->length = 0;
+    block->capacity = capacity;
+    return block;
+}
+
+//////////////////// Producer side ////////////////////
+
+// Collects entries into blocks and pushes each block once it is full
+typedef struct BlockWriter
+{
+    RingBuffer* ring;
+    PipelineBlock* block;
+} BlockWriter;
+
+// Appends an entry of length bytes plus a terminating NUL, returning where it went so the caller can fill it in
+static inline char* reserveEntry(BlockWriter* writer, size_t length)
+{
+    if (writer->block != NULL && writer->block->length + length + 1 > writer->block->capacity)
+    {
+        pushBlock(writer->ring, writer->block);
+        writer->block = NULL;
+    }
+    if (writer->block == NULL)
+    {
+        writer->block = newPipelineBlock(length + 1 > PIPELINE_BLOCK_SIZE ? length + 1 : PIPELINE_BLOCK_SIZE);
+    }
+    char* entry = writer->block->text + writer->block->length;
+    writer->block->length += length + 1;
+    entry[length] = '\0';
+    return entry;
+}
+
+// Pushes the partly filled block and tells the consumer nothing more is coming
+static inline void finishBlocks(BlockWriter* writer)
+{
+    if (writer->block != NULL && writer->block->length > 0)
+    {
+        pushBlock(writer->ring, writer->block);
+    }
+    else
+    {
+        free(writer->block);
+    }
+    writer->block = NULL;
+    closeRingBuffer(writer->ring);
+}
+
+//////////////////// Consumer side ////////////////////
+
+typedef struct BlockReader
+{
+    RingBuffer* ring;
+    PipelineBlock* block; // The block entries are being handed out from, freed once they all have been
+    size_t position;
+} BlockReader;
+
+// Returns the next entry, or NULL at the end. It stays valid until the entry after it is read
+static inline char* nextEntry(BlockReader* reader)
+{
+    if (reader->block == NULL || reader->position >= reader->block->length)
+    {
+        free(reader->block);
+        reader->block = popBlock(reader->ring);
+        reader->position = 0;
+        if (reader->block == NULL)
+        {
+            return NULL;
+        }
+    }
+    char* entry = reader->block->text + reader->position;
+    reader->position += strlen(entry) + 1;
+    return entry;
+}
+
+//////////////////// Line reader stage ////////////////////
+
+// A thread reading a file's lines into blocks, each line kept exactly as arenaReadLine returns it
+typedef struct LineQueue
+{
+    RingBuffer ring;
+    BlockReader reader;
+    FILE* file;
+    pthread_t thread;
+} LineQueue;
+
+static inline void* readLinesThread(void* argument)
+{
+    LineQueue* queue = argument;
+    Arena readerArena = { 0 }; // The reader's own scratch space; arenas aren't shared between threads
+    BlockWriter writer = { &queue->ring, NULL };
+    char* line;
+    for (arenaReset(&readerArena); (line = arenaReadLine(&readerArena, queue->file)) != NULL; arenaReset(&readerArena))
+    {
+        size_t length = strlen(line);
+        memcpy(reserveEntry(&writer, length), line, length);
+    }
+    finishBlocks(&writer);
+    arenaFree(&readerArena);
+    return NULL;
+}
+
+static inline void startQueue(LineQueue* queue, FILE* file, void* (*thread)(void*))
+{
+    initRingBuffer(&queue->ring);
+    queue->reader.ring = &queue->ring;
+    queue->reader.block = NULL;
+    queue->reader.position = 0;
+    queue->file = file;
+    if (pthread_create(&queue->thread, NULL, thread, queue) != 0)
+    {
+        fprintf(stderr, "Error: Could not start the reader thread\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Like readLinesThread, but each entry is a block of whole lines, read in one go for lexSourceBlock. A line cut
+// off at the end of a read is carried over to the front of the next block
+static inline void* readChunksThread(void* argument)
+{
+    LineQueue* queue = argument;
+    PipelineBlock* block = newPipelineBlock(PIPELINE_BLOCK_SIZE);
+    for (;;)
+    {
+        block->length += fread(block->text + block->length, 1, block->capacity - 1 - block->length, queue->file);
+        bool finished = feof(queue->file) || ferror(queue->file);
+        size_t cut = block->length;
+        while (!finished && cut > 0 && block->text[cut - 1] != '\n')
+        {
+            cut--;
+        }
+        if (cut == 0 && !finished) // One line fills the block, so it grows
+        {
+            if (block->length + 1 >= block->capacity)
+            {
+                PipelineBlock* larger = newPipelineBlock(block->capacity * 2);
+                memcpy(larger->text, block->text, block->length);
+                larger->length = block->length;
+                free(block);
+                block = larger;
+            }
+            continue;
+        }
+        PipelineBlock* next = newPipelineBlock(block->capacity);
+        next->length = block->length - cut;
+        memcpy(next->text, block->text + cut, next->length);
+        block->text[cut] = '\0';
+        block->length = cut + 1;
+        if (cut > 0)
+        {
+            pushBlock(&queue->ring, block);
+        }
+        else
+        {
+            free(block);
+        }
+        block = next;
+        if (finished)
+        {
+            break;
+        }
+    }
+    free(block);
+    closeRingBuffer(&queue->ring);
+    return NULL;
+}
+
+static inline void startLineQueue(LineQueue* queue, FILE* file)
+{
+    startQueue(queue, file, readLinesThread);
+}
+
+// Entries are blocks of whole lines rather than single lines
+static inline void startChunkQueue(LineQueue* queue, FILE* file)
+{
+    startQueue(queue, file, readChunksThread);
+}
+
+// Waits for the reader, discarding anything it read that wasn't used
+static inline void stopLineQueue(LineQueue* queue)
+{
+    while (nextEntry(&queue->reader) != NULL)
+    {
+    }
+    pthread_join(queue->thread, NULL);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,379 @@
+// Runs an assembled SIC/XE program and annotates its listing with how often each line executed and had its memory read
+// and written, followed by the hottest lines
+// Build: gcc -O2 sicprof.c -o sicprof -lm
+// Usage: ./sicprof <object_file> <listing_file> [-o <output_file>] [--top <count>] [--limit <instructions>]
+//                  [--input <device_input>] [--output <device_output>]
+#include "siccompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "sicobject.h"
+#include "sicmachine.h"
+
+// One line of the listing, and what the run did to the bytes its statement occupies
+typedef struct ProfiledLine
+{
+    char* text;
+    bool statement;  // A numbered line with an address; everything else is copied through
+    int address;
+    int end;         // One past its last byte; address itself for statements that occupy nothing
+    unsigned long long executions;
+    unsigned long long reads;
+    unsigned long long writes;
+} ProfiledLine;
+
+ProfiledLine* lines = NULL;
+int lineCount = 0;
+
+// The index'th tab-separated field of line, setting length to its length, or NULL if the line has fewer fields
+const char* listingField(const char* line, int index, size_t* length)
+{
+    for (int i = 0; i < index; i++)
+    {
+        line = strchr(line, '\t');
+        if (line == NULL)
+        {
+            return NULL;
+        }
+        line++;
+    }
+    *length = strcspn(line, "\t");
+    return line;
+}
+
+bool fieldIs(const char* field, size_t length, const char* text)
+{
+    return field != NULL && length == strlen(text) && strncmp(field, text, length) == 0;
+}
+
+// Splits the listing into lines and finds each statement's address. The address column is the absolute address,
+// followed by the block-relative one when the program uses blocks ("1036 CDATA+0006"), so only its first word is read
+ProfiledLine* readListing(char* text, size_t size)
+{
+    int capacity = 256;
+    lines = malloc(capacity * sizeof(ProfiledLine));
+    char* line = text;
+    while (line < text + size)
+    {
+        char* newline = memchr(line, '\n', text + size - line);
+        char* next = newline != NULL ? newline + 1 : text + size;
+        char* end = newline != NULL ? newline : text + size;
+        if (end > line && end[-1] == '\r')
+        {
+            end--;
+        }
+        *end = '\0';
+
+        if (lineCount == capacity)
+        {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(ProfiledLine));
+        }
+        ProfiledLine* profiled = &lines[lineCount++];
+        memset(profiled, 0, sizeof(*profiled));
+        profiled->text = line;
+        size_t length;
+        const char* address = listingField(line, 1, &length);
+        if (isdigit((unsigned char)line[0]) && strspn(line, "0123456789") == strcspn(line, "\t") && address != NULL
+            && isxdigit((unsigned char)address[0]))
+        {
+            profiled->statement = true;
+            profiled->address = (int)strtol(address, NULL, 16) & MACHINE_ADDRESS_MASK;
+        }
+        line = next;
+    }
+    return lines;
+}
+
+int compareAddresses(const void* a, const void* b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Works out the bytes each statement occupies. An instruction or constant has its object code's length, except that the
+// listing cuts long data short ("..."), and RESB and RESW list none; those run up to the next statement's address
+void findLineExtents(int programEnd)
+{
+    int* addresses = malloc((lineCount > 0 ? lineCount : 1) * sizeof(int));
+    int addressCount = 0;
+    for (int i = 0; i < lineCount; i++)
+    {
+        if (lines[i].statement)
+        {
+            addresses[addressCount++] = lines[i].address;
+        }
+    }
+    qsort(addresses, addressCount, sizeof(int), compareAddresses);
+
+    for (int i = 0; i < lineCount; i++)
+    {
+        ProfiledLine* line = &lines[i];
+        if (!line->statement)
+        {
+            continue;
+        }
+        size_t opcodeLength = 0, codeLength = 0;
+        const char* opcode = listingField(line->text, 3, &opcodeLength);
+        const char* code = listingField(line->text, 5, &codeLength);
+        if (opcode != NULL && *opcode == '+')
+        {
+            opcode++;
+            opcodeLength--;
+        }
+        line->end = line->address;
+        bool truncated = code != NULL && codeLength >= 3 && strncmp(code + codeLength - 3, "...", 3) == 0;
+        if (truncated || (codeLength == 0 && (fieldIs(opcode, opcodeLength, "RESB") || fieldIs(opcode, opcodeLength, "RESW"))))
+        {
+            // The first address after this one, by binary search
+            int low = 0, high = addressCount;
+            while (low < high)
+            {
+                int middle = low + (high - low) / 2;
+                if (addresses[middle] <= line->address)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            line->end = low < addressCount ? addresses[low] : programEnd;
+        }
+        else if (code != NULL)
+        {
+            line->end = line->address + (int)(codeLength / 2);
+        }
+        if (line->end > MACHINE_MEMORY_SIZE || line->end < line->address)
+        {
+            line->end = line->address;
+        }
+    }
+    free(addresses);
+}
+
+void countLines(const Machine* machine)
+{
+    for (int i = 0; i < lineCount; i++)
+    {
+        ProfiledLine* line = &lines[i];
+        for (int address = line->address; line->statement && address < line->end; address++)
+        {
+            line->executions += machine->executions[address];
+            line->reads += machine->reads[address];
+            line->writes += machine->writes[address];
+        }
+    }
+}
+
+double percentOf(unsigned long long count, unsigned long long total)
+{
+    return total > 0 ? 100.0 * (double)count / (double)total : 0;
+}
+
+int compareHotness(const void* a, const void* b)
+{
+    const ProfiledLine* x = &lines[*(const int*)a], * y = &lines[*(const int*)b];
+    if (x->executions != y->executions)
+    {
+        return x->executions < y->executions ? 1 : -1;
+    }
+    return (*(const int*)a > *(const int*)b) - (*(const int*)a < *(const int*)b);
+}
+
+// The listing with EXECS, PCT, READS and WRITES columns in front, then the top lines by executions
+void writeAnnotatedListing(FILE* OutputFile, unsigned long long executed, int top)
+{
+    for (int i = 0; i < lineCount; i++)
+    {
+        const ProfiledLine* line = &lines[i];
+        if (strncmp(line->text, "LINE\t", 5) == 0)
+        {
+            fprintf(OutputFile, "EXECS\tPCT\tREADS\tWRITES\t%s\n", line->text);
+        }
+        else if (line->statement && line->end > line->address)
+        {
+            fprintf(OutputFile, "%llu\t%.2f%%\t%llu\t%llu\t%s\n", line->executions, percentOf(line->executions, executed),
+                line->reads, line->writes, line->text);
+        }
+        else if (isdigit((unsigned char)line->text[0]))
+        {
+            fprintf(OutputFile, "\t\t\t\t%s\n", line->text); // Comments and statements that occupy no memory
+        }
+        else
+        {
+            fprintf(OutputFile, "%s\n", line->text);
+        }
+    }
+
+    int* order = malloc((lineCount > 0 ? lineCount : 1) * sizeof(int));
+    int orderCount = 0;
+    for (int i = 0; i < lineCount; i++)
+    {
+        if (lines[i].executions > 0)
+        {
+            order[orderCount++] = i;
+        }
+    }
+    qsort(order, orderCount, sizeof(int), compareHotness);
+    fprintf(OutputFile, "\nHOTTEST LINES\nEXECS\tPCT\tLINE\tLOCCTR\tSOURCE_STATEMENT\n");
+    for (int i = 0; i < orderCount && i < top; i++)
+    {
+        const ProfiledLine* line = &lines[order[i]];
+        size_t length;
+        const char* source;
+        fprintf(OutputFile, "%llu\t%.2f%%\t", line->executions, percentOf(line->executions, executed));
+        // The line number, address, label, opcode and operand, without the object code
+        for (int field = 0; field < 5 && (source = listingField(line->text, field, &length)) != NULL; field++)
+        {
+            fprintf(OutputFile, "%s%.*s", field > 0 ? "\t" : "", (int)length, source);
+        }
+        fprintf(OutputFile, "\n");
+    }
+    free(order);
+}
+
+char* readWholeFile(const char* path, size_t* size)
+{
+    FILE* File = fopen(path, "rb");
+    if (File == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(File, 0, SEEK_END);
+    long length = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    char* text = malloc(length + 1);
+    if (text == NULL || fread(text, 1, length, File) != (size_t)length)
+    {
+        fprintf(stderr, "Error: Could not read %s\n", path);
+        free(text);
+        fclose(File);
+        return NULL;
+    }
+    fclose(File);
+    text[length] = '\0';
+    *size = (size_t)length;
+    return text;
+}
+
+double nowSeconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* objectPath = NULL, * listingPath = NULL, * outputPath = NULL, * inputPath = NULL, * devicePath = NULL;
+    int top = 10;
+    unsigned long long limit = 0; // Instructions to run at most, 0 for no limit
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+        {
+            top = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc)
+        {
+            limit = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            inputPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            devicePath = argv[++i];
+        }
+        else if (objectPath == NULL)
+        {
+            objectPath = argv[i];
+        }
+        else if (listingPath == NULL)
+        {
+            listingPath = argv[i];
+        }
+        else
+        {
+            listingPath = NULL;
+            break;
+        }
+    }
+    if (objectPath == NULL || listingPath == NULL)
+    {
+        printf("\nUsage: %s <object_file> <listing_file> [-o <output_file>] [--top <count>] [--limit <instructions>]\n"
+            "       [--input <device_input>] [--output <device_output>]\n", argv[0]);
+        return 1;
+    }
+
+    ObjectImage image;
+    if (!readObjectFile(objectPath, &image))
+    {
+        return EXIT_FAILURE;
+    }
+    size_t listingSize;
+    char* listing = readWholeFile(listingPath, &listingSize);
+    if (listing == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    Machine machine;
+    if (!initMachine(&machine))
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    loadMachine(&machine, image.startAddress, image.memory, image.loaded, image.length);
+    machine.input = inputPath != NULL ? fopen(inputPath, "rb") : NULL;
+    machine.output = devicePath != NULL ? fopen(devicePath, "wb") : NULL;
+    if ((inputPath != NULL && machine.input == NULL) || (devicePath != NULL && machine.output == NULL))
+    {
+        perror(inputPath != NULL && machine.input == NULL ? inputPath : devicePath);
+        return EXIT_FAILURE;
+    }
+
+    double start = nowSeconds();
+    int stop = runMachine(&machine, image.entryAddress, limit);
+    double seconds = nowSeconds() - start;
+    fprintf(stderr, "Stopped at %06X: %s after %llu instructions (%.1f million per second)\n", machine.stopAddress,
+        MACHINE_STOP_NAMES[stop], machine.executed, seconds > 0 ? machine.executed / seconds / 1e6 : 0);
+
+    readListing(listing, listingSize);
+    findLineExtents(image.startAddress + image.length);
+    countLines(&machine);
+    FILE* OutputFile = (outputPath != NULL) ? fopen(outputPath, "w") : stdout;
+    if (OutputFile == NULL)
+    {
+        perror("Error opening output file");
+        return EXIT_FAILURE;
+    }
+    writeAnnotatedListing(OutputFile, machine.executed, top);
+
+    if (OutputFile != stdout)
+    {
+        fclose(OutputFile);
+    }
+    if (machine.input != NULL)
+    {
+        fclose(machine.input);
+    }
+    if (machine.output != NULL)
+    {
+        fclose(machine.output);
+    }
+    free(lines);
+    free(listing);
+    freeMachine(&machine);
+    freeObjectImage(&image);
+    return 0;
+}
@@ -0,0 +1,296 @@
+// Statement records for --external, the bounded-memory mode. Instead of the text intermediate file, pass 1 spills one
+// fixed-width record per statement to a temporary file: its line number, LOCCTR and block, and its label, opcode and
+// operand as small indexes (the symbol table's, and a table of the opcodes seen). Text that isn't a symbol (comments,
+// constants, expressions, register pairs) goes to a second temporary file in the same order, so both are written and
+// read strictly front to back. Pass 2 reads the records a batch at a time and turns each back into the line pass 1
+// would have written, so it assembles exactly as it does from the intermediate file while only the symbol table
+// stays in memory. The fields pass 2 finds for M records go to a third file, since ORG can reuse addresses and so
+// there is no limit to how many there are
+#ifndef SICRECORDS_H
+#define SICRECORDS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "sicarena.h"
+#include "sicsymtab.h"
+
+#define RECORD_BATCH 4096               // Records pass 2 reads in one go
+#define RECORD_BUFFER_SIZE (1 << 20)    // stdio buffer of each file, so each is read ahead in large pieces
+#define RECORD_MAX_OPCODES 256
+
+// Flag bits. The low ones are the USE_IMMEDIATE, USE_INDIRECT and USE_INDEXED bits of an operand naming a symbol
+#define RECORD_LABEL_TEXT 0x10    // The label isn't in the symbol table yet (EQU, START), so it is in the text file
+                                  // ahead of the operand, NUL-terminated
+#define RECORD_COMMENT 0x40       // A comment line: the text is copied after the line number (or alone, for line -1)
+#define RECORD_OPERAND_TEXT 0x80  // The operand is in the text file rather than a symbol
+
+typedef struct StatementRecord
+{
+    int line;                // Line number, counted as pass 1 counts them
+    int address;             // LOCCTR, within the statement's block
+    int block;               // Program block (USE), 0 for the default one
+    int label;               // Symbol index, -1 for none (or RECORD_LABEL_TEXT)
+    int operand;             // Symbol index of an operand that is a symbol, -1 otherwise
+    unsigned int textLength; // Bytes of the text file that belong to this record
+    unsigned char opcode;    // Index in recordOpcodes, 0 for none
+    unsigned char flags;     // RECORD_ bits
+} StatementRecord;
+
+typedef struct StatementRecords
+{
+    FILE* RecordFile;
+    FILE* TextFile;
+    FILE* ModificationFile;      // {address, halfBytes} pairs, read back once pass 2 reaches END
+    bool modificationsRewound;
+    Arena* arena;                // Where opcode names are kept
+    StatementRecord* batch;      // Pass 2's read-ahead
+    int batchCount;
+    int batchPosition;
+} StatementRecords;
+
+// Opcodes by index, interned as pass 1 first sees them. Index 0 is the empty opcode
+static const char* recordOpcodes[RECORD_MAX_OPCODES];
+static int recordOpcodeCount = 0;
+static int recordOpcodeHash[2 * RECORD_MAX_OPCODES]; // Indexes into recordOpcodes, 0 for an empty slot
+
+static inline int internRecordOpcode(Arena* arena, const char* OPCODE)
+{
+    if (OPCODE == NULL || *OPCODE == '\0')
+    {
+        return 0;
+    }
+    unsigned int mask = 2 * RECORD_MAX_OPCODES - 1;
+    unsigned int slot = hashSymbolName(OPCODE, strlen(OPCODE)) & mask;
+    for (; recordOpcodeHash[slot] != 0; slot = (slot + 1) & mask)
+    {
+        if (strcmp(recordOpcodes[recordOpcodeHash[slot]], OPCODE) == 0)
+        {
+            return recordOpcodeHash[slot];
+        }
+    }
+    if (recordOpcodeCount == RECORD_MAX_OPCODES)
+    {
+        fprintf(stderr, "Error: More than %d different opcodes for the statement records\n", RECORD_MAX_OPCODES - 1);
+        exit(EXIT_FAILURE);
+    }
+    recordOpcodes[recordOpcodeCount] = arenaStrdup(arena, OPCODE);
+    recordOpcodeHash[slot] = recordOpcodeCount;
+    return recordOpcodeCount++;
+}
+
+static inline FILE* openRecordFile(void)
+{
+    FILE* file = tmpfile();
+    if (file == NULL)
+    {
+        perror("Error opening a statement record file");
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(file, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+    return file;
+}
+
+// Opens the three temporary files: the records and their text for pass 1 to write, and the M records for pass 2
+static inline void openStatementRecords(StatementRecords* records, Arena* arena)
+{
+    records->RecordFile = openRecordFile();
+    records->TextFile = openRecordFile();
+    records->ModificationFile = openRecordFile();
+    records->modificationsRewound = false;
+    records->arena = arena;
+    records->batch = NULL;
+    records->batchCount = 0;
+    records->batchPosition = 0;
+    recordOpcodes[0] = "";
+    recordOpcodeCount = 1;
+    memset(recordOpcodeHash, 0, sizeof(recordOpcodeHash));
+}
+
+static inline void writeRecord(StatementRecords* records, const StatementRecord* record)
+{
+    fwrite(record, sizeof(*record), 1, records->RecordFile);
+}
+
+// A comment line, written after its line number. Line -1 writes text as a line of its own (the column headings)
+static inline void writeCommentRecord(StatementRecords* records, int line, const char* text)
+{
+    StatementRecord record = { line, 0, 0, -1, -1, (unsigned int)strlen(text), 0, RECORD_COMMENT };
+    fwrite(text, 1, record.textLength, records->TextFile);
+    writeRecord(records, &record);
+}
+
+// A statement. An operand that is a symbol, with at most a # or @ in front or ,X after, is recorded as the symbol's
+// index; anything else is text
+static inline void writeStatementRecord(StatementRecords* records, int line, int address, int block, const char* LABEL,
+    const char* OPCODE, const char* OPERAND)
+{
+    StatementRecord record = { line, address, block, -1, -1, 0, (unsigned char)internRecordOpcode(records->arena, OPCODE), 0 };
+    if (LABEL != NULL)
+    {
+        record.label = findSymbol(LABEL, strlen(LABEL));
+        if (record.label < 0)
+        {
+            size_t length = strlen(LABEL) + 1;
+            record.flags |= RECORD_LABEL_TEXT;
+            record.textLength += (unsigned int)length;
+            fwrite(LABEL, 1, length, records->TextFile);
+        }
+    }
+    if (OPERAND != NULL)
+    {
+        size_t length = strlen(OPERAND);
+        const char* body = OPERAND;
+        int mode = 0;
+        if (length >= 2 && OPERAND[length - 2] == ',' && OPERAND[length - 1] == 'X')
+        {
+            length -= 2;
+            mode = USE_INDEXED;
+        }
+        else if (OPERAND[0] == '@' || OPERAND[0] == '#')
+        {
+            mode = OPERAND[0] == '@' ? USE_INDIRECT : USE_IMMEDIATE;
+            body++;
+            length--;
+        }
+        record.operand = findSymbol(body, length);
+        if (record.operand >= 0)
+        {
+            record.flags |= (unsigned char)mode;
+        }
+        else
+        {
+            record.flags |= RECORD_OPERAND_TEXT;
+            length = strlen(OPERAND);
+            record.textLength += (unsigned int)length;
+            fwrite(OPERAND, 1, length, records->TextFile);
+        }
+    }
+    writeRecord(records, &record);
+}
+
+// Ends pass 1's writing and goes back to the start of the record and text files for pass 2
+static inline void rewindStatementRecords(StatementRecords* records)
+{
+    if (fflush(records->RecordFile) != 0 || fflush(records->TextFile) != 0 || ferror(records->RecordFile) || ferror(records->TextFile))
+    {
+        fprintf(stderr, "Error: Could not write the statement records (is the temporary directory full?)\n");
+        exit(EXIT_FAILURE);
+    }
+    rewind(records->RecordFile);
+    rewind(records->TextFile);
+    records->batch = malloc(RECORD_BATCH * sizeof(StatementRecord));
+    if (records->batch == NULL)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    records->batchCount = 0;
+    records->batchPosition = 0;
+}
+
+// The next record as the intermediate file line pass 1 would have written, in arena. Returns NULL after the last one
+static inline char* readStatementRecord(StatementRecords* records, Arena* arena)
+{
+    if (records->batchPosition == records->batchCount)
+    {
+        records->batchCount = (int)fread(records->batch, sizeof(StatementRecord), RECORD_BATCH, records->RecordFile);
+        records->batchPosition = 0;
+        if (records->batchCount == 0)
+        {
+            return NULL;
+        }
+    }
+    const StatementRecord* record = &records->batch[records->batchPosition++];
+    char* text = arenaAlloc(arena, record->textLength + 1);
+    if (fread(text, 1, record->textLength, records->TextFile) != record->textLength)
+    {
+        fprintf(stderr, "Error: Could not read the statement records\n");
+        exit(EXIT_FAILURE);
+    }
+    text[record->textLength] = '\0';
+    if (record->flags & RECORD_COMMENT)
+    {
+        if (record->line < 0)
+        {
+            return text;
+        }
+        char* line = arenaAlloc(arena, record->textLength + 16);
+        sprintf(line, "%d\t%s", record->line, text);
+        return line;
+    }
+
+    const char* LABEL = "";
+    if (record->label >= 0)
+    {
+        LABEL = symbolTable[record->label].name;
+    }
+    else if (record->flags & RECORD_LABEL_TEXT)
+    {
+        LABEL = text;
+        text += strlen(text) + 1;
+    }
+    const char* OPCODE = recordOpcodes[record->opcode];
+    const char* prefix = "", * OPERAND = "", * suffix = "";
+    if (record->operand >= 0)
+    {
+        prefix = (record->flags & USE_IMMEDIATE) ? "#" : (record->flags & USE_INDIRECT) ? "@" : "";
+        OPERAND = symbolTable[record->operand].name;
+        suffix = (record->flags & USE_INDEXED) ? ",X" : "";
+    }
+    else if (record->flags & RECORD_OPERAND_TEXT)
+    {
+        OPERAND = text;
+    }
+    char* line = arenaAlloc(arena, strlen(LABEL) + strlen(OPCODE) + strlen(OPERAND) + 48);
+    if (record->block > 0)
+    {
+        sprintf(line, "%d\t%04X:%d\t%s\t%s\t%s%s%s", record->line, record->address, record->block, LABEL, OPCODE, prefix, OPERAND, suffix);
+    }
+    else
+    {
+        sprintf(line, "%d\t%04X\t%s\t%s\t%s%s%s", record->line, record->address, LABEL, OPCODE, prefix, OPERAND, suffix);
+    }
+    return line;
+}
+
+static inline void writeModificationRecord(StatementRecords* records, int address, int halfBytes)
+{
+    int fields[2] = { address, halfBytes };
+    fwrite(fields, sizeof(fields), 1, records->ModificationFile);
+}
+
+// The modifications in the order they were written, starting from the first. Returns false after the last one
+static inline bool readModificationRecord(StatementRecords* records, int* address, int* halfBytes)
+{
+    if (!records->modificationsRewound)
+    {
+        if (fflush(records->ModificationFile) != 0 || ferror(records->ModificationFile))
+        {
+            fprintf(stderr, "Error: Could not write the statement records (is the temporary directory full?)\n");
+            exit(EXIT_FAILURE);
+        }
+        rewind(records->ModificationFile);
+        records->modificationsRewound = true;
+    }
+    int fields[2];
+    if (fread(fields, sizeof(fields), 1, records->ModificationFile) != 1)
+    {
+        return false;
+    }
+    *address = fields[0];
+    *halfBytes = fields[1];
+    return true;
+}
+
+static inline void closeStatementRecords(StatementRecords* records)
+{
+    fclose(records->RecordFile);
+    fclose(records->TextFile);
+    fclose(records->ModificationFile);
+    free(records->batch);
+    records->batch = NULL;
+}
+
+#endif
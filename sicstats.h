@@ -0,0 +1,280 @@
+// Encoding report (--stats / --stats-json): how often each instruction format, addressing mode and operand kind is used,
+// for the whole program and for each label's region, and which references were too far away for format 3
+#ifndef SICSTATS_H
+#define SICSTATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#include "sicarena.h"
+
+// How a format 3/4 operand was addressed
+#define ADDRESSING_NONE 0   // No operand (RSUB)
+#define ADDRESSING_PC 1     // PC-relative
+#define ADDRESSING_BASE 2   // Base-relative
+#define ADDRESSING_DIRECT 3 // b = p = 0: format 4, or an immediate constant
+
+// PC displacements this far outside -2048..2047 count as near misses: a small move of code or data would make them fit
+#define NEAR_MISS_MARGIN 512
+#define TOP_FORMAT4_TARGETS 10
+
+typedef struct EncodingCounts
+{
+    int instructions;
+    int format[5]; // Indexed by format number, 1 to 4
+    int pcRelative;
+    int baseRelative;
+    int direct;
+    int immediate;
+    int indirect;
+    int indexed;
+    int nearMisses;
+} EncodingCounts;
+
+// Statements from one label up to the next
+typedef struct EncodingRegion
+{
+    const char* label;
+    int address;
+    EncodingCounts counts;
+} EncodingRegion;
+
+// A format 4 instruction with a symbol operand
+typedef struct Format4Reference
+{
+    const char* symbol;
+    int line;
+    int displacement; // From the format 3 PC, so it says how far out of range it was
+    bool needed;      // Neither PC- nor base-relative addressing could have reached it
+} Format4Reference;
+
+typedef struct EncodingStats
+{
+    Arena* arena;
+    EncodingCounts total;
+    EncodingRegion* regions;
+    int regionCount;
+    int regionCapacity;
+    Format4Reference* references;
+    int referenceCount;
+    int referenceCapacity;
+} EncodingStats;
+
+static inline void resetEncodingStats(EncodingStats* stats, Arena* arena)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->arena = arena;
+}
+
+// Arrays in the arena double, so growing them stays linear overall
+static inline void* growStatsArray(Arena* arena, void* items, int count, int* capacity, size_t itemSize)
+{
+    if (count < *capacity)
+    {
+        return items;
+    }
+    int grown = *capacity ? *capacity * 2 : 64;
+    void* copy = arenaAlloc(arena, grown * itemSize);
+    if (count > 0)
+    {
+        memcpy(copy, items, count * itemSize);
+    }
+    *capacity = grown;
+    return copy;
+}
+
+// Starts the region of a new label. Statements before the first label are counted only in the total
+static inline void beginEncodingRegion(EncodingStats* stats, const char* label, int address)
+{
+    stats->regions = growStatsArray(stats->arena, stats->regions, stats->regionCount, &stats->regionCapacity, sizeof(EncodingRegion));
+    EncodingRegion* region = &stats->regions[stats->regionCount++];
+    memset(region, 0, sizeof(*region));
+    region->label = arenaStrdup(stats->arena, label);
+    region->address = address;
+}
+
+static inline bool isNearMiss(int displacement)
+{
+    return (displacement > 2047 && displacement <= 2047 + NEAR_MISS_MARGIN) || (displacement < -2048 && displacement >= -2048 - NEAR_MISS_MARGIN);
+}
+
+static inline void addEncoding(EncodingCounts* counts, int format, const char* OPERAND, int addressing, bool nearMiss)
+{
+    counts->instructions++;
+    counts->format[format]++;
+    counts->pcRelative += addressing == ADDRESSING_PC;
+    counts->baseRelative += addressing == ADDRESSING_BASE;
+    counts->direct += addressing == ADDRESSING_DIRECT;
+    if (format >= 3 && OPERAND != NULL)
+    {
+        size_t length = strlen(OPERAND);
+        counts->immediate += OPERAND[0] == '#';
+        counts->indirect += OPERAND[0] == '@';
+        counts->indexed += length >= 2 && OPERAND[length - 2] == ',' && OPERAND[length - 1] == 'X';
+    }
+    counts->nearMisses += nearMiss;
+}
+
+// Counts one instruction. For symbol operands, displacement is the target minus the format 3 PC, and baseReachable says
+// whether base-relative addressing could have reached it
+static inline void countEncoding(EncodingStats* stats, int format, const char* OPERAND, int addressing, bool symbolOperand, int displacement, bool baseReachable, int line)
+{
+    // A near miss is a symbol that PC-relative addressing just couldn't reach, whatever was used instead
+    bool nearMiss = symbolOperand && isNearMiss(displacement);
+    addEncoding(&stats->total, format, OPERAND, addressing, nearMiss);
+    if (stats->regionCount > 0)
+    {
+        addEncoding(&stats->regions[stats->regionCount - 1].counts, format, OPERAND, addressing, nearMiss);
+    }
+
+    if (format == 4 && symbolOperand)
+    {
+        stats->references = growStatsArray(stats->arena, stats->references, stats->referenceCount, &stats->referenceCapacity, sizeof(Format4Reference));
+        Format4Reference* reference = &stats->references[stats->referenceCount++];
+        size_t length = strlen(OPERAND);
+        const char* name = OPERAND;
+        if (name[0] == '#' || name[0] == '@')
+        {
+            name++;
+            length--;
+        }
+        else if (length >= 2 && name[length - 2] == ',')
+        {
+            length -= 2;
+        }
+        reference->symbol = arenaStrndup(stats->arena, name, length);
+        reference->line = line;
+        reference->displacement = displacement;
+        reference->needed = !(displacement >= -2048 && displacement <= 2047) && !baseReachable;
+    }
+}
+
+// One target of format 4 references, with how many there were
+typedef struct Format4Target
+{
+    const char* symbol;
+    int references;
+    int needed;          // References that format 3 couldn't have reached
+    int closestDistance; // Smallest |displacement| among them
+    int firstLine;
+} Format4Target;
+
+static inline int compareReferencesBySymbol(const void* a, const void* b)
+{
+    const Format4Reference* x = a, * y = b;
+    int order = strcmp(x->symbol, y->symbol);
+    return order != 0 ? order : x->line - y->line;
+}
+
+static inline int compareTargetsByCount(const void* a, const void* b)
+{
+    const Format4Target* x = a, * y = b;
+    if (x->references != y->references)
+    {
+        return y->references - x->references;
+    }
+    return strcmp(x->symbol, y->symbol);
+}
+
+// Groups the format 4 references by target, most referenced first. Returns the number of targets
+static inline int rankFormat4Targets(EncodingStats* stats, Format4Target** targets)
+{
+    qsort(stats->references, stats->referenceCount, sizeof(Format4Reference), compareReferencesBySymbol);
+    *targets = arenaAlloc(stats->arena, (stats->referenceCount > 0 ? stats->referenceCount : 1) * sizeof(Format4Target));
+    int count = 0;
+    for (int i = 0; i < stats->referenceCount; i++)
+    {
+        const Format4Reference* reference = &stats->references[i];
+        int distance = reference->displacement < 0 ? -reference->displacement : reference->displacement;
+        if (count == 0 || strcmp((*targets)[count - 1].symbol, reference->symbol) != 0)
+        {
+            Format4Target* target = &(*targets)[count++];
+            target->symbol = reference->symbol;
+            target->references = 0;
+            target->needed = 0;
+            target->closestDistance = distance;
+            target->firstLine = reference->line;
+        }
+        Format4Target* target = &(*targets)[count - 1];
+        target->references++;
+        target->needed += reference->needed;
+        target->closestDistance = distance < target->closestDistance ? distance : target->closestDistance;
+    }
+    qsort(*targets, count, sizeof(Format4Target), compareTargetsByCount);
+    return count;
+}
+
+static inline void writeCountsText(FILE* file, const char* name, const EncodingCounts* counts)
+{
+    fprintf(file, "%-8s%6d%6d%6d%6d%6d%6d%6d%6d%6d%6d%6d%6d\n", name, counts->instructions,
+        counts->format[1], counts->format[2], counts->format[3], counts->format[4],
+        counts->pcRelative, counts->baseRelative, counts->direct,
+        counts->immediate, counts->indirect, counts->indexed, counts->nearMisses);
+}
+
+static inline void writeEncodingReport(FILE* file, EncodingStats* stats, const char* program)
+{
+    Format4Target* targets = NULL;
+    int targetCount = rankFormat4Targets(stats, &targets);
+
+    fprintf(file, "ENCODING REPORT: %s\n", program);
+    fprintf(file, "Near miss: a symbol %d bytes or less outside the PC-relative range (-2048..2047)\n\n", NEAR_MISS_MARGIN);
+    fprintf(file, "%-8s%6s%6s%6s%6s%6s%6s%6s%6s%6s%6s%6s%6s\n", "REGION", "INSTR", "F1", "F2", "F3", "F4", "PC", "BASE", "DIRCT", "IMM", "IND", "INDEX", "NEAR");
+    writeCountsText(file, "TOTAL", &stats->total);
+    for (int i = 0; i < stats->regionCount; i++)
+    {
+        if (stats->regions[i].counts.instructions > 0)
+        {
+            writeCountsText(file, stats->regions[i].label, &stats->regions[i].counts);
+        }
+    }
+
+    fprintf(file, "\nFORMAT 4 TARGETS (most referenced first)\n");
+    fprintf(file, "%-8s%6s%8s%10s%8s\n", "SYMBOL", "REFS", "NEEDED", "CLOSEST", "LINE");
+    for (int i = 0; i < targetCount && i < TOP_FORMAT4_TARGETS; i++)
+    {
+        fprintf(file, "%-8s%6d%8d%10d%8d\n", targets[i].symbol, targets[i].references, targets[i].needed, targets[i].closestDistance, targets[i].firstLine);
+    }
+}
+
+static inline void writeCountsJson(FILE* file, const EncodingCounts* counts)
+{
+    fprintf(file, "{\"instructions\": %d, \"format1\": %d, \"format2\": %d, \"format3\": %d, \"format4\": %d, "
+        "\"pcRelative\": %d, \"baseRelative\": %d, \"direct\": %d, \"immediate\": %d, \"indirect\": %d, \"indexed\": %d, \"nearMisses\": %d}",
+        counts->instructions, counts->format[1], counts->format[2], counts->format[3], counts->format[4],
+        counts->pcRelative, counts->baseRelative, counts->direct,
+        counts->immediate, counts->indirect, counts->indexed, counts->nearMisses);
+}
+
+// Labels are plain identifiers, so they need no escaping
+static inline void writeEncodingReportJson(FILE* file, EncodingStats* stats, const char* program)
+{
+    Format4Target* targets = NULL;
+    int targetCount = rankFormat4Targets(stats, &targets);
+
+    fprintf(file, "{\n  \"program\": \"%s\",\n  \"nearMissMargin\": %d,\n  \"total\": ", program, NEAR_MISS_MARGIN);
+    writeCountsJson(file, &stats->total);
+    fprintf(file, ",\n  \"regions\": [");
+    bool first = true;
+    for (int i = 0; i < stats->regionCount; i++)
+    {
+        if (stats->regions[i].counts.instructions > 0)
+        {
+            fprintf(file, "%s\n    {\"label\": \"%s\", \"address\": %d, \"counts\": ", first ? "" : ",", stats->regions[i].label, stats->regions[i].address);
+            writeCountsJson(file, &stats->regions[i].counts);
+            fprintf(file, "}");
+            first = false;
+        }
+    }
+    fprintf(file, "\n  ],\n  \"format4Targets\": [");
+    for (int i = 0; i < targetCount && i < TOP_FORMAT4_TARGETS; i++)
+    {
+        fprintf(file, "%s\n    {\"symbol\": \"%s\", \"references\": %d, \"needed\": %d, \"closestDistance\": %d, \"firstLine\": %d}",
+            i == 0 ? "" : ",", targets[i].symbol, targets[i].references, targets[i].needed, targets[i].closestDistance, targets[i].firstLine);
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+#endif
@@ -0,0 +1,271 @@
+// Symbol indexes (--symbols): the program's symbols in a binary file meant to be mapped, so a debugger or loader can look
+// a name up, or find the symbol an address falls under, without reading the listing.
+// Layout, all integers little-endian 32 bit:
+//   0             header: "SICSYMS" and a NUL, symbolCount, addressCount, hashSize, symbolOffset, hashOffset,
+//                 stringOffset, stringSize (36 bytes, padded to 40)
+//   symbolOffset  symbolCount entries {address, name, line, flags}. The first addressCount are the symbols that stand for
+//                 addresses, sorted by address (ties in definition order); the rest are absolute EQUs, in definition order
+//   hashOffset    hashSize slots (a power of two, at least twice symbolCount), each an entry index or SYMBOLS_EMPTY_SLOT.
+//                 A name starts at slot symbolIndexHash(name) & (hashSize - 1) and probes linearly
+//   stringOffset  the NUL-terminated names. name in an entry is an offset into them
+#ifndef SICSYMBOLS_H
+#define SICSYMBOLS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "siccompat.h"
+#include "sicarena.h"
+#include "sicmapfile.h"
+
+#define SYMBOLS_MAGIC "SICSYMS"
+#define SYMBOLS_HEADER_SIZE 40
+#define SYMBOLS_ENTRY_SIZE 16
+#define SYMBOLS_EMPTY_SLOT 0xFFFFFFFFu
+#define SYMBOLS_ABSOLUTE 0x1 // flags: the value is a number (an absolute EQU), not an address
+
+// 32-bit FNV-1a, the hash the slots are laid out by
+static inline unsigned int symbolIndexHash(const char* name)
+{
+    unsigned int hash = 2166136261u;
+    for (; *name != '\0'; name++)
+    {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+//////////////////// Writing ////////////////////
+
+// One symbol as the assembler hands it over
+typedef struct SymbolIndexEntry
+{
+    const char* name;
+    int address;
+    int line;       // Line that defines it, numbered as in the listing (0 if not known)
+    bool absolute;
+    int order;      // Position in definition order, to keep the sort stable
+    unsigned int nameOffset;
+} SymbolIndexEntry;
+
+static inline int compareSymbolIndexEntries(const void* a, const void* b)
+{
+    const SymbolIndexEntry* x = a, * y = b;
+    if (x->absolute != y->absolute)
+    {
+        return x->absolute ? 1 : -1;
+    }
+    if (!x->absolute && x->address != y->address)
+    {
+        return (x->address > y->address) - (x->address < y->address);
+    }
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+// Writes the count entries (in definition order, names unique) to path, reordering entries. Scratch space comes from arena
+static inline void writeSymbolIndex(SymbolIndexEntry* entries, int count, Arena* arena, const char* path)
+{
+    FILE* SymbolsFile = fopen(path, "wb");
+    if (SymbolsFile == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned int stringSize = 0;
+    int addressCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        entries[i].order = i;
+        entries[i].nameOffset = stringSize;
+        stringSize += (unsigned int)strlen(entries[i].name) + 1;
+        addressCount += entries[i].absolute ? 0 : 1;
+    }
+    // The names are laid out in definition order, before the sort moves the entries
+    char* strings = arenaAlloc(arena, stringSize > 0 ? stringSize : 1);
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(strings + entries[i].nameOffset, entries[i].name, strlen(entries[i].name) + 1);
+    }
+    qsort(entries, count, sizeof(SymbolIndexEntry), compareSymbolIndexEntries);
+
+    unsigned int hashSize = 16;
+    while (hashSize < 2 * (unsigned int)count)
+    {
+        hashSize *= 2;
+    }
+    unsigned int* slots = arenaAlloc(arena, hashSize * sizeof(unsigned int));
+    memset(slots, 0xFF, hashSize * sizeof(unsigned int));
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int slot = symbolIndexHash(entries[i].name) & (hashSize - 1);
+        while (slots[slot] != SYMBOLS_EMPTY_SLOT)
+        {
+            slot = (slot + 1) & (hashSize - 1);
+        }
+        slots[slot] = (unsigned int)i;
+    }
+
+    unsigned int symbolOffset = SYMBOLS_HEADER_SIZE;
+    unsigned int hashOffset = symbolOffset + count * SYMBOLS_ENTRY_SIZE;
+    unsigned int stringOffset = hashOffset + hashSize * 4;
+    unsigned char header[SYMBOLS_HEADER_SIZE] = { 0 };
+    memcpy(header, SYMBOLS_MAGIC, sizeof(SYMBOLS_MAGIC));
+    putFileWord(header + 8, (unsigned int)count);
+    putFileWord(header + 12, (unsigned int)addressCount);
+    putFileWord(header + 16, hashSize);
+    putFileWord(header + 20, symbolOffset);
+    putFileWord(header + 24, hashOffset);
+    putFileWord(header + 28, stringOffset);
+    putFileWord(header + 32, stringSize);
+    fwrite(header, 1, sizeof(header), SymbolsFile);
+
+    for (int i = 0; i < count; i++)
+    {
+        unsigned char bytes[SYMBOLS_ENTRY_SIZE];
+        putFileWord(bytes, (unsigned int)entries[i].address);
+        putFileWord(bytes + 4, entries[i].nameOffset);
+        putFileWord(bytes + 8, (unsigned int)entries[i].line);
+        putFileWord(bytes + 12, entries[i].absolute ? SYMBOLS_ABSOLUTE : 0);
+        fwrite(bytes, 1, sizeof(bytes), SymbolsFile);
+    }
+    for (unsigned int i = 0; i < hashSize; i++)
+    {
+        unsigned char bytes[4];
+        putFileWord(bytes, slots[i]);
+        fwrite(bytes, 1, sizeof(bytes), SymbolsFile);
+    }
+    fwrite(strings, 1, stringSize, SymbolsFile);
+    fclose(SymbolsFile);
+}
+
+//////////////////// Reading ////////////////////
+
+typedef struct SymbolIndex
+{
+    MappedFile file;
+    const unsigned char* symbols;
+    int symbolCount;
+    int addressCount;
+    const unsigned char* slots;
+    unsigned int hashSize;
+    const char* strings;
+    unsigned int stringSize;
+} SymbolIndex;
+
+// One symbol read back from the index
+typedef struct IndexedSymbol
+{
+    const char* name;
+    int address;
+    int line;
+    bool absolute;
+} IndexedSymbol;
+
+static inline void closeSymbolIndex(SymbolIndex* index)
+{
+    unmapFile(&index->file);
+    memset(index, 0, sizeof(*index));
+}
+
+static inline bool openSymbolIndex(const char* path, SymbolIndex* index)
+{
+    memset(index, 0, sizeof(*index));
+    if (!mapFile(path, &index->file))
+    {
+        return false;
+    }
+    const unsigned char* header = index->file.data;
+    if (index->file.size < SYMBOLS_HEADER_SIZE || memcmp(header, SYMBOLS_MAGIC, sizeof(SYMBOLS_MAGIC)) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a symbol index\n", path);
+        closeSymbolIndex(index);
+        return false;
+    }
+    index->symbolCount = (int)getFileWord(header + 8);
+    index->addressCount = (int)getFileWord(header + 12);
+    index->hashSize = getFileWord(header + 16);
+    size_t symbolOffset = getFileWord(header + 20);
+    size_t hashOffset = getFileWord(header + 24);
+    size_t stringOffset = getFileWord(header + 28);
+    index->stringSize = getFileWord(header + 32);
+    if (symbolOffset + (size_t)index->symbolCount * SYMBOLS_ENTRY_SIZE > index->file.size || hashOffset + (size_t)index->hashSize * 4 > index->file.size
+        || stringOffset + index->stringSize > index->file.size || (index->stringSize > 0 && index->file.data[stringOffset + index->stringSize - 1] != '\0')
+        || index->addressCount > index->symbolCount || index->hashSize == 0 || (index->hashSize & (index->hashSize - 1)) != 0
+        || index->hashSize < (unsigned int)index->symbolCount)
+    {
+        fprintf(stderr, "Error: Symbol index %s is truncated\n", path);
+        closeSymbolIndex(index);
+        return false;
+    }
+    index->symbols = index->file.data + symbolOffset;
+    index->slots = index->file.data + hashOffset;
+    index->strings = (const char*)index->file.data + stringOffset;
+    return true;
+}
+
+// Reads entry i (0 <= i < symbolCount) into symbol
+static inline void getIndexedSymbol(const SymbolIndex* index, int i, IndexedSymbol* symbol)
+{
+    const unsigned char* entry = index->symbols + (size_t)i * SYMBOLS_ENTRY_SIZE;
+    unsigned int name = getFileWord(entry + 4);
+    symbol->address = (int)getFileWord(entry);
+    symbol->name = name < index->stringSize ? index->strings + name : "";
+    symbol->line = (int)getFileWord(entry + 8);
+    symbol->absolute = (getFileWord(entry + 12) & SYMBOLS_ABSOLUTE) != 0;
+}
+
+// Finds a symbol by name through the hash slots. Returns false if the program has no such symbol
+static inline bool lookupSymbolName(const SymbolIndex* index, const char* name, IndexedSymbol* symbol)
+{
+    unsigned int mask = index->hashSize - 1;
+    unsigned int slot = symbolIndexHash(name) & mask;
+    for (unsigned int probes = 0; probes < index->hashSize; probes++, slot = (slot + 1) & mask)
+    {
+        unsigned int entry = getFileWord(index->slots + 4 * (size_t)slot);
+        if (entry == SYMBOLS_EMPTY_SLOT || entry >= (unsigned int)index->symbolCount)
+        {
+            return false;
+        }
+        getIndexedSymbol(index, (int)entry, symbol);
+        if (strcmp(symbol->name, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Finds the symbol address falls under: the last one at or before it, by binary search over the address-sorted part.
+// Of several symbols at the same address, the first defined is given. Returns false if address comes before them all
+static inline bool lookupNearestSymbol(const SymbolIndex* index, int address, IndexedSymbol* symbol)
+{
+    int low = 0, high = index->addressCount - 1, found = -1;
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        if ((int)getFileWord(index->symbols + (size_t)middle * SYMBOLS_ENTRY_SIZE) <= address)
+        {
+            found = middle;
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    if (found < 0)
+    {
+        return false;
+    }
+    int foundAddress = (int)getFileWord(index->symbols + (size_t)found * SYMBOLS_ENTRY_SIZE);
+    while (found > 0 && (int)getFileWord(index->symbols + (size_t)(found - 1) * SYMBOLS_ENTRY_SIZE) == foundAddress)
+    {
+        found--;
+    }
+    getIndexedSymbol(index, found, symbol);
+    return true;
+}
+
+#endif
@@ -0,0 +1,183 @@
+// Symbol table shared by both assemblers: names are interned in an arena and found through an open-addressing hash index
+#ifndef SICSYMTAB_H
+#define SICSYMTAB_H
+
+#include <string.h>
+#include <stdbool.h>
+#include "sicarena.h"
+
+// A symbol in SIC is like a function in C. This object stores the name and address of each symbol
+typedef struct Symbol
+{
+    const char* name;
+    int address;
+    int definedLine; // Source line of the label, 0 if not known
+    bool absolute;   // An EQU whose value is a number rather than an address
+    bool pending;    // An EQU that refers forward and hasn't been given its value yet
+    int block;       // Program block (USE) of the statement defining it. Pass 1 counts addresses from the block's start
+    int firstUse;    // Head and tail of its list in symbolUses, -1 if it has no recorded uses
+    int lastUse;
+} Symbol;
+
+// How an operand referred to a symbol, as bits that can be combined (BUFFER,X in format 4 is USE_INDEXED | USE_EXTENDED)
+#define USE_IMMEDIATE 0x01     // #symbol
+#define USE_INDIRECT 0x02      // @symbol
+#define USE_INDEXED 0x04       // symbol,X
+#define USE_EXTENDED 0x08      // +OPCODE symbol (format 4, direct 20 bit address)
+#define USE_PC_RELATIVE 0x10
+#define USE_BASE_RELATIVE 0x20
+
+// One reference to a symbol. Each symbol's uses are chained through next in the order pass 2 made them
+typedef struct SymbolUse
+{
+    int line;
+    int next;  // Index of the symbol's next use, -1 at the end
+    int mode;  // USE_ bits
+} SymbolUse;
+
+// Symbols in the order they were defined (the listing prints them in this order)
+Symbol* symbolTable = NULL;
+int symbolCount = 0;
+
+static int symbolCapacity = 0;
+static int* symbolHash = NULL;     // Indexes into symbolTable, -1 for an empty slot
+static int symbolHashSize = 0;     // Always a power of two, kept at least twice symbolCount
+static Arena* symbolArena = NULL;
+
+// Every recorded use, for the cross-reference. Only filled in while recordSymbolUses is set
+SymbolUse* symbolUses = NULL;
+int symbolUseCount = 0;
+bool recordSymbolUses = false;
+static int symbolUseCapacity = 0;
+
+static inline unsigned int hashSymbolName(const char* name, size_t length)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Empties the table. Its storage comes from arena, so it is released whenever that arena is reset
+static inline void resetSymbolTable(Arena* arena)
+{
+    symbolArena = arena;
+    symbolTable = NULL;
+    symbolCount = 0;
+    symbolCapacity = 0;
+    symbolHash = NULL;
+    symbolHashSize = 0;
+    symbolUses = NULL;
+    symbolUseCount = 0;
+    symbolUseCapacity = 0;
+}
+
+// Returns the index of the symbol whose name is the first length characters of name, or -1 if it isn't defined
+static inline int findSymbol(const char* name, size_t length)
+{
+    if (symbolHashSize == 0)
+    {
+        return -1;
+    }
+    unsigned int mask = symbolHashSize - 1;
+    for (unsigned int slot = hashSymbolName(name, length) & mask;; slot = (slot + 1) & mask)
+    {
+        int index = symbolHash[slot];
+        if (index < 0)
+        {
+            return -1;
+        }
+        if (strncmp(symbolTable[index].name, name, length) == 0 && symbolTable[index].name[length] == '\0')
+        {
+            return index;
+        }
+    }
+}
+
+static inline void insertSymbolHash(int index)
+{
+    unsigned int mask = symbolHashSize - 1;
+    unsigned int slot = hashSymbolName(symbolTable[index].name, strlen(symbolTable[index].name)) & mask;
+    while (symbolHash[slot] >= 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    symbolHash[slot] = index;
+}
+
+// Interns name and appends it to the table, returning its index, or -1 if it is already defined
+static inline int insertSymbol(const char* name, int address)
+{
+    if (findSymbol(name, strlen(name)) >= 0)
+    {
+        return -1;
+    }
+    if (symbolCount == symbolCapacity)
+    {
+        // Both arrays double, so the abandoned copies left in the arena never add up to more than the live ones
+        int capacity = symbolCapacity ? symbolCapacity * 2 : 64;
+        Symbol* table = arenaAlloc(symbolArena, capacity * sizeof(Symbol));
+        if (symbolCount > 0)
+        {
+            memcpy(table, symbolTable, symbolCount * sizeof(Symbol));
+        }
+        symbolTable = table;
+        symbolCapacity = capacity;
+
+        symbolHashSize = capacity * 2;
+        symbolHash = arenaAlloc(symbolArena, symbolHashSize * sizeof(int));
+        memset(symbolHash, -1, symbolHashSize * sizeof(int));
+        for (int i = 0; i < symbolCount; i++)
+        {
+            insertSymbolHash(i);
+        }
+    }
+    symbolTable[symbolCount].name = arenaStrdup(symbolArena, name);
+    symbolTable[symbolCount].address = address;
+    symbolTable[symbolCount].definedLine = 0;
+    symbolTable[symbolCount].absolute = false;
+    symbolTable[symbolCount].pending = false;
+    symbolTable[symbolCount].block = 0;
+    symbolTable[symbolCount].firstUse = -1;
+    symbolTable[symbolCount].lastUse = -1;
+    insertSymbolHash(symbolCount);
+    return symbolCount++;
+}
+
+// Appends a use to the symbol's list in constant (amortized) time, returning its index in symbolUses (-1 if uses aren't being recorded)
+static inline int addSymbolUse(int index, int line, int mode)
+{
+    if (!recordSymbolUses)
+    {
+        return -1;
+    }
+    if (symbolUseCount == symbolUseCapacity)
+    {
+        int capacity = symbolUseCapacity ? symbolUseCapacity * 2 : 256;
+        SymbolUse* uses = arenaAlloc(symbolArena, capacity * sizeof(SymbolUse));
+        if (symbolUseCount > 0)
+        {
+            memcpy(uses, symbolUses, symbolUseCount * sizeof(SymbolUse));
+        }
+        symbolUses = uses;
+        symbolUseCapacity = capacity;
+    }
+    SymbolUse* use = &symbolUses[symbolUseCount];
+    use->line = line;
+    use->next = -1;
+    use->mode = mode;
+    if (symbolTable[index].lastUse >= 0)
+    {
+        symbolUses[symbolTable[index].lastUse].next = symbolUseCount;
+    }
+    else
+    {
+        symbolTable[index].firstUse = symbolUseCount;
+    }
+    symbolTable[index].lastUse = symbolUseCount;
+    return symbolUseCount++;
+}
+
+#endif
@@ -0,0 +1,155 @@
+// The SIC/XE instruction set as the assembler and the disassembler see it: every opcode with its format, machine code
+// and operands, and the registers' names and numbers
+#ifndef SICXEOPTAB_H
+#define SICXEOPTAB_H
+
+#include <string.h>
+
+// What an instruction's operand field holds, which decides how it is encoded
+#define OPERANDS_NONE 0           // Nothing (RSUB, and every format 1 instruction)
+#define OPERANDS_MEMORY 1         // m: a memory operand, with the format 3/4 addressing modes
+#define OPERANDS_REGISTER 2       // r1 (CLEAR X)
+#define OPERANDS_REGISTERS 3      // r1,r2 (COMPR A,S)
+#define OPERANDS_REGISTER_COUNT 4 // r1,n: a shift count from 1 to 16, stored as n - 1 (SHIFTL A,4)
+#define OPERANDS_NUMBER 5         // n: a number from 0 to 15 (SVC 2)
+
+// Struct for an opcode containing its name, format, hex code, number of expected operands and what they are
+typedef struct OperationCodeTable
+{
+    char Mnemonic[7];
+    char Format;
+    unsigned short int MachineCode;
+    unsigned short int NumberOperands;
+    char OperandType;
+}SIC_OPTAB;
+
+// Table of opcodes (struct defined above): the whole SIC/XE instruction set. Kept in alphabetical order for the
+// binary search in findOpcode
+static const SIC_OPTAB OPTAB[] =
+{
+    {    "ADD",  '3',  0x18, 1, OPERANDS_MEMORY },
+    {   "ADDF",  '3',  0x58, 1, OPERANDS_MEMORY },
+    {   "ADDR",  '2',  0x90, 2, OPERANDS_REGISTERS },
+    {    "AND",  '3',  0x40, 1, OPERANDS_MEMORY },
+    {  "CLEAR",  '2',  0xB4, 1, OPERANDS_REGISTER },
+    {   "COMP",  '3',  0x28, 1, OPERANDS_MEMORY },
+    {  "COMPF",  '3',  0x88, 1, OPERANDS_MEMORY },
+    {  "COMPR",  '2',  0xA0, 2, OPERANDS_REGISTERS },
+    {    "DIV",  '3',  0x24, 1, OPERANDS_MEMORY },
+    {   "DIVF",  '3',  0x64, 1, OPERANDS_MEMORY },
+    {   "DIVR",  '2',  0x9C, 2, OPERANDS_REGISTERS },
+    {    "FIX",  '1',  0xC4, 0, OPERANDS_NONE },
+    {  "FLOAT",  '1',  0xC0, 0, OPERANDS_NONE },
+    {    "HIO",  '1',  0xF4, 0, OPERANDS_NONE },
+    {      "J",  '3',  0x3C, 1, OPERANDS_MEMORY },
+    {    "JEQ",  '3',  0x30, 1, OPERANDS_MEMORY },
+    {    "JGT",  '3',  0x34, 1, OPERANDS_MEMORY },
+    {    "JLT",  '3',  0x38, 1, OPERANDS_MEMORY },
+    {   "JSUB",  '3',  0x48, 1, OPERANDS_MEMORY },
+    {    "LDA",  '3',  0x00, 1, OPERANDS_MEMORY },
+    {    "LDB",  '3',  0x68, 1, OPERANDS_MEMORY },
+    {   "LDCH",  '3',  0x50, 1, OPERANDS_MEMORY },
+    {    "LDF",  '3',  0x70, 1, OPERANDS_MEMORY },
+    {    "LDL",  '3',  0x08, 1, OPERANDS_MEMORY },
+    {    "LDS",  '3',  0x6C, 1, OPERANDS_MEMORY },
+    {    "LDT",  '3',  0x74, 1, OPERANDS_MEMORY },
+    {    "LDX",  '3',  0x04, 1, OPERANDS_MEMORY },
+    {    "LPS",  '3',  0xD0, 1, OPERANDS_MEMORY },
+    {    "MUL",  '3',  0x20, 1, OPERANDS_MEMORY },
+    {   "MULF",  '3',  0x60, 1, OPERANDS_MEMORY },
+    {   "MULR",  '2',  0x98, 2, OPERANDS_REGISTERS },
+    {   "NORM",  '1',  0xC8, 0, OPERANDS_NONE },
+    {     "OR",  '3',  0x44, 1, OPERANDS_MEMORY },
+    {     "RD",  '3',  0xD8, 1, OPERANDS_MEMORY },
+    {    "RMO",  '2',  0xAC, 2, OPERANDS_REGISTERS },
+    {   "RSUB",  '3',  0x4C, 0, OPERANDS_NONE },
+    { "SHIFTL",  '2',  0xA4, 2, OPERANDS_REGISTER_COUNT },
+    { "SHIFTR",  '2',  0xA8, 2, OPERANDS_REGISTER_COUNT },
+    {    "SIO",  '1',  0xF0, 0, OPERANDS_NONE },
+    {    "SSK",  '3',  0xEC, 1, OPERANDS_MEMORY },
+    {    "STA",  '3',  0x0C, 1, OPERANDS_MEMORY },
+    {    "STB",  '3',  0x78, 1, OPERANDS_MEMORY },
+    {   "STCH",  '3',  0x54, 1, OPERANDS_MEMORY },
+    {    "STF",  '3',  0x80, 1, OPERANDS_MEMORY },
+    {    "STI",  '3',  0xD4, 1, OPERANDS_MEMORY },
+    {    "STL",  '3',  0x14, 1, OPERANDS_MEMORY },
+    {    "STS",  '3',  0x7C, 1, OPERANDS_MEMORY },
+    {   "STSW",  '3',  0xE8, 1, OPERANDS_MEMORY },
+    {    "STT",  '3',  0x84, 1, OPERANDS_MEMORY },
+    {    "STX",  '3',  0x10, 1, OPERANDS_MEMORY },
+    {    "SUB",  '3',  0x1C, 1, OPERANDS_MEMORY },
+    {   "SUBF",  '3',  0x5C, 1, OPERANDS_MEMORY },
+    {   "SUBR",  '2',  0x94, 2, OPERANDS_REGISTERS },
+    {    "SVC",  '2',  0xB0, 1, OPERANDS_NUMBER },
+    {     "TD",  '3',  0xE0, 1, OPERANDS_MEMORY },
+    {    "TIO",  '1',  0xF8, 0, OPERANDS_NONE },
+    {    "TIX",  '3',  0x2C, 1, OPERANDS_MEMORY },
+    {   "TIXR",  '2',  0xB8, 1, OPERANDS_REGISTER },
+    {     "WD",  '3',  0xDC, 1, OPERANDS_MEMORY },
+};
+
+#define OPTAB_SIZE (sizeof(OPTAB) / sizeof(SIC_OPTAB))
+
+// Finds an opcode's table entry, ignoring the + of format 4. NULL if there is no such instruction
+static inline const SIC_OPTAB* findOpcode(const char* OPCODE)
+{
+    if (OPCODE[0] == '+')
+    {
+        OPCODE++;
+    }
+    int low = 0, high = (int)OPTAB_SIZE - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        int order = strcmp(OPCODE, OPTAB[middle].Mnemonic);
+        if (order == 0)
+        {
+            return &OPTAB[middle];
+        }
+        if (order < 0)
+        {
+            high = middle - 1;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return NULL;
+}
+
+// Checks if the opcode name it is sent is in the opcode table
+static inline int isValidOpcode(char* OPCODE)
+{
+    return findOpcode(OPCODE) != NULL;
+}
+
+static inline unsigned short int getMachineCode(const char* OPCODE)
+{
+    const SIC_OPTAB* op = findOpcode(OPCODE);
+    return op != NULL ? op->MachineCode : 0; // Return 0 if opcode not found
+}
+
+static inline char getFormat(const char* OPCODE)
+{
+    const SIC_OPTAB* op = findOpcode(OPCODE);
+    return op != NULL ? op->Format : 0; // Return 0 if opcode not found
+}
+
+// Register names and their numbers in format 2 instructions (7 is unused)
+static const char* const RegisterNames[] = { "A", "X", "L", "B", "S", "T", "F", NULL, "PC", "SW" };
+
+// Returns the number of the register name names, or -1 if it isn't one
+static inline int getRegisterNumber(const char* name)
+{
+    for (int i = 0; i < (int)(sizeof(RegisterNames) / sizeof(RegisterNames[0])); i++)
+    {
+        if (RegisterNames[i] != NULL && strcmp(name, RegisterNames[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#endif
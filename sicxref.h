@@ -0,0 +1,105 @@
+// Cross-reference of every symbol: where it is defined and each line that uses it, built from the use lists pass 2 records
+#ifndef SICXREF_H
+#define SICXREF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "siccompat.h"
+#include "sicarena.h"
+#include "sicsymtab.h"
+
+static inline int compareSymbolNames(const void* a, const void* b)
+{
+    return strcmp(symbolTable[*(const int*)a].name, symbolTable[*(const int*)b].name);
+}
+
+// Symbol indexes in name order, allocated from arena
+static inline int* sortSymbolsByName(Arena* arena)
+{
+    int* order = arenaAlloc(arena, (symbolCount > 0 ? symbolCount : 1) * sizeof(int));
+    for (int i = 0; i < symbolCount; i++)
+    {
+        order[i] = i;
+    }
+    qsort(order, symbolCount, sizeof(int), compareSymbolNames);
+    return order;
+}
+
+// Writes one symbol's row: NAME, address, defining line, then each use as its line number followed by its mode marks
+static inline void writeCrossReferenceEntry(FILE* file, int index)
+{
+    const Symbol* symbol = &symbolTable[index];
+    fprintf(file, "%s\t%04X\t%d\t", symbol->name, symbol->address, symbol->definedLine);
+    for (int use = symbol->firstUse; use >= 0; use = symbolUses[use].next)
+    {
+        int mode = symbolUses[use].mode;
+        fprintf(file, "%s%d%s%s%s%s%s%s", use == symbol->firstUse ? "" : " ", symbolUses[use].line,
+            (mode & USE_EXTENDED) ? "+" : "",
+            (mode & USE_IMMEDIATE) ? "#" : "",
+            (mode & USE_INDIRECT) ? "@" : "",
+            (mode & USE_INDEXED) ? "X" : "",
+            (mode & USE_PC_RELATIVE) ? "P" : "",
+            (mode & USE_BASE_RELATIVE) ? "B" : "");
+    }
+    fprintf(file, "\n");
+}
+
+// Appends the cross-reference section to the listing, after the symbol table
+static inline void writeCrossReference(FILE* ListingFile, Arena* arena)
+{
+    if (ListingFile == NULL)
+    {
+        return;
+    }
+    int* order = sortSymbolsByName(arena);
+    fprintf(ListingFile, "\n\nCROSS REFERENCE (+ format 4, # immediate, @ indirect, X indexed, P PC-relative, B base-relative)\n");
+    fprintf(ListingFile, "SYMBOL\tADDRESS\tDEFINED\tREFERENCES\n");
+    for (int i = 0; i < symbolCount; i++)
+    {
+        writeCrossReferenceEntry(ListingFile, order[i]);
+    }
+}
+
+// Writes the cross-reference as its own file, with a fixed-width index up front so one symbol can be found without reading it all:
+//   SICXREF <count> <nameWidth>
+//   <count> index lines in name order: the name padded to nameWidth, a tab, the entry's 8 hex digit file offset, a newline
+//   the entries, in the same format as the listing section
+static inline void writeCrossReferenceFile(const char* path, Arena* arena)
+{
+    FILE* CrossReferenceFile = fopen(path, "wb");
+    if (CrossReferenceFile == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    int* order = sortSymbolsByName(arena);
+    long* offsets = arenaAlloc(arena, (symbolCount > 0 ? symbolCount : 1) * sizeof(long));
+    int nameWidth = 1;
+    for (int i = 0; i < symbolCount; i++)
+    {
+        int length = (int)strlen(symbolTable[i].name);
+        nameWidth = length > nameWidth ? length : nameWidth;
+    }
+
+    // The index has a fixed size, so the entries are written after a placeholder and the offsets filled in afterwards
+    fprintf(CrossReferenceFile, "SICXREF %d %d\n", symbolCount, nameWidth);
+    long indexStart = ftell(CrossReferenceFile);
+    for (int i = 0; i < symbolCount; i++)
+    {
+        fprintf(CrossReferenceFile, "%-*s\t%08X\n", nameWidth, "", 0);
+    }
+    for (int i = 0; i < symbolCount; i++)
+    {
+        offsets[i] = ftell(CrossReferenceFile);
+        writeCrossReferenceEntry(CrossReferenceFile, order[i]);
+    }
+    fseek(CrossReferenceFile, indexStart, SEEK_SET);
+    for (int i = 0; i < symbolCount; i++)
+    {
+        fprintf(CrossReferenceFile, "%-*s\t%08lX\n", nameWidth, symbolTable[order[i]].name, (unsigned long)offsets[i]);
+    }
+    fclose(CrossReferenceFile);
+}
+
+#endif